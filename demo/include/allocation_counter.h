@@ -0,0 +1,21 @@
+#ifndef INCL_ALLOCATION_COUNTER_H
+#define INCL_ALLOCATION_COUNTER_H
+
+#include <cstdint>
+
+/**
+ * @brief Counts the heap allocations of the whole process between start and stop.
+ *
+ * Two hooks cover the allocations a frame can cause: the replaced global operator new, including its std::align_val_t
+ * overloads (std containers, onnxruntime's and OpenCV's C++ objects, cv::AutoBuffer), and a counting cv::MatAllocator
+ * installed as OpenCV's default while counting, because every cv::Mat buffer comes from cv::fastMalloc (malloc /
+ * posix_memalign) and never from operator new. Plain malloc calls inside other libraries (e.g. onnxruntime's arena) are not seen.
+ *
+ * The operator new replacement lives in allocation_counter.cpp and is only compiled into the demo, not into the
+ * libraries the OBS plugin links. Counting is off by default and costs a relaxed atomic load per allocation.
+ */
+void start_counting_allocations();
+// Stops counting and returns the number of allocations since start_counting_allocations()
+uint64_t stop_counting_allocations();
+
+#endif // INCL_ALLOCATION_COUNTER_H
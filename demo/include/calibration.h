@@ -0,0 +1,58 @@
+#ifndef INCL_CALIBRATION_H
+#define INCL_CALIBRATION_H
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <opencv2/core/mat.hpp>
+
+#include "nn/autobackend.h"
+
+/*
+ * INT8 quantization workflow (see tools/quantize_int8.py):
+ *  1. `NudeNetCPPDemo calibrate <image_dir> [model] [calibration.npy]` runs local images through the same
+ *     preprocessing as inference (AutoBackendOnnx::preprocess, i.e. letterbox + _fill_blob) and stores the tensors.
+ *  2. `python tools/quantize_int8.py` collects the activation ranges from these tensors and writes a QDQ model.
+ *  3. `NudeNetCPPDemo compare <image_dir> <fp32 model> <int8 model>` reports detection agreement and latency.
+ * The QDQ model keeps the metadata of the original, AutoBackendOnnx loads it like any other model.
+ */
+
+/**
+ * @brief Preprocesses up to `max_images` images of `image_dir` into a [N, ch, H, W] float32 .npy file.
+ *
+ * @return Number of images written, 0 when nothing could be written.
+ */
+size_t write_calibration_tensors(AutoBackendOnnx& model, const std::string& image_dir, const std::string& output_path,
+    size_t max_images = 500, int conversionCode = -1);
+
+struct ClassAgreement {
+    size_t reference = 0;  // detections of the FP32 model
+    size_t candidate = 0;  // detections of the INT8 model
+    size_t matched = 0;    // pairs of the same class with IoU >= the match threshold
+
+    // 1 when both models found the same objects, 0 when none of them match
+    double agreement() const {
+        size_t total = std::max(reference, candidate);
+        return total > 0 ? static_cast<double>(matched) / total : 1.0;
+    }
+};
+
+struct ModelComparison {
+    std::vector<ClassAgreement> classes;  // indexed by class id
+    size_t images = 0;
+    double reference_seconds = 0.0;       // total predict_once time of the FP32 model
+    double candidate_seconds = 0.0;
+};
+
+/**
+ * @brief Runs both models over the images of `image_dir`, matching their detections per class.
+ *
+ * Detections are matched greedily by descending IoU within a class, a pair counts when its IoU is at least `match_iou`.
+ */
+ModelComparison compare_models(AutoBackendOnnx& reference, AutoBackendOnnx& candidate, const std::string& image_dir,
+    float conf, float iou, float mask_threshold, int conversionCode = -1, float match_iou = 0.5f, size_t max_images = 0);
+
+void print_model_comparison(const ModelComparison& comparison, const std::unordered_map<int, std::string>& names);
+
+#endif // INCL_CALIBRATION_H
@@ -0,0 +1,75 @@
+#ifndef INCL_CENSOR_H
+#define INCL_CENSOR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <opencv2/core/mat.hpp>
+
+#include "preprocess.h"
+
+enum class CensorMode {
+    Fill,      // solid box, what plot_results_fast draws
+    Pixelate,  // block-average mosaic
+    Blur,      // repeated separable box blur (3 passes are close to a gaussian)
+};
+
+struct CensorOptions {
+    CensorMode mode = CensorMode::Fill;
+    // Mosaic block size / blur radius as a fraction of the shorter box side, so small and large boxes look alike
+    float strength = 0.1f;
+    // Lower bound of the block size / blur radius in pixels
+    int min_kernel = 4;
+    int blur_passes = 3;
+    cv::Scalar fill_color = cv::Scalar(0, 0, 0);
+};
+
+// Row buffers reused between calls, a stream of frames censors without allocating once they reached their size
+struct CensorScratch {
+    std::vector<uint16_t> sums;    // column sums of one block row (pixelate) or of the sliding window (blur)
+    std::vector<uint8_t> row;      // one filled mosaic row
+    std::vector<uint8_t> region;   // the region after the horizontal blur pass
+};
+
+// A writable raw YUV frame (see YuvImage for the plane layout), censored without converting it to BGR
+struct YuvPlanes {
+    YuvLayout layout = YuvLayout::NV12;
+    uint8_t* data[3] = {};
+    int stride[3] = {};
+    int width = 0;
+    int height = 0;
+    // only used to convert CensorOptions::fill_color
+    YuvMatrix matrix = YuvMatrix::BT601;
+    bool fullRange = false;
+};
+
+// "fill", "pixelate" or "blur", false when `name` is none of them
+bool parse_censor_mode(const std::string& name, CensorMode& mode);
+std::string censor_mode_name(CensorMode mode);
+
+/*
+ * The kernels below work in place on the part of `roi` inside `image` (8-bit, 1, 3 or 4 channels; other depths
+ * fall back to cv::blur) and only read pixels inside it, so nothing outside the box leaks into the censored area.
+ */
+
+// Replaces every block_size x block_size block of the region with its average color
+void pixelate_region(cv::Mat& image, const cv::Rect& roi, int block_size, CensorScratch& scratch);
+
+// `passes` separable box blurs of radius `radius` (at most 127), edges are replicated
+void box_blur_region(cv::Mat& image, const cv::Rect& roi, int radius, int passes, CensorScratch& scratch);
+
+// Censors `roi` with the kernel selected by options.mode
+void censor_region(cv::Mat& image, const cv::Rect& roi, const CensorOptions& options, CensorScratch& scratch);
+
+/**
+ * @brief censor_region for YUV frames, writes the Y and chroma planes in place.
+ *
+ * The region is first grown to whole chroma samples (even x, and even y for NV12/I420), so luma and chroma censor
+ * exactly the same pixels and no colored fringe of the original stays at the box edges. Only the rows of the box are
+ * touched: fill is a memset (a repeated U/V or Y/U/Y/V pattern for the interleaved planes), pixelate and blur run the
+ * kernels above on the luma plane and on the chroma planes at half the block size / radius, blocks stay aligned.
+ * The frame width (and height for NV12/I420) must be even.
+ */
+void censor_yuv_region(YuvPlanes& frame, const cv::Rect& roi, const CensorOptions& options, CensorScratch& scratch);
+
+#endif // INCL_CENSOR_H
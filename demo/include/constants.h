@@ -6,7 +6,7 @@
 
 #define ORT_VERBOSE false
 #define DEBUG_INFO false
-#define TIMING_INFO true
+#define TIMING_INFO true  // compiles the benchmark helpers of the demo, the library reports through latency_histogram.h
 
 namespace MetadataConstants {
     inline const std::string IMGSZ = "imgsz";
@@ -23,6 +23,11 @@ namespace MetadataConstants {
 namespace OnnxProviders {
     inline const std::string CPU = "cpu";
     inline const std::string CUDA = "cuda";
+    inline const std::string XNNPACK = "xnnpack";
+    inline const std::string DNNL = "dnnl";
+    inline const std::string OPENVINO = "openvino";
+    // benchmark every CPU provider of the build on the model at startup and keep the fastest
+    inline const std::string AUTO = "auto";
 }
 
 namespace OnnxInitializers {
@@ -30,6 +35,13 @@ namespace OnnxInitializers {
     inline const int UNINITIALIZED_NC = -1;
 }
 
+// Calibration inference of OnnxProviders::AUTO
+namespace Calibration {
+    // size of dynamic (non-batch) input axes
+    inline const int CALIBRATION_DYNAMIC_DIM = 640;
+    inline const int CALIBRATION_RUNS = 3;
+}
+
 namespace Utils {
     // Padding value when letterbox changes image size ratio
     inline const int DEFAULT_LETTERBOX_PAD_VALUE = 114;
@@ -0,0 +1,51 @@
+#ifndef INCL_DIRECTORY_SCAN_H
+#define INCL_DIRECTORY_SCAN_H
+
+#include <string>
+
+#include "nn/autobackend.h"
+
+struct ScanOptions {
+    // Threads running cv::imread, 0 picks hardware_concurrency - 1 (the detector keeps the last core)
+    size_t reader_threads = 0;
+    // Decoded images buffered per reader thread
+    size_t queue_capacity = 8;
+    // Images per predict_batch call, only models with a dynamic batch axis benefit from more than 1
+    size_t batch_size = 1;
+    bool recursive = true;
+    float conf = 0.3f;
+    float iou = 0.45f;
+    float mask_threshold = 0.5f;
+    int conversion_code = -1;
+};
+
+struct ScanStats {
+    size_t images = 0;
+    size_t unreadable = 0;
+    size_t detections = 0;
+    double decode_seconds = 0.0;  // summed over the reader threads
+    double detect_seconds = 0.0;
+    double starved_seconds = 0.0; // time the detector waited for a decoded image
+    double wall_seconds = 0.0;
+
+    double imagesPerSecond() const { return wall_seconds > 0.0 ? images / wall_seconds : 0.0; }
+};
+
+/**
+ * @brief Runs the detector over every image below `directory` and writes one JSON line per file to `output_path`
+ * ("-" writes to stdout):
+ * {"path": "...", "width": 640, "height": 480, "detections": [{"class": "FACE_FEMALE", "class_id": 1, "confidence": 0.91, "box": [x, y, w, h]}]}
+ * Files that cannot be decoded get {"path": "...", "error": "unreadable"}.
+ *
+ * One model stays loaded for the whole scan. A pool of reader threads decodes the images ahead of the detector, each
+ * reader owns every Nth file and a bounded SpscQueue, so the records come out in sorted path order. An exception in a
+ * reader thread stops the scan and is rethrown here after all threads have joined.
+ *
+ * @return false when the output cannot be written or the directory has no images.
+ */
+bool scan_directory(AutoBackendOnnx& model, const std::string& directory, const std::string& output_path,
+    const ScanOptions& options, ScanStats& stats);
+
+void print_scan_stats(const ScanStats& stats);
+
+#endif // INCL_DIRECTORY_SCAN_H
@@ -0,0 +1,10 @@
+#ifndef INCL_IMAGE_FILES_H
+#define INCL_IMAGE_FILES_H
+
+#include <string>
+#include <vector>
+
+// Image files (jpg, jpeg, png, bmp, webp) directly inside `directory` (or anywhere below it), sorted by path
+std::vector<std::string> list_images(const std::string& directory, bool recursive = false);
+
+#endif // INCL_IMAGE_FILES_H
@@ -0,0 +1,87 @@
+#ifndef INCL_LATENCY_HISTOGRAM_H
+#define INCL_LATENCY_HISTOGRAM_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Point-in-time copy of a LatencyHistogram. The fields are read one by one with relaxed loads, so a snapshot taken
+ * while other threads record may be off by the samples recorded during the copy.
+ */
+struct HistogramSnapshot {
+    std::vector<uint64_t> counts;  // per bucket, see LatencyHistogram
+    uint64_t count = 0;
+    uint64_t sum_us = 0;
+    uint64_t max_us = 0;
+
+    double mean() const { return count > 0 ? static_cast<double>(sum_us) / static_cast<double>(count) / 1e6 : 0.0; }
+    double max() const { return static_cast<double>(max_us) / 1e6; }
+    // Latency (seconds) at or below which a fraction `p` (0..1) of the samples fall, the midpoint of its bucket
+    double percentile(double p) const;
+};
+
+/**
+ * @brief Log-linear (HDR style) histogram of latencies between 1us and ~19h.
+ *
+ * Values below 64us get one bucket per microsecond, every further power of two is split into 32 linear buckets,
+ * so a percentile is within ~3% of the exact value. record() is wait-free: a handful of relaxed atomic adds
+ * (the maximum is a short CAS loop), safe to call from any number of threads.
+ */
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 6;
+    static constexpr uint64_t SUB_BUCKETS = uint64_t(1) << SUB_BUCKET_BITS;  // 64
+    static constexpr uint64_t HALF_SUB_BUCKETS = SUB_BUCKETS / 2;           // 32
+    static constexpr int MAX_VALUE_BITS = 36;                                 // 2^36us ~ 19h, longer samples are clamped
+    static constexpr size_t BUCKETS = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 2) * HALF_SUB_BUCKETS;
+
+    void record(double seconds);
+    void recordMicroseconds(uint64_t us);
+    HistogramSnapshot snapshot() const;
+    void reset();
+
+    static size_t bucketIndex(uint64_t us);
+    // Smallest and largest value (microseconds) that falls into bucket `index`
+    static uint64_t bucketLowest(size_t index);
+    static uint64_t bucketHighest(size_t index);
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKETS> counts_{};
+    std::atomic<uint64_t> count_{ 0 };
+    std::atomic<uint64_t> sum_us_{ 0 };
+    std::atomic<uint64_t> max_us_{ 0 };
+};
+
+// Stages with a process-wide histogram, recorded by Timer (see nn_utils.h) and the predictors
+enum class LatencyStage {
+    Preprocess,
+    Inference,
+    Postprocess,
+    Total,        // preprocess + inference + postprocess of one predict_once call
+    Tracking,     // BoxTracker::predict on a frame without inference
+    SceneChange,  // SceneChangeDetector::hasChanged
+    Filter,       // FrameFilter::filter on the video thread (copy for the worker + censoring)
+    Count,
+};
+
+const char* latency_stage_name(LatencyStage stage);
+
+// Recording is on by default, turning it off makes Timer skip the histograms (the accumulators still work)
+bool latency_metrics_enabled();
+void set_latency_metrics_enabled(bool enabled);
+
+LatencyHistogram& latency_histogram(LatencyStage stage);
+void reset_latency_metrics();
+
+// Frames SceneChangePredictor answered with the previous results instead of an inference (counted while enabled)
+void record_scene_change_skip();
+uint64_t scene_change_skips();
+
+// One line per stage with samples: count, mean, p50, p95, p99 and max in milliseconds. With scene change checks, one
+// more line with the skipped frames, the skip ratio and the estimated time saved (skips * mean total - check time).
+std::string format_latency_report();
+
+#endif // INCL_LATENCY_HISTOGRAM_H
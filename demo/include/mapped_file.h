@@ -0,0 +1,42 @@
+#ifndef INCL_MAPPED_FILE_H
+#define INCL_MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Read-only view of a whole file, memory mapped when the platform allows it (mmap / MapViewOfFile)
+ * and read into memory otherwise. The view stays valid for the lifetime of the object.
+ */
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    bool isOpen() const { return data_ != nullptr; }
+    bool isMapped() const { return mapped_; }
+    const void* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    // Unmaps the file (or frees the buffer)
+    void close();
+
+private:
+    const void* data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    std::vector<char> buffer_;  // fallback when mapping fails
+#ifdef _WIN32
+    void* fileHandle_ = nullptr;
+    void* mappingHandle_ = nullptr;
+#endif
+};
+
+#endif // INCL_MAPPED_FILE_H
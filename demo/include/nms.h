@@ -0,0 +1,44 @@
+#ifndef INCL_NMS_H
+#define INCL_NMS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "postprocess.h"
+
+struct NmsOptions {
+    float iou_threshold = 0.45f;
+    bool class_agnostic = true;    // true: any two overlapping boxes compete (cv::dnn::NMSBoxes behaviour), false: only boxes of the same class
+    int top_k = 0;                 // keep at most top_k boxes, <= 0 means no limit
+    int max_candidates = 30000;    // only the max_candidates best scoring boxes enter NMS (ultralytics max_nms)
+};
+
+/**
+ * Reusable scratch memory for nms_boxes, boxes are gathered here in score order as {x1, y1, x2, y2}
+ * so the IoU of one box against all the remaining ones is computed over contiguous memory.
+ */
+struct NmsScratch {
+    std::vector<int> order;
+    std::vector<float> x1;
+    std::vector<float> y1;
+    std::vector<float> x2;
+    std::vector<float> y2;
+    std::vector<float> area;
+    std::vector<int32_t> cls;
+    std::vector<int32_t> suppressed;  // 0 or -1 (all bits set), usable directly as a SIMD mask
+};
+
+/**
+ * @brief Greedy non-maximum suppression on float boxes.
+ *
+ * @param candidates Candidate boxes {left, top, width, height} with scores and class ids.
+ * @param options See NmsOptions.
+ * @param keep Output, indices into candidates of the kept boxes, ordered by descending score.
+ * @param scratch Scratch buffers reused between calls.
+ *
+ * @return Number of kept boxes.
+ */
+size_t nms_boxes(const DetectionCandidates& candidates, const NmsOptions& options, std::vector<int>& keep, NmsScratch& scratch);
+
+#endif // INCL_NMS_H
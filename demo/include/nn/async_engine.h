@@ -0,0 +1,107 @@
+#ifndef NN_ASYNC_ENGINE_H
+#define NN_ASYNC_ENGINE_H
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <opencv2/core/mat.hpp>
+
+#include "autobackend.h"
+#include "spsc_queue.h"
+
+/**
+ * @brief Pipelined, asynchronous wrapper around AutoBackendOnnx.
+ *
+ * Preprocess, inference and postprocess run on three dedicated worker threads connected by bounded lock-free
+ * queues, so while frame N is in inference, frame N+1 is being letterboxed and frame N-1 decoded. Sustained
+ * throughput is bound by the slowest stage instead of the sum of all three. Results are delivered in submission order.
+ * Idle workers sleep on a condition variable until the previous stage hands them a frame.
+ *
+ * submit() must always be called from the same thread. The engine owns its own tensors, but shares the scratch
+ * memory of the model, so do not call predict_once/predict_batch on the same model while the engine is running.
+ */
+class AsyncInferenceEngine {
+public:
+    using Callback = std::function<void(std::vector<YoloResults>&& results, std::exception_ptr error)>;
+
+    /**
+     * @param model Model to run, must outlive the engine.
+     * @param conf The confidence threshold for object detection.
+     * @param iou The intersection-over-union (IoU) threshold for non-maximum suppression.
+     * @param conversionCode Conversion code passed to AutoBackendOnnx::preprocess (e.g., cv::COLOR_BGR2RGB).
+     * @param max_in_flight Maximum number of frames inside the pipeline, submit() blocks when it is reached.
+     *
+     * @throws std::invalid_argument if `max_in_flight` is 0.
+     */
+    AsyncInferenceEngine(AutoBackendOnnx& model, float conf, float iou, int conversionCode = -1, size_t max_in_flight = 4);
+    ~AsyncInferenceEngine();
+
+    AsyncInferenceEngine(const AsyncInferenceEngine&) = delete;
+    AsyncInferenceEngine& operator=(const AsyncInferenceEngine&) = delete;
+
+    /**
+     * @brief Queues a frame, the returned future becomes ready once its results are available.
+     *
+     * `image` is copied into a buffer owned by the pipeline, the caller may reuse it (e.g. `cap >> frame`) right away.
+     *
+     * @throws std::logic_error when called after stop() or from a result callback. The callback runs on the thread
+     * that frees the slots, waiting there for a slot would never return.
+     */
+    std::future<std::vector<YoloResults>> submit(const cv::Mat& image);
+
+    // Same as above, but `callback` is invoked on the postprocess worker thread instead. Exceptions it throws are
+    // caught and reported on stderr.
+    void submit(const cv::Mat& image, Callback callback);
+
+    // Finishes every queued frame and joins the workers. Called by the destructor.
+    void stop();
+
+private:
+    struct Slot {
+        cv::Mat image;   // copy of the submitted frame, reused across submissions of the same size
+        cv::Mat blob;    // [batch, ch, H, W]
+        cv::Mat output;  // [batch * features, preds_num], empty when output0 has dynamic axes
+        std::vector<Ort::Value> inputTensors;
+        std::vector<Ort::Value> outputTensors;  // pre-created, unless output0 has dynamic axes
+        std::vector<YoloResults> results;
+        std::promise<std::vector<YoloResults>> promise;
+        Callback callback;
+        std::exception_ptr error;
+    };
+
+    void _acquire_slot(size_t& slot_idx);
+    void _enqueue(size_t slot_idx);
+    void _preprocess_worker();
+    void _inference_worker();
+    void _postprocess_worker();
+
+    AutoBackendOnnx& model_;
+    float conf_;
+    float iou_;
+    int conversionCode_;
+    bool staticOutput_ = false;
+
+    std::vector<std::unique_ptr<Slot>> slots_;
+    SpscQueue<size_t> freeSlots_;        // postprocess worker -> submit()
+    SpscQueue<size_t> preprocessQueue_;  // submit() -> preprocess worker
+    SpscQueue<size_t> inferenceQueue_;   // preprocess worker -> inference worker
+    SpscQueue<size_t> postprocessQueue_; // inference worker -> postprocess worker
+
+    std::atomic<bool> stopping_{ false };
+    std::atomic<bool> preprocessDone_{ false };
+    std::atomic<bool> inferenceDone_{ false };
+    // each waiter sleeps on its signal while its queue is empty: submit() on a full pipeline and the three workers
+    QueueSignal freeSlotSignal_;
+    QueueSignal preprocessSignal_;
+    QueueSignal inferenceSignal_;
+    QueueSignal postprocessSignal_;
+    std::thread preprocessThread_;
+    std::thread inferenceThread_;
+    std::thread postprocessThread_;
+};
+
+#endif // NN_ASYNC_ENGINE_H
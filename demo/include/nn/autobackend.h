@@ -8,6 +8,10 @@
 
 #include "onnx_model_base.h"
 #include "constants.h"
+#include "nms.h"
+#include "postprocess.h"
+#include "preprocess.h"
+#include "tiling.h"
 
 /**
  * @brief Represents the results of YOLO prediction.
@@ -21,6 +25,31 @@ struct YoloResults {
     cv::Rect_<float> bbox;  // The bounding box of the detected object.
 };
 
+// Ultralytics metadata of a model, parsed once per process for every distinct model (see AutoBackendOnnx constructor)
+struct YoloMetadata {
+    std::vector<int> imgsz;
+    int stride = OnnxInitializers::UNINITIALIZED_STRIDE;
+    std::unordered_map<int, std::string> names;
+    std::string task;
+    int batch = 1;
+};
+
+// Per-frame input size selection, only used by models with dynamic height/width axes
+struct DynamicResolutionOptions {
+    bool enabled = false;
+    // Fraction of the metadata imgsz the frame is fitted into (stride aligned), lower is faster but finds less
+    float quality = 1.0f;
+};
+
+// Wall time of the stages of the last predict_once/predict_batch call (the whole batch for predict_batch)
+struct StageTimes {
+    double preprocess_seconds = 0.0;
+    double inference_seconds = 0.0;
+    double postprocess_seconds = 0.0;
+
+    double total() const { return preprocess_seconds + inference_seconds + postprocess_seconds; }
+};
+
 struct ImageInfo {
     cv::Size raw_size;  // add additional attrs if you need
 };
@@ -28,7 +57,7 @@ struct ImageInfo {
 
 class AutoBackendOnnx : public OnnxModelBase {
 public:
-    AutoBackendOnnx(const char* modelPath, const char* logid, const char* provider);
+    AutoBackendOnnx(const char* modelPath, const char* logid, const char* provider, const SessionConfig& sessionConfig = SessionConfig());
 
     // getters
     virtual const std::vector<int>& getImgsz();
@@ -41,6 +70,42 @@ public:
     virtual const int& getHeight();
     virtual const cv::Size& getCvSize();
     virtual const std::string& getTask();
+    virtual const int& getBatch();
+    virtual bool hasDynamicBatch();
+    // Static shape of output0 per image ([features, preds_num]), -1 when output0 has dynamic axes
+    virtual const int64_t& getOutputFeatures();
+    virtual const int64_t& getOutputAnchors();
+    virtual const NmsOptions& getNmsOptions();
+    virtual const StageTimes& getLastStageTimes();
+    // Whether the model was exported with dynamic height/width axes, i.e. setInputSize() can change the input size
+    virtual bool hasDynamicInputSize();
+    // Input size from the model metadata, getCvSize() differs from it after setInputSize()
+    virtual const cv::Size& getMetadataCvSize();
+
+    // The iou threshold passed to predict_once always overrides options.iou_threshold
+    virtual void setNmsOptions(const NmsOptions& options);
+
+    /**
+     * @brief Changes the input size of a model with dynamic height/width axes.
+     *
+     * @param size New input size, should be a multiple of getStride().
+     *
+     * @return false when the model has a fixed input size or `size` is empty, the input size is unchanged then.
+     *
+     * The input tensors are re-bound on the next call, do not change the size while an AsyncInferenceEngine is running.
+     */
+    virtual bool setInputSize(const cv::Size& size);
+
+    virtual const DynamicResolutionOptions& getDynamicResolution();
+    /**
+     * @brief Lets predict_once pick the input size of every frame from its aspect ratio and `options.quality`.
+     *
+     * The frame is fitted into the stride aligned quality-scaled imgsz and only padded up to the next stride multiple
+     * (letterbox_auto_shape()), so a 16:9 frame on a square model does not pay for the letterbox borders. The tensors are
+     * only re-bound when the size changes, a stream of same-sized frames keeps one binding. predict_batch and
+     * predict_tiled use the current input size. No-op (with a warning) for models with a fixed input size.
+     */
+    virtual void setDynamicResolution(const DynamicResolutionOptions& options);
 
     /**
      * @brief Runs object detection on an input image.
@@ -56,10 +121,89 @@ public:
      */
     virtual std::vector<YoloResults> predict_once(cv::Mat& image, float& conf, float& iou, float& mask_threshold, int conversionCode = -1);
 
+    /**
+     * @brief Runs object detection on a raw NV12/I420/YUY2 frame (e.g. from a capture card) without converting it to BGR.
+     *
+     * yuv_letterbox_to_blob() samples the frame only at model resolution and writes RGB straight into the input tensor,
+     * so the preprocessing cost follows the model size, not the frame size. The boxes are in frame coordinates.
+     */
+    virtual std::vector<YoloResults> predict_once(const YuvImage& image, float& conf, float& iou, float& mask_threshold);
+
+    /*
+     * predict_once into a caller owned vector. Every buffer of a call (tensors, preprocessing and NMS scratch, the
+     * intermediate images of the unfused path and `results` itself) is reused, so once a stream of same-sized frames
+     * warmed up, a frame costs no heap allocation outside onnxruntime's Run.
+     */
+    virtual void predict_once(cv::Mat& image, std::vector<YoloResults>& results, float& conf, float& iou, float& mask_threshold, int conversionCode = -1);
+    virtual void predict_once(const YuvImage& image, std::vector<YoloResults>& results, float& conf, float& iou, float& mask_threshold);
+
+    /**
+     * @brief Runs object detection on several images with a single session run.
+     *
+     * @param images The input images, they may have different sizes.
+     * @param conf The confidence threshold for object detection.
+     * @param iou The intersection-over-union (IoU) threshold for non-maximum suppression.
+     * @param mask_threshold The threshold for the semantic segmentation mask.
+     * @param conversionCode An optional conversion code for image format conversion (e.g., cv::COLOR_BGR2RGB).
+     *
+     * @return One vector of YoloResults per input image, in the same order, scaled back to the size of that image.
+     *
+     * The images are packed into one [N, ch, H, W] tensor when the model was exported with a dynamic batch axis
+     * (see hasDynamicBatch()), otherwise they are processed in chunks of the exported batch size.
+     */
+    virtual std::vector<std::vector<YoloResults>> predict_batch(const std::vector<cv::Mat>& images, float& conf, float& iou, float& mask_threshold, int conversionCode = -1);
+
+    /**
+     * @brief Runs object detection on overlapping tiles of a high resolution image.
+     *
+     * @param image The input image, e.g. a 1440p/4K capture.
+     * @param conf The confidence threshold for object detection.
+     * @param iou The IoU threshold for non-maximum suppression, both inside a tile and across tile seams.
+     * @param mask_threshold The threshold for the semantic segmentation mask.
+     * @param conversionCode An optional conversion code for image format conversion (e.g., cv::COLOR_BGR2RGB).
+     * @param options Tile size, overlap and whether the whole frame is inferred too, see TilingOptions.
+     *
+     * @return A vector of YoloResults in the coordinates of `image`.
+     *
+     * Small regions survive because every tile is letterboxed to the model size instead of the whole frame.
+     * The tiles (see tile_grid()) are views into `image` and run through predict_batch(), their boxes are offset
+     * back to the frame and merged across the seams with NMS. Falls back to predict_once() when a single tile covers
+     * the frame.
+     */
+    virtual std::vector<YoloResults> predict_tiled(cv::Mat& image, float& conf, float& iou, float& mask_threshold, int conversionCode = -1,
+        const TilingOptions& options = TilingOptions());
+
+    /*
+     * Individual stages of predict_once, used by pipelined callers like AsyncInferenceEngine that own their own tensors.
+     * preprocess and postprocess use separate scratch memory, so they may run concurrently with each other
+     * (and with OnnxModelBase::forward), but each of them must not be called from two threads at once.
+     */
+
+    // Letterboxes `image` into `blob`, a [ch, H, W] float tensor
+    virtual void preprocess(cv::Mat& image, float* blob, int conversionCode = -1);
+    // Letterboxes a YUV frame into `blob` as RGB, 3 channel models only
+    virtual void preprocess(const YuvImage& image, float* blob);
+    // Decodes output0 ([features, preds_num] of one image), applies NMS and scales the boxes to image_size
+    virtual void postprocess(cv::Mat& output0, const cv::Size& image_size, std::vector<YoloResults>& output, float conf, float iou);
+
 private:
+    // predict_once around a preprocessing step that fills the bound input tensor for an image of `image_size`
+    template <typename Preprocess>
+    void _predict_once(const cv::Size& image_size, std::vector<YoloResults>& results, float& conf, float& iou, Preprocess&& fill_input);
+    // output0 is the raw [features, preds_num] output of one image
     virtual void _postprocess_detects(cv::Mat& output0, ImageInfo image_info, std::vector<YoloResults>& output,
         int& class_names_num, float& conf_threshold, float& iou_threshold);
-    virtual void _fill_blob(cv::Mat& image, float*& blob, std::vector<int64_t>& inputTensorShape);
+    virtual void _fill_blob(cv::Mat& image, float* blob);
+    // Whether letterbox_to_blob can replace the letterbox + cvtColor + _fill_blob chain for this image/conversion
+    virtual bool _can_fuse_preprocess(const cv::Mat& image, int conversionCode, bool& swapRB);
+    // Input size setDynamicResolution() selects for an image of `image_size`
+    virtual cv::Size _dynamic_input_size(const cv::Size& image_size);
+    virtual void _init_io_tensors();
+    // (Re)creates the input/output tensors for `batch` images, no-op when they are already bound for that batch
+    virtual void _bind_io_tensors(int64_t batch);
+    // Runs the bound tensors, returns output0 as [bs * features, preds_num]
+    virtual cv::Mat _forward_bound();
+    virtual cv::Mat _output_of(const cv::Mat& rawOutput0, int index);
 
 protected:
     std::vector<int> imgsz_;
@@ -70,6 +214,36 @@ protected:
     std::vector<int64_t> inputTensorShape_;
     cv::Size cvSize_;
     std::string task_;
+    int batch_ = 1;
+    int64_t modelBatch_ = -1;  // batch size of the model input, -1 for a dynamic batch axis
+    bool dynamicInputSize_ = false;
+    cv::Size metadataCvSize_;
+    DynamicResolutionOptions dynamicResolution_;
+    StageTimes lastStageTimes_;
+
+    // Persistent input/output buffers, allocated once and reused by every predict_once/predict_batch call.
+    // inputBlob_ holds boundBatch_ x [ch, H, W] and outputBlob_ boundBatch_ x [features, preds] images,
+    // both allocated by OpenCV, which aligns the data to CV_MALLOC_ALIGN. They only grow with the batch size.
+    cv::Mat inputBlob_;
+    cv::Mat outputBlob_;
+    int64_t boundBatch_ = 0;
+    int64_t outputFeatures_ = -1;
+    int64_t outputAnchors_ = -1;
+    std::vector<int64_t> boundInputShape_;
+    std::vector<int64_t> boundOutputShape_;
+    std::vector<Ort::Value> inputTensors_;
+    std::vector<Ort::Value> outputTensors_;  // empty when output0 has dynamic axes, onnxruntime allocates it per run then
+    std::vector<Ort::Value> dynamicOutputTensors_;
+    // [batch, features, preds] of dynamicOutputTensors_, read after the first run of every binding
+    int64_t dynamicOutputShape_[3] = {};
+    bool dynamicOutputShapeKnown_ = false;
+    PreprocessScratch preprocessScratch_;
+    DetectionCandidates candidates_;
+    NmsOptions nmsOptions_;
+    NmsScratch nmsScratch_;
+    std::vector<int> nmsResult_;
+    std::vector<cv::Mat> tileViews_;
+    DetectionCandidates tileCandidates_;
 };
 
 #endif // NN_AUTOBACKEND_H
\ No newline at end of file
@@ -0,0 +1,56 @@
+#ifndef NN_EXECUTION_PROVIDERS_H
+#define NN_EXECUTION_PROVIDERS_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <onnxruntime_cxx_api.h>
+
+#include "session_config.h"
+
+/**
+ * An onnxruntime execution provider the session can be created with.
+ *
+ * `name` is the OnnxProviders name used by callers, `ort_name` the name reported by Ort::GetAvailableProviders()
+ * for builds that contain it. `append` attaches the provider to the session options and throws Ort::Exception
+ * when it cannot (e.g. the shared provider library is missing next to onnxruntime).
+ */
+struct ExecutionProvider {
+    std::string name;
+    std::string ort_name;
+    bool cpu = true;  // runs on the CPU, i.e. takes part in the automatic selection
+    std::function<void(Ort::SessionOptions&, const SessionConfig&)> append;
+};
+
+/**
+ * @brief Execution providers known to OnnxModelBase.
+ *
+ * Registered by default: cpu (the default CPU EP, always available), xnnpack, dnnl (oneDNN), openvino (CPU device)
+ * and cuda. Further providers can be added with add() before the first model is created.
+ */
+class ExecutionProviderRegistry {
+public:
+    static ExecutionProviderRegistry& instance();
+
+    // Replaces a provider with the same name
+    void add(const ExecutionProvider& provider);
+    // nullptr for an unknown name
+    const ExecutionProvider* find(const std::string& name) const;
+    // Registered providers the linked onnxruntime build contains, in registration order, cpu first
+    std::vector<const ExecutionProvider*> available(bool cpu_only = false) const;
+
+    /**
+     * @brief Attaches the provider `name` to `options`.
+     *
+     * @return false (with a warning) when the provider is unknown, missing from the build or fails to attach,
+     *         `options` then still runs on the default CPU EP.
+     */
+    bool attach(const std::string& name, Ort::SessionOptions& options, const SessionConfig& config) const;
+
+private:
+    ExecutionProviderRegistry();
+
+    std::vector<ExecutionProvider> providers_;
+};
+
+#endif // NN_EXECUTION_PROVIDERS_H
@@ -0,0 +1,175 @@
+#ifndef NN_FRAME_FILTER_H
+#define NN_FRAME_FILTER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/core/mat.hpp>
+
+#include "autobackend.h"
+#include "censor.h"
+#include "constants.h"
+#include "nn/session_config.h"
+#include "preprocess.h"
+#include "triple_buffer.h"
+
+// Pixel formats of the raw CPU frames the filter accepts (a subset of the libobs video_format enum)
+enum class FrameFormat {
+    Unsupported,
+    BGRA,
+    BGRX,
+    RGBA,
+    NV12,  // Y plane + interleaved UV plane, both at half resolution
+    I420,  // Y, U and V planes, U and V at half resolution
+    YUY2,  // packed Y0 U Y1 V, one U/V pair per two pixels
+};
+
+// A raw frame in the layout of obs_source_frame, the pixels are only referenced
+struct FrameView {
+    FrameFormat format = FrameFormat::Unsupported;
+    uint8_t* data[3] = {};
+    int linesize[3] = {};
+    int width = 0;
+    int height = 0;
+    // YUV formats only, how the samples map to RGB for the detector
+    YuvMatrix matrix = YuvMatrix::BT601;
+    bool fullRange = false;
+};
+
+struct FrameFilterOptions {
+    float conf = 0.3f;
+    float iou = 0.45f;
+    CensorOptions censor;
+};
+
+struct FrameFilterStats {
+    uint64_t frames = 0;      // frames passed to filter()
+    uint64_t submitted = 0;   // copies handed to the worker
+    uint64_t dropped = 0;     // submitted frames replaced by a newer one before the worker picked them up
+    uint64_t inferred = 0;    // frames the worker processed
+    uint64_t reused = 0;      // frames censored with detections an earlier frame already used (no newer inference done)
+    uint64_t failed = 0;      // inferences that threw
+};
+
+/**
+ * @brief Censors raw video frames with detections computed on a worker thread.
+ *
+ * Built for the asynchronous OBS filter path (filter_video on obs_source_frame): filter() runs on the source's video
+ * thread, censors the frame in place with the newest finished detections and, when asked to, copies the frame for the
+ * worker. Frames and detections are exchanged through lock-free TripleBuffers, so filter() never takes a lock or waits
+ * for the worker; it only notifies the worker, which sleeps on a condition variable while there is nothing to do. The
+ * worker only ever sees the newest submitted frame (older ones are dropped) and runs AutoBackendOnnx::predict_once on
+ * it without a color conversion pass (YUV frames go through the YuvImage overload), so a slow inference shows up as
+ * older boxes, never as a stalled video thread.
+ * The model is loaded on the worker thread too, frames pass through uncensored until it is ready.
+ *
+ * Nothing here depends on libobs, the plugin maps obs_source_frame to FrameView.
+ */
+class FrameFilter {
+public:
+    FrameFilter(const std::string& model_path, const SessionConfig& session_config = SessionConfig(),
+        const std::string& provider = OnnxProviders::CPU);
+    ~FrameFilter();
+
+    FrameFilter(const FrameFilter&) = delete;
+    FrameFilter& operator=(const FrameFilter&) = delete;
+
+    /**
+     * @brief Censors `frame` in place and, with `infer`, submits a copy of it for detection. Never waits for inference.
+     *
+     * The boxes of the newest finished inference are scaled to the frame size, so they lag behind by the inference
+     * latency (see InferenceScheduler for choosing `infer`). Always call it from the same thread.
+     */
+    void filter(FrameView& frame, bool infer);
+
+    // Applied from the next filter() call on. Not thread-safe against itself, call it from one thread at a time
+    void setOptions(const FrameFilterOptions& options);
+    // Reloads the model with the new options on the worker thread, the previous detections stay until then
+    void setSessionConfig(const SessionConfig& session_config);
+    // Input size for models with dynamic height/width (InferenceScheduler::getInputScale()), see setDynamicResolution
+    void setInputScale(float scale);
+
+    // Mean time (seconds) of the inferences finished since the last call, false when none finished (any thread)
+    bool takeInferenceSeconds(double& seconds);
+    bool isModelLoaded() const;
+    // Whether the loaded model has dynamic height/width, i.e. setInputScale() has an effect. False until isModelLoaded()
+    bool hasDynamicInputSize() const;
+    FrameFilterStats getStats() const;
+
+private:
+    // A compact (linesize = bytes per row) copy of a submitted frame, with the thresholds it was submitted with
+    struct FrameCopy {
+        FrameFormat format = FrameFormat::Unsupported;
+        int width = 0;
+        int height = 0;
+        YuvMatrix matrix = YuvMatrix::BT601;
+        bool fullRange = false;
+        float conf = 0.3f;
+        float iou = 0.45f;
+        std::vector<uint8_t> pixels;
+    };
+
+    struct Detections {
+        std::vector<YoloResults> results;
+        cv::Size frameSize;  // empty until the first inference finished
+    };
+
+    void _worker();
+    // `synchronize` takes the wake mutex so the notification cannot be lost. filter() skips it to stay lock-free,
+    // in the rare case it slips between the worker's check and its wait the frame is picked up with the next one.
+    void _wake_worker(bool synchronize);
+    bool _load_model(std::unique_ptr<AutoBackendOnnx>& model);
+    void _censor(FrameView& frame, std::vector<YoloResults>& results);
+
+    const std::string modelPath_;
+    const std::string provider_;
+
+    // video thread -> worker, worker -> video thread, setOptions -> video thread
+    TripleBuffer<FrameCopy> frames_;
+    TripleBuffer<Detections> detections_;
+    TripleBuffer<FrameFilterOptions> options_;
+
+    std::atomic<bool> stopping_{ false };
+    std::atomic<bool> reload_{ true };
+    std::atomic<bool> modelLoaded_{ false };
+    std::atomic<bool> dynamicInputSize_{ false };  // written before modelLoaded_
+    std::atomic<float> inputScale_{ 1.0f };
+    // finished inferences since the last takeInferenceSeconds() in the top bits, their total time (ns) below, one
+    // atomic so the reader never pairs the count of one inference with the time of two
+    static constexpr int INFERENCE_COUNT_SHIFT = 48;  // 2^48ns ~ 78h
+    std::atomic<uint64_t> inferenceTotals_{ 0 };
+    std::atomic<uint64_t> frameCount_{ 0 };
+    std::atomic<uint64_t> submittedCount_{ 0 };
+    std::atomic<uint64_t> droppedCount_{ 0 };
+    std::atomic<uint64_t> inferredCount_{ 0 };
+    std::atomic<uint64_t> reusedCount_{ 0 };
+    std::atomic<uint64_t> failedCount_{ 0 };
+
+    // only for reloads, never taken by filter()
+    std::mutex sessionConfigMutex_;
+    SessionConfig sessionConfig_;
+
+    // video thread only
+    std::vector<YoloResults> frameResults_;
+    CensorScratch censorScratch_;
+    FrameFilterOptions frameOptions_;
+
+    // the worker waits on wake_ while no frame or reload is pending
+    std::mutex wakeMutex_;
+    std::condition_variable wake_;
+    std::atomic<bool> wakeRequested_{ false };
+
+    std::thread worker_;
+};
+
+// Wraps a compact single-buffer frame (Y plane followed by the chroma planes for NV12/I420) as a FrameView
+FrameView frame_view_of(FrameFormat format, int width, int height, uint8_t* pixels);
+// Size of such a compact frame in bytes, 0 for unsupported formats or odd sizes of subsampled formats
+size_t frame_buffer_size(FrameFormat format, int width, int height);
+
+#endif // NN_FRAME_FILTER_H
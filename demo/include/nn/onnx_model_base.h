@@ -6,6 +6,9 @@
 #include <unordered_map>
 #include <vector>
 
+#include "mapped_file.h"
+#include "session_config.h"
+
 /*
  * This interface must provide only required arguments to load any onnx model regarding specific info -
  *  - i.e. modelPath will always be required, provider like "cpu" or "cuda" the same, since these are parameters you need
@@ -18,9 +21,12 @@ public:
      *
      * @param[in] modelPath Path to the model file.
      * @param[in] logid Log identifier.
-     * @param[in] provider Provider (e.g., "CPU" or "CUDA"). Use namespace OnnxProviders.
+     * @param[in] provider Provider (e.g., "cpu", "xnnpack" or "auto"). Use namespace OnnxProviders, see ExecutionProviderRegistry.
+     *  Falls back to the default CPU provider when the requested one is missing from the build or fails to load.
+     * @param[in] sessionConfig Threading/optimization options of the session and the optional optimized-model cache.
      */
-    OnnxModelBase(const char* modelPath, const char* logid, const char* provider);
+    OnnxModelBase(const char* modelPath, const char* logid, const char* provider, const SessionConfig& sessionConfig = SessionConfig());
+    virtual ~OnnxModelBase();
 
     virtual const std::vector<std::string>& getInputNames(); // = 0
     virtual const std::vector<std::string>& getOutputNames();
@@ -30,11 +36,42 @@ public:
     virtual const std::unordered_map<std::string, std::string>& getMetadata();
     virtual const char* getModelPath();
     virtual const Ort::Session& getSession();
+    virtual const SessionConfig& getSessionConfig();
+    // Provider the session actually runs on, the one picked by OnnxProviders::AUTO or cpu after a fallback
+    virtual const std::string& getProvider();
     virtual std::vector<Ort::Value> forward(std::vector<Ort::Value>& inputTensors);
+
+    /**
+     * @brief Runs the session writing into caller-owned, pre-created output tensors.
+     *
+     * @param[in] inputTensors Input tensors, one for each model input (in the order of getInputNames()).
+     * @param[in,out] outputTensors Pre-allocated output tensors, bound to the first outputTensors.size() model outputs.
+     *
+     * No output memory is allocated by onnxruntime, which lets callers reuse the same buffers for every frame.
+     */
+    virtual void forward(std::vector<Ort::Value>& inputTensors, std::vector<Ort::Value>& outputTensors);
     Ort::Session session{ nullptr };
 
 protected:
+    /**
+     * @brief Creates a session for the model at `path`, memory mapped when sessionConfig_.memory_map_model is set.
+     *
+     * ORT format models (.ort) are detected from the file identifier and used in place, without copying the mapped bytes.
+     */
+    Ort::Session _create_session(const std::string& path, const Ort::SessionOptions& baseOptions);
+
+    /**
+     * @brief Creates a session with every available CPU provider and times a few inferences on zero inputs.
+     *
+     * @return The name of the fastest provider, cpu when none of the others works. The choice is kept per model path
+     *         for the lifetime of the process, so re-created models (OBS scene switches) do not calibrate again.
+     */
+    std::string _select_fastest_provider(const Ort::SessionOptions& baseOptions);
+
     const char* modelPath_;
+    SessionConfig sessionConfig_;
+    std::string provider_;
+    MappedFile modelFile_;  // backs the session of an ORT format model
     Ort::Env env{ nullptr };
 
     std::vector<std::string> inputNodeNames;
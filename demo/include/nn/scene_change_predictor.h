@@ -0,0 +1,56 @@
+#ifndef NN_SCENE_CHANGE_PREDICTOR_H
+#define NN_SCENE_CHANGE_PREDICTOR_H
+
+#include <cstdint>
+#include <vector>
+#include <opencv2/core/mat.hpp>
+
+#include "autobackend.h"
+#include "scene_change.h"
+
+struct SceneChangeStats {
+    uint64_t frames = 0;
+    uint64_t skipped = 0;           // frames that reused the previous results
+    double inference_seconds = 0.0; // total predict_once time of the inferred frames
+    double detector_seconds = 0.0;  // total time spent in the change detector
+
+    double skipRatio() const { return frames > 0 ? static_cast<double>(skipped) / frames : 0.0; }
+    // Estimated time the skipped frames would have cost, minus the overhead of the detector
+    double savedSeconds() const {
+        uint64_t inferred = frames - skipped;
+        double average = inferred > 0 ? inference_seconds / inferred : 0.0;
+        return average * skipped - detector_seconds;
+    }
+};
+
+/**
+ * @brief Runs AutoBackendOnnx::predict_once only when the scene changed.
+ *
+ * Static content (slides, desktop capture, talking heads) reuses the results of the last inferred frame until
+ * SceneChangeDetector reports a change, the refresh interval forces a new inference, or the thresholds change.
+ */
+class SceneChangePredictor {
+public:
+    explicit SceneChangePredictor(AutoBackendOnnx& model, const SceneChangeOptions& options = SceneChangeOptions());
+
+    // Same contract as AutoBackendOnnx::predict_once
+    std::vector<YoloResults> predict_once(cv::Mat& image, float& conf, float& iou, float& mask_threshold, int conversionCode = -1);
+
+    // Forgets the cached results, the next frame is always inferred
+    void reset();
+
+    const SceneChangeStats& getStats() const { return stats_; }
+    SceneChangeDetector& getDetector() { return detector_; }
+
+private:
+    AutoBackendOnnx& model_;
+    SceneChangeDetector detector_;
+    SceneChangeStats stats_;
+    std::vector<YoloResults> lastResults_;
+    bool hasResults_ = false;
+    float lastConf_ = -1.0f;
+    float lastIou_ = -1.0f;
+    int lastConversionCode_ = -1;
+};
+
+#endif // NN_SCENE_CHANGE_PREDICTOR_H
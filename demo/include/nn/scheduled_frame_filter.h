@@ -0,0 +1,55 @@
+#ifndef NN_SCHEDULED_FRAME_FILTER_H
+#define NN_SCHEDULED_FRAME_FILTER_H
+
+#include <mutex>
+#include <string>
+
+#include "nn/frame_filter.h"
+#include "scheduler.h"
+
+/**
+ * @brief FrameFilter driven by InferenceScheduler, the per-frame loop of the OBS filter_video callback.
+ *
+ * filter() feeds the inference times the worker reported back into the scheduler, lets it pick whether this frame is
+ * submitted and at which input size, censors the frame and records the video thread's cost of frames that were not
+ * submitted. The OBS plugin and the demo's filter harness both run their frames through it, so the harness measures
+ * the same scheduling the plugin does. Once the model is loaded, the input scales are pinned to 1 for models without
+ * dynamic height/width (see fixed_size_if_static()), so the scheduler only adapts the interval for them.
+ *
+ * filter() runs on the video thread, the scheduler options may be changed from any other thread (the scheduler is
+ * guarded by a mutex that filter() holds only around the scheduler calls, never while censoring).
+ */
+class ScheduledFrameFilter {
+public:
+    ScheduledFrameFilter(const std::string& model_path, const SessionConfig& session_config = SessionConfig(),
+        const std::string& provider = OnnxProviders::CPU, const SchedulerOptions& options = SchedulerOptions());
+
+    ScheduledFrameFilter(const ScheduledFrameFilter&) = delete;
+    ScheduledFrameFilter& operator=(const ScheduledFrameFilter&) = delete;
+
+    /**
+     * @brief Censors `frame` in place and submits it for detection when the scheduler picks it, see FrameFilter::filter().
+     *
+     * @param frame_seconds Wall time since the previous frame (e.g. from the frame timestamps), see InferenceScheduler::nextFrame().
+     *
+     * @return Whether the frame was submitted for detection.
+     */
+    bool filter(FrameView& frame, double frame_seconds);
+
+    void setSchedulerOptions(const SchedulerOptions& options);
+    // The options as set, before the input scales are pinned for a fixed size model
+    SchedulerOptions getSchedulerOptions();
+    int getInterval();
+
+    // For options, session config and stats, do not call its filter() directly
+    FrameFilter& getFilter() { return filter_; }
+
+private:
+    FrameFilter filter_;
+    std::mutex schedulerMutex_;
+    SchedulerOptions options_;
+    bool inputSizeKnown_ = false;  // the scheduler got the options for the loaded model
+    InferenceScheduler scheduler_;
+};
+
+#endif // NN_SCHEDULED_FRAME_FILTER_H
@@ -0,0 +1,48 @@
+#ifndef NN_SCHEDULED_PREDICTOR_H
+#define NN_SCHEDULED_PREDICTOR_H
+
+#include <vector>
+#include <opencv2/core/mat.hpp>
+
+#include "autobackend.h"
+#include "scheduler.h"
+#include "tracker.h"
+
+/**
+ * @brief Runs AutoBackendOnnx::predict_once on the frames InferenceScheduler picks and propagates the detections
+ * with BoxTracker on the others, adapting the inference rate and the input size to the latency and CPU budgets.
+ *
+ * The input size only changes for models exported with dynamic height/width axes (see
+ * AutoBackendOnnx::hasDynamicInputSize()): the scale picked by the scheduler becomes the quality of the model's
+ * dynamic resolution. The scheduler only adapts the inference interval for any other model.
+ * The model is shared, its dynamic resolution options are restored by the destructor.
+ */
+class ScheduledPredictor {
+public:
+    ScheduledPredictor(AutoBackendOnnx& model, const SchedulerOptions& options = SchedulerOptions(), const TrackerOptions& tracker_options = TrackerOptions());
+    ~ScheduledPredictor();
+
+    ScheduledPredictor(const ScheduledPredictor&) = delete;
+    ScheduledPredictor& operator=(const ScheduledPredictor&) = delete;
+
+    /**
+     * @brief Same contract as AutoBackendOnnx::predict_once, call it for every frame of the stream.
+     *
+     * @param frame_seconds Wall time since the previous frame, see InferenceScheduler::nextFrame().
+     */
+    std::vector<YoloResults> predict_once(cv::Mat& image, float& conf, float& iou, float& mask_threshold, int conversionCode = -1, double frame_seconds = 0.0);
+
+    // Drops every track and the measurements, the next frame is always inferred at the largest input size
+    void reset();
+
+    InferenceScheduler& getScheduler() { return scheduler_; }
+    BoxTracker& getTracker() { return tracker_; }
+
+private:
+    AutoBackendOnnx& model_;
+    DynamicResolutionOptions previousResolution_;
+    InferenceScheduler scheduler_;
+    BoxTracker tracker_;
+};
+
+#endif // NN_SCHEDULED_PREDICTOR_H
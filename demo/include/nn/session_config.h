@@ -0,0 +1,77 @@
+#ifndef NN_SESSION_CONFIG_H
+#define NN_SESSION_CONFIG_H
+
+#include <string>
+#include <vector>
+
+/*
+ * Tuning knobs of the onnxruntime session, applied by OnnxModelBase when the session is created.
+ * Kept free of onnxruntime types, so it can be filled from a file, CLI flags or OBS filter settings
+ * without pulling in the onnxruntime headers.
+ */
+namespace SessionConfigDefaults {
+    inline const int THREADS_AUTO = 0;  // let onnxruntime decide (one thread per physical core)
+}
+
+enum class SessionOptimizationLevel {
+    Disable,
+    Basic,
+    Extended,
+    All,
+};
+
+enum class SessionExecutionMode {
+    Sequential,
+    Parallel,
+};
+
+struct SessionConfig {
+    SessionOptimizationLevel optimization_level = SessionOptimizationLevel::All;
+    int intra_op_threads = SessionConfigDefaults::THREADS_AUTO;
+    int inter_op_threads = SessionConfigDefaults::THREADS_AUTO;  // only used with SessionExecutionMode::Parallel
+    SessionExecutionMode execution_mode = SessionExecutionMode::Sequential;
+    bool mem_pattern = true;
+    bool cpu_mem_arena = true;
+    // Create the session from a memory mapped model file instead of letting onnxruntime read it from the path
+    bool memory_map_model = true;
+    // Whether idle intra-op threads spin waiting for work. Lowest latency, but burns CPU between frames.
+    bool allow_spinning = true;
+
+    // When set, the graph optimized by onnxruntime is serialized to this path on the first run and loaded from it
+    // (with graph optimizations disabled) on later runs. The file is regenerated when the source model is newer.
+    // The optimized graph may contain hardware specific nodes, so do not share it between machines.
+    std::string optimized_model_path;
+};
+
+/**
+ * @brief Sets a single SessionConfig field from its textual key/value form.
+ *
+ * Keys: graph_optimization_level (disable|basic|extended|all), intra_op_threads, inter_op_threads,
+ *  execution_mode (sequential|parallel), mem_pattern, cpu_mem_arena, memory_map_model, allow_spinning (true|false|1|0),
+ *  optimized_model_path. Dashes in keys are accepted in place of underscores.
+ *
+ * @return false (and prints a warning) when the key is unknown or the value cannot be parsed.
+ */
+bool set_session_config_value(SessionConfig& config, const std::string& key, const std::string& value);
+
+/**
+ * @brief Loads `key = value` lines from a file into `config`. Empty lines and lines starting with '#' are ignored.
+ *
+ * @return false when the file cannot be read or contains an invalid entry.
+ */
+bool load_session_config(const std::string& path, SessionConfig& config);
+
+/**
+ * @brief Consumes session flags from command line arguments.
+ *
+ * Recognizes `--session-config <file>` and `--<key> <value>` / `--<key>=<value>` for every key of set_session_config_value.
+ * Arguments that are not session flags are returned in their original order (e.g. the image path).
+ *
+ * @return false when a session flag is invalid or is missing its value.
+ */
+bool parse_session_config_args(const std::vector<std::string>& args, SessionConfig& config, std::vector<std::string>& remaining);
+
+std::string optimization_level_name(SessionOptimizationLevel level);
+std::string execution_mode_name(SessionExecutionMode mode);
+
+#endif // NN_SESSION_CONFIG_H
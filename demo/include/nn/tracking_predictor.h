@@ -0,0 +1,37 @@
+#ifndef NN_TRACKING_PREDICTOR_H
+#define NN_TRACKING_PREDICTOR_H
+
+#include <cstdint>
+#include <vector>
+#include <opencv2/core/mat.hpp>
+
+#include "autobackend.h"
+#include "tracker.h"
+
+/**
+ * @brief Runs AutoBackendOnnx::predict_once every `inference_interval` frames and propagates the detections with
+ * BoxTracker on the frames in between, so every frame gets censor boxes at a fraction of the inference cost.
+ */
+class TrackingPredictor {
+public:
+    TrackingPredictor(AutoBackendOnnx& model, int inference_interval = 3, const TrackerOptions& options = TrackerOptions());
+
+    // Same contract as AutoBackendOnnx::predict_once, call it for every frame of the stream
+    std::vector<YoloResults> predict_once(cv::Mat& image, float& conf, float& iou, float& mask_threshold, int conversionCode = -1);
+
+    // Drops every track, the next frame is always inferred
+    void reset();
+
+    int getInferenceInterval() const { return inferenceInterval_; }
+    // 1 runs inference on every frame (the tracker still smooths and expands the boxes)
+    void setInferenceInterval(int inference_interval);
+    BoxTracker& getTracker() { return tracker_; }
+
+private:
+    AutoBackendOnnx& model_;
+    BoxTracker tracker_;
+    int inferenceInterval_;
+    uint64_t frameIndex_ = 0;
+};
+
+#endif // NN_TRACKING_PREDICTOR_H
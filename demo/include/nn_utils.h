@@ -7,7 +7,9 @@
 #include <vector>
 #include <onnxruntime_c_api.h>
 #include <opencv2/core/types.hpp>
+#include "censor.h"
 #include "constants.h"
+#include "latency_histogram.h"
 #include "nn/onnx_model_base.h"
 #include "nn/autobackend.h"
 
@@ -65,30 +67,40 @@ void plot_results_with_classifications(cv::Mat img, std::vector<YoloResults>& re
 // Use for production
 void plot_results_fast(cv::Mat img, std::vector<YoloResults>& results);
 
+// Use for production, censors every box with the kernel selected by `options` (CensorMode::Fill draws like plot_results_fast)
+void plot_results_censored(cv::Mat img, std::vector<YoloResults>& results, const CensorOptions& options, CensorScratch& scratch);
+// Same for a raw YUV frame (e.g. from a capture card), the frame stays in its own format, see censor_yuv_region
+void plot_results_censored(YuvPlanes& frame, std::vector<YoloResults>& results, const CensorOptions& options, CensorScratch& scratch);
+
 /*
    ----------------------------
    ----- HELPER FUNCTIONS -----
    ----------------------------
 */
-#if TIMING_INFO
+// Adds the wall time (in seconds) between construction and Stop() to `accumulator`.
+// With a stage, the time is also recorded in that stage's latency histogram (while latency_metrics_enabled()).
 class Timer {
 public:
     Timer(double& accumulator, bool isEnabled = true);
+    Timer(double& accumulator, LatencyStage stage);
     void Stop();
 
 private:
     double& accumulator;
     bool isEnabled;
+    LatencyStage stage = LatencyStage::Count;
     std::chrono::time_point<std::chrono::high_resolution_clock> start;
 };
-#endif
 
 // Main purpose of this function is to parse `imgsz` key value of model metadata. Expected input: something like [544, 960] or [3,544, 960]
 std::vector<int> parse_imgsz_from_metadata(const std::string& input);
 
-// Main purpose of this function is to parse `names` key value of model metadata. Expected input: something like {Key: 0, Value: 'IDENTIFIER'}
+// Main purpose of this function is to parse `names` key value of model metadata. Expected input: something like {0: 'IDENTIFIER', 1: 'OTHER'}, quotes are stripped
 std::unordered_map<int, std::string> parse_names_from_metadata(const std::string& input);
 
 int64_t vector_product(const std::vector<int64_t>& vec);
 
+// Escapes quotes, backslashes and control characters for use inside a JSON string literal
+std::string json_escape(const std::string& value);
+
 #endif // NN_UTILS_H
\ No newline at end of file
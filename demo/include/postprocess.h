@@ -0,0 +1,47 @@
+#ifndef INCL_POSTPROCESS_H
+#define INCL_POSTPROCESS_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Structure-of-arrays buffer of the detection candidates that passed the confidence threshold.
+ *
+ * Boxes are stored as {left, top, width, height}. The vectors only ever grow, so after the first few frames
+ * decoding into the same instance does not allocate anymore.
+ */
+struct DetectionCandidates {
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> w;
+    std::vector<float> h;
+    std::vector<float> score;
+    std::vector<int> class_id;
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    void clear() { count = 0; }
+    void push_back(float left, float top, float width, float height, float conf, int cls);
+
+private:
+    size_t count = 0;
+};
+
+/**
+ * @brief Decodes YOLOv8 detection output in its native [features, preds_num] layout.
+ *
+ * @param output0 Pointer to output0 of one image, features = 4 box rows {cx, cy, w, h} followed by num_classes score rows.
+ * @param num_anchors Number of predictions (columns), e.g. 8400 for 640x640.
+ * @param num_classes Number of class score rows.
+ * @param conf_threshold Only anchors whose best class score is greater than this are kept.
+ * @param candidates Output buffer, cleared first.
+ *
+ * @return Number of decoded candidates.
+ *
+ * The per-anchor best class is computed with SIMD across anchors, box coordinates are only read for anchors
+ * that passed the threshold. Box geometry matches the original row-wise decoding (left/top clamped to 0).
+ */
+size_t decode_detections(const float* output0, int num_anchors, int num_classes, float conf_threshold,
+    DetectionCandidates& candidates);
+
+#endif // INCL_POSTPROCESS_H
@@ -0,0 +1,120 @@
+#ifndef INCL_PREPROCESS_H
+#define INCL_PREPROCESS_H
+
+#include <cstdint>
+#include <vector>
+#include <opencv2/core/mat.hpp>
+
+/**
+ * Describes how letterbox() / letterbox_to_blob() map an image of a given shape into the model input.
+ *
+ * newUnpad is the size of the resized image before padding, outShape is the final (padded) size.
+ * ratio holds the {width, height} scaling factors and top/bottom/left/right the padding in pixels.
+ */
+struct LetterboxGeometry {
+    cv::Size newUnpad;
+    cv::Size outShape;
+    float ratio[2]{ 1.0f, 1.0f };
+    int top = 0;
+    int bottom = 0;
+    int left = 0;
+    int right = 0;
+};
+
+LetterboxGeometry letterbox_geometry(const cv::Size& shape,
+    const cv::Size& newShape = cv::Size(640, 640),
+    bool auto_ = false,
+    bool scaleFill = false,
+    bool scaleUp = true,
+    int stride = 32
+);
+
+/**
+ * Stride aligned input size for an image of `shape` fitted into `maxShape` with the `auto_` mode of letterbox_geometry():
+ * the padding of each axis is cut down to less than one stride, so no compute is spent on letterbox borders.
+ * `maxShape` should be a multiple of `stride`.
+ */
+cv::Size letterbox_auto_shape(const cv::Size& shape, const cv::Size& maxShape, int stride = 32);
+
+/**
+ * Reusable scratch memory for letterbox_to_blob / yuv_letterbox_to_blob. Keep one instance per caller (e.g. per model)
+ * so that the buffers are allocated on the first frame only.
+ */
+struct PreprocessScratch {
+    std::vector<int> xofs0;      // left source pixel offset (in bytes) for every output column
+    std::vector<int> xofs1;      // right source pixel offset (in bytes) for every output column
+    std::vector<float> xweight;  // weight of the right source pixel for every output column
+    std::vector<float> rows;     // two horizontally resampled source rows, 3 planes each
+    // yuv_letterbox_to_blob only: the chroma column tables (the luma ones use xofs0/xofs1/xweight)
+    std::vector<int> cxofs0;
+    std::vector<int> cxofs1;
+    std::vector<float> cxweight;
+    // intermediate images of the unfused fallback (letterbox + cvtColor + fill_blob) in AutoBackendOnnx::preprocess
+    cv::Mat resized;
+    cv::Mat letterboxed;
+    cv::Mat converted;
+};
+
+enum class YuvLayout {
+    NV12,  // Y plane + interleaved UV plane at half width and height
+    I420,  // Y, U and V planes, U and V at half width and height
+    YUY2,  // packed Y0 U Y1 V, one U/V pair per two pixels of a row
+};
+
+enum class YuvMatrix {
+    BT601,
+    BT709,
+};
+
+/**
+ * A raw YUV frame as capture devices deliver it, the pixels are only referenced.
+ * data/stride hold the Y and UV planes (NV12), the Y, U and V planes (I420) or the single packed plane (YUY2).
+ */
+struct YuvImage {
+    YuvLayout layout = YuvLayout::NV12;
+    const uint8_t* data[3] = {};
+    int stride[3] = {};
+    int width = 0;
+    int height = 0;
+    YuvMatrix matrix = YuvMatrix::BT601;
+    bool fullRange = false;  // false: Y in 16..235, U/V in 16..240
+
+    cv::Size size() const { return cv::Size(width, height); }
+};
+
+/**
+ * @brief Fused letterbox + channel swap + normalization + HWC->CHW.
+ *
+ * @param image Source image, CV_8U with 1, 3 or 4 channels (grayscale is replicated, alpha is ignored).
+ * @param blob Destination planar float tensor of shape [3, geometry.outShape.height, geometry.outShape.width].
+ * @param geometry Letterbox geometry, see letterbox_geometry().
+ * @param swapRB Whether to swap the first and the third channel (e.g. BGR -> RGB).
+ * @param scratch Scratch buffers reused between calls.
+ * @param scale Factor applied to every value, including the padding.
+ *
+ * Bilinearly resizes the image (same sampling as cv::resize with cv::INTER_LINEAR) straight into the padded
+ * tensor, so the whole preprocessing is a single pass over the output without any intermediate cv::Mat.
+ */
+void letterbox_to_blob(const cv::Mat& image, float* blob, const LetterboxGeometry& geometry, bool swapRB,
+    PreprocessScratch& scratch, float scale = 1.0f / 255.0f);
+
+/**
+ * @brief letterbox_to_blob for YUV frames: resize + pad + YUV->RGB + normalization + HWC->CHW in one pass.
+ *
+ * Writes the R, G and B planes of `blob`. Y and the subsampled chroma are bilinearly sampled (cv::INTER_LINEAR
+ * coordinates of their own plane) only at the output resolution and converted afterwards, so a 4K capture costs the
+ * same as a 720p one and no full-size BGR frame is ever created. The width (and the height for NV12/I420) must be even.
+ */
+void yuv_letterbox_to_blob(const YuvImage& image, float* blob, const LetterboxGeometry& geometry,
+    PreprocessScratch& scratch, float scale = 1.0f / 255.0f);
+
+/**
+ * @brief Normalizes an already letterboxed image into a planar float tensor (the unfused fallback of letterbox_to_blob).
+ *
+ * @param image Letterboxed image, any depth that cv::Mat::convertTo handles, `blob` gets one plane per channel.
+ *              8-bit images are converted without temporaries, other depths go through a float copy.
+ * @param blob Destination planar float tensor of shape [channels, image.rows, image.cols].
+ */
+void fill_blob(const cv::Mat& image, float* blob);
+
+#endif // INCL_PREPROCESS_H
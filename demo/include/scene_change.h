@@ -0,0 +1,65 @@
+#ifndef INCL_SCENE_CHANGE_H
+#define INCL_SCENE_CHANGE_H
+
+#include <cstdint>
+#include <vector>
+#include <opencv2/core/mat.hpp>
+
+struct SceneChangeOptions {
+    // Mean absolute luma difference (0..1) between the current and the reference thumbnail above which the scene changed
+    float threshold = 0.02f;
+    // A single thumbnail cell changing by more than this (0..1) also counts, so small local changes are not averaged away
+    float cell_threshold = 0.15f;
+    // Force a change after this many consecutive unchanged frames, 0 never forces one
+    int refresh_interval = 30;
+    cv::Size thumbnail_size = cv::Size(64, 36);
+};
+
+/**
+ * @brief Cheap detector of meaningful changes between video frames.
+ *
+ * Every frame is reduced to a small luma thumbnail (block means over a sparse sample grid, so a 1080p frame costs
+ * ~150k pixel reads) and compared with the thumbnail of the reference frame, i.e. the last frame that was accepted
+ * for inference. Comparing against the reference rather than the previous frame lets slow drifts add up.
+ *
+ * Only 8-bit images with 1, 3 or 4 channels are analyzed, any other image always counts as changed.
+ */
+class SceneChangeDetector {
+public:
+    explicit SceneChangeDetector(const SceneChangeOptions& options = SceneChangeOptions());
+
+    /**
+     * @brief Whether `image` differs enough from the reference frame (or the refresh interval is reached).
+     *
+     * When it did not change, the unchanged frame counter is advanced. When it did, call accept() once the
+     * frame was processed to make it the new reference.
+     */
+    bool hasChanged(const cv::Mat& image);
+
+    // Makes the image of the last hasChanged() call the reference frame
+    void accept();
+
+    // Forgets the reference frame, the next frame always counts as changed
+    void reset();
+
+    // Mean absolute difference (0..1) computed by the last hasChanged() call
+    float lastDifference() const { return lastDifference_; }
+    const SceneChangeOptions& getOptions() const { return options_; }
+    void setOptions(const SceneChangeOptions& options);
+
+private:
+    // Returns false when the image type is not supported
+    bool _thumbnail(const cv::Mat& image, std::vector<uint8_t>& thumbnail);
+
+    SceneChangeOptions options_;
+    std::vector<uint8_t> reference_;
+    std::vector<uint8_t> current_;
+    cv::Size referenceSize_;
+    cv::Size currentSize_;
+    bool hasReference_ = false;
+    bool currentValid_ = false;
+    int unchangedFrames_ = 0;
+    float lastDifference_ = 0.0f;
+};
+
+#endif // INCL_SCENE_CHANGE_H
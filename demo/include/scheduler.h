@@ -0,0 +1,97 @@
+#ifndef INCL_SCHEDULER_H
+#define INCL_SCHEDULER_H
+
+#include <chrono>
+#include <vector>
+
+struct SchedulerOptions {
+    // Wall time (seconds) a single inference (preprocess + inference + postprocess) may take
+    double target_latency = 1.0 / 30.0;
+    // Maximum fraction (0..1) of the wall time the detector may keep its thread busy, the rest is left to the encoder
+    double max_cpu_share = 0.5;
+    // Inference runs on every `interval`-th frame, the interval stays within these bounds
+    int min_interval = 1;
+    int max_interval = 8;
+    // Model input sizes as fractions of the exported imgsz, largest first. A single entry keeps the size fixed.
+    std::vector<float> input_scales = { 1.0f, 0.75f, 0.5f };
+    // Weight of a new sample in the moving averages of the stage times and the frame period
+    double smoothing = 0.2;
+    // Quality is only raised when the estimate after the step stays below this fraction of both budgets
+    double headroom = 0.8;
+    // Inferences to wait after a change before the next one, so the averages settle on the new cost
+    int cooldown = 5;
+};
+
+/**
+ * @brief Decides how often the detector runs and at which input size, from measured stage times.
+ *
+ * Every video frame calls nextFrame(), which tells whether to run inference on it. The caller reports the measured
+ * time of the inference (AutoBackendOnnx::getLastStageTimes()) or of the cheap substitute used on the other frames
+ * (tracking, reused results), and the scheduler keeps moving averages of both and of the frame period.
+ *
+ * The CPU share is estimated as (latency + (interval - 1) * skipped frame cost) / (interval * frame period).
+ * Over budget, a too slow inference lowers the input size and a too high share raises the interval (the input size
+ * only drops when the interval is already at its maximum). Under budget, the input size is raised first, then the
+ * interval lowered, each only when the cost estimate of the step (inference cost ~ input area) keeps headroom.
+ */
+class InferenceScheduler {
+public:
+    explicit InferenceScheduler(const SchedulerOptions& options = SchedulerOptions());
+
+    /**
+     * @brief Advances to the next video frame.
+     *
+     * @param frame_seconds Wall time since the previous frame (e.g. the `seconds` of an OBS video_tick),
+     *                      values <= 0 measure it with a steady clock between the calls.
+     *
+     * @return Whether inference should run on this frame.
+     */
+    bool nextFrame(double frame_seconds = 0.0);
+
+    // Time of the inference run on a frame nextFrame() accepted, may adapt the interval and the input size
+    void recordInference(double seconds);
+    // Time spent on a frame without inference
+    void recordSkipped(double seconds);
+
+    // Forgets the measurements and goes back to the highest quality allowed by the options
+    void reset();
+
+    int getInterval() const { return interval_; }
+    int getScaleIndex() const { return scaleIndex_; }
+    float getInputScale() const { return options_.input_scales[scaleIndex_]; }
+    // Moving averages, 0 until the first sample
+    double getLatency() const { return latency_; }
+    double getSkippedCost() const { return skippedCost_; }
+    double getFramePeriod() const { return framePeriod_; }
+    // Estimated CPU share at the current interval and input size
+    double getCpuShare() const;
+    // Number of interval/input size changes so far
+    int getAdjustments() const { return adjustments_; }
+
+    const SchedulerOptions& getOptions() const { return options_; }
+    void setOptions(const SchedulerOptions& options);
+
+private:
+    void _adapt();
+    // Latency and CPU share estimates for an interval and an input scale index, scaled from the current measurements
+    double _estimate_latency(int scale_index) const;
+    double _estimate_share(int interval, int scale_index) const;
+
+    SchedulerOptions options_;
+    int interval_ = 1;
+    int scaleIndex_ = 0;
+    double latency_ = 0.0;
+    double skippedCost_ = 0.0;
+    double framePeriod_ = 0.0;
+    int framesSinceInference_ = 0;
+    int inferencesSinceChange_ = 0;
+    int adjustments_ = 0;
+    bool hasInferred_ = false;
+    bool hasLastFrame_ = false;
+    std::chrono::steady_clock::time_point lastFrame_;
+};
+
+// `options` with the input size pinned to the exported one for models without dynamic height/width
+SchedulerOptions fixed_size_if_static(SchedulerOptions options, bool dynamic_input_size);
+
+#endif // INCL_SCHEDULER_H
@@ -0,0 +1,20 @@
+#ifndef INCL_SIMD_H
+#define INCL_SIMD_H
+
+/*
+ * Compile-time selection of the SIMD instruction set used by the hand-vectorized kernels.
+ *  - NUDENET_AVX2 is set when the compiler targets AVX2 (enable it with the NUDENET_ENABLE_AVX2 cmake option)
+ *  - NUDENET_SSE2 is set on every x86-64 build
+ * Every kernel must keep a scalar tail/fallback, so the code also builds on other architectures (e.g. aarch64).
+ */
+#if defined(__AVX2__)
+#define NUDENET_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NUDENET_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#endif // INCL_SIMD_H
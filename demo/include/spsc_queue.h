@@ -0,0 +1,109 @@
+#ifndef INCL_SPSC_QUEUE_H
+#define INCL_SPSC_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * Bounded lock-free single-producer/single-consumer ring buffer.
+ *
+ * Exactly one thread may call try_push and exactly one (other) thread may call try_pop.
+ * The capacity is rounded up to a power of two.
+ */
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        buffer_.resize(size);
+        mask_ = size - 1;
+    }
+
+    bool try_push(T value) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) > mask_) {
+            return false;  // full
+        }
+        buffer_[tail & mask_] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& value) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;  // empty
+        }
+        value = std::move(buffer_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const { return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire); }
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    std::vector<T> buffer_;
+    size_t mask_ = 0;
+    alignas(64) std::atomic<size_t> head_{ 0 };  // next slot to pop, written by the consumer only
+    alignas(64) std::atomic<size_t> tail_{ 0 };  // next slot to push, written by the producer only
+};
+
+/**
+ * Spin -> yield -> sleep backoff for threads polling a lock-free queue, so idle workers do not burn a core.
+ */
+class Backoff {
+public:
+    void pause() {
+        if (spins_ < 64) {
+            ++spins_;
+        }
+        else if (spins_ < 128) {
+            ++spins_;
+            std::this_thread::yield();
+        }
+        else {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+    void reset() { spins_ = 0; }
+
+private:
+    int spins_ = 0;
+};
+
+/**
+ * Parks a thread waiting on lock-free queues instead of polling them: the waiter sleeps until `ready()` holds, the
+ * other side calls notify() after every push or state change it waits for. notify() takes the mutex, so a push cannot
+ * slip between the waiter's check and its wait.
+ */
+class QueueSignal {
+public:
+    template <typename Predicate>
+    void wait(Predicate ready) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait(lock, ready);
+    }
+
+    void notify() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+        }
+        condition_.notify_one();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable condition_;
+};
+
+#endif // INCL_SPSC_QUEUE_H
@@ -0,0 +1,75 @@
+#ifndef INCL_STAGE_BENCHMARK_H
+#define INCL_STAGE_BENCHMARK_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <opencv2/core/mat.hpp>
+
+#include "nn/autobackend.h"
+
+// Latency distribution of one stage at one source resolution, in milliseconds
+struct StageStats {
+    std::string stage;
+    cv::Size resolution;
+    size_t iterations = 0;
+    double mean = 0.0;
+    double stddev = 0.0;
+    double min = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+};
+
+struct StageBenchmarkOptions {
+    // Source frame sizes, the test image is resized to each of them
+    std::vector<cv::Size> resolutions = { cv::Size(640, 480), cv::Size(1280, 720), cv::Size(1920, 1080), cv::Size(3840, 2160) };
+    size_t iterations = 200;
+    size_t warmup = 10;
+    // forward is the same at every source resolution, it is measured once with `forward_iterations`
+    size_t forward_iterations = 50;
+    float conf = 0.3f;
+    float iou = 0.45f;
+    int conversion_code = -1;
+};
+
+// Runs `body` warmup + iterations times and summarizes the timed iterations
+StageStats measure_stage(const std::string& stage, const cv::Size& resolution, size_t iterations, size_t warmup, const std::function<void()>& body);
+
+/**
+ * @brief Measures every stage of the detection pipeline separately.
+ *
+ * Stages: letterbox, fill_blob (the unfused normalization), letterbox_to_blob (the fused kernel used by predict_once),
+ * nv12_cvtcolor_to_blob/yuv_letterbox_to_blob (an NV12 frame converted to BGR first vs sampled directly), forward,
+ * postprocess (decode + scale + NMS, i.e. _postprocess_detects), decode, nms, plot_fast, plot_classified,
+ * censor_pixelate/censor_blur (plot_results_censored) and censor_nv12_fill/censor_nv12_pixelate (the same on NV12
+ * planes). Only the stage itself is inside the timed region: inputs are prepared before, nothing is printed while
+ * timing.
+ */
+std::vector<StageStats> run_stage_benchmarks(AutoBackendOnnx& model, const cv::Mat& image, const StageBenchmarkOptions& options = StageBenchmarkOptions());
+
+// Heap allocations per call after warmup, see allocation_counter.h
+struct AllocationStats {
+    double predict_once = 0.0;
+    double forward = 0.0;  // onnxruntime's Run alone, on tensors of our own
+};
+
+/**
+ * @brief Counts the allocations of predict_once on `image` next to the ones of a bare forward.
+ *
+ * Every allocation above the forward count is one of ours, the steady state should have none. Both are warmed up with
+ * `options.warmup` calls and counted over `options.forward_iterations` calls.
+ */
+AllocationStats measure_allocations(AutoBackendOnnx& model, const cv::Mat& image, const StageBenchmarkOptions& options = StageBenchmarkOptions());
+
+void print_stage_stats(const std::vector<StageStats>& stats);
+
+/**
+ * @brief Writes the results as JSON: {"context": {...}, "benchmarks": [{"stage", "resolution", "iterations", "mean_ms", ...}]}.
+ *
+ * @return false when the file cannot be written.
+ */
+bool write_stage_stats_json(const std::string& path, const std::vector<StageStats>& stats, AutoBackendOnnx& model);
+
+#endif // INCL_STAGE_BENCHMARK_H
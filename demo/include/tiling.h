@@ -0,0 +1,26 @@
+#ifndef INCL_TILING_H
+#define INCL_TILING_H
+
+#include <vector>
+#include <opencv2/core/types.hpp>
+
+struct TilingOptions {
+    // Tile size in frame pixels, an empty size uses the model input size (tiles are then inferred without downscaling)
+    cv::Size tile_size;
+    // Overlap of neighbouring tiles as a fraction (0..0.9) of the tile size, an object cut by a seam is whole in the next tile
+    float overlap = 0.2f;
+    // Also infer the whole frame letterboxed to the model size, so objects larger than a tile are found in one piece
+    bool include_full_frame = true;
+};
+
+/**
+ * @brief Covers a frame with a grid of overlapping tiles.
+ *
+ * Along each axis the smallest number of tiles whose overlap is at least `overlap` is placed, spread evenly
+ * from edge to edge. Tiles never leave the frame, a frame smaller than a tile gets a single (clipped) tile.
+ *
+ * @return The tiles in row-major order.
+ */
+std::vector<cv::Rect> tile_grid(const cv::Size& frame_size, const cv::Size& tile_size, float overlap);
+
+#endif // INCL_TILING_H
@@ -0,0 +1,86 @@
+#ifndef INCL_TRACKER_H
+#define INCL_TRACKER_H
+
+#include <vector>
+#include <opencv2/core/types.hpp>
+
+#include "nn/autobackend.h"
+
+struct TrackerOptions {
+    // Minimum IoU between a predicted track and a detection of the same class to associate them
+    float iou_threshold = 0.3f;
+    // A track is dropped after this many frames without a matching detection
+    int max_age = 30;
+    // Box expansion, as a fraction of the box size added on each side: base + per_frame * frames since the last detection
+    float base_margin = 0.02f;
+    float margin_per_frame = 0.02f;
+    float max_margin = 0.5f;
+    // Standard deviations relative to the box height: measurement noise of detections and acceleration noise per frame
+    float measurement_noise = 0.05f;
+    float process_noise = 0.0125f;
+};
+
+/**
+ * @brief Constant-velocity Kalman filter of one box coordinate (position + velocity per frame).
+ */
+struct KalmanAxis {
+    float position = 0.0f;
+    float velocity = 0.0f;
+    float p00 = 0.0f, p01 = 0.0f, p11 = 0.0f;  // covariance
+
+    void init(float z, float position_var, float velocity_var);
+    void predict(float accel_var);
+    void correct(float z, float measurement_var);
+};
+
+struct Track {
+    KalmanAxis cx, cy, w, h;
+    int class_idx = 0;
+    float conf = 0.0f;
+    int frames_since_update = 0;
+
+    cv::Rect_<float> box() const;
+};
+
+/**
+ * @brief Lightweight multi-object tracker that propagates detections between inference frames.
+ *
+ * update() consumes the detections of a keyframe: every track is advanced by one frame, then tracks and detections of
+ * the same class are associated greedily by descending IoU. Matched tracks are corrected, unmatched detections start
+ * new tracks and unmatched tracks keep coasting on their motion model until max_age. predict() only advances the
+ * tracks, it costs a few hundred flops per object.
+ *
+ * The returned boxes are expanded by a margin that grows with the time since the last detection of the track, so the
+ * censor boxes rather cover too much than lag behind moving content.
+ */
+class BoxTracker {
+public:
+    explicit BoxTracker(const TrackerOptions& options = TrackerOptions());
+
+    // Keyframe: advances the tracks by one frame and corrects them with `detections`. Returns the tracked boxes.
+    const std::vector<YoloResults>& update(const std::vector<YoloResults>& detections, const cv::Size& frame_size);
+    // Intermediate frame: advances the tracks by one frame. Returns the predicted boxes.
+    const std::vector<YoloResults>& predict(const cv::Size& frame_size);
+
+    void reset();
+    const std::vector<Track>& getTracks() const { return tracks_; }
+    const TrackerOptions& getOptions() const { return options_; }
+
+private:
+    void _advance();
+    const std::vector<YoloResults>& _emit(const cv::Size& frame_size);
+
+    TrackerOptions options_;
+    std::vector<Track> tracks_;
+    std::vector<YoloResults> output_;
+    std::vector<bool> trackMatched_;
+    std::vector<bool> detectionMatched_;
+    struct Candidate {
+        float iou;
+        int track;
+        int detection;
+    };
+    std::vector<Candidate> candidates_;
+};
+
+#endif // INCL_TRACKER_H
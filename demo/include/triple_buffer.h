@@ -0,0 +1,52 @@
+#ifndef INCL_TRIPLE_BUFFER_H
+#define INCL_TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Lock-free single-producer/single-consumer "latest value" exchange.
+ *
+ * The producer fills back() and publish()es it, the consumer update()s to the newest published value and reads it
+ * through front(). Neither side ever waits: a value the consumer did not pick up in time is replaced by the next
+ * publish() (publish() reports that), and front() stays valid until the consumer calls update() again.
+ * Exactly one thread may use back()/publish() and exactly one (other) thread front()/update().
+ * Slots are reused, so values that own memory (vectors) stop allocating once every slot reached its size.
+ */
+template <typename T>
+class TripleBuffer {
+public:
+    // Slot owned by the producer, not visible to the consumer until publish()
+    T& back() { return slots_[back_]; }
+
+    // Hands back() over to the consumer, returns true when this replaced a published value that was never taken
+    bool publish() {
+        const uint8_t previous = middle_.exchange(static_cast<uint8_t>(back_ | FRESH), std::memory_order_acq_rel);
+        back_ = previous & INDEX_MASK;
+        return (previous & FRESH) != 0;
+    }
+
+    // Moves front() to the newest published value, false (front() unchanged) when nothing was published since
+    bool update() {
+        if ((middle_.load(std::memory_order_acquire) & FRESH) == 0) {
+            return false;
+        }
+        const uint8_t previous = middle_.exchange(front_, std::memory_order_acq_rel);
+        front_ = previous & INDEX_MASK;
+        return true;
+    }
+
+    // Slot owned by the consumer, a default constructed T before the first successful update()
+    T& front() { return slots_[front_]; }
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    static constexpr uint8_t FRESH = 0x4;  // set while the middle slot holds a value the consumer has not taken yet
+
+    T slots_[3];
+    alignas(64) std::atomic<uint8_t> middle_{ 1 };  // index of the exchange slot | FRESH
+    alignas(64) uint8_t back_ = 0;                  // producer only
+    alignas(64) uint8_t front_ = 2;                 // consumer only
+};
+
+#endif // INCL_TRIPLE_BUFFER_H
@@ -0,0 +1,54 @@
+#ifndef INCL_VIDEO_PIPELINE_H
+#define INCL_VIDEO_PIPELINE_H
+
+#include <cstdint>
+#include <string>
+
+#include "censor.h"
+#include "nn/autobackend.h"
+
+struct VideoProcessingOptions {
+    // 1 runs the detector on every frame, N > 1 every Nth frame with TrackingPredictor filling the gaps
+    int inference_interval = 1;
+    // Frames buffered between decoder -> detector and detector -> encoder
+    size_t queue_capacity = 8;
+    float conf = 0.3f;
+    float iou = 0.45f;
+    float mask_threshold = 0.5f;
+    int conversion_code = -1;
+    CensorOptions censor;
+    // Codec of the output, passed to cv::VideoWriter::fourcc
+    std::string fourcc = "mp4v";
+};
+
+// Busy time (seconds) per stage, each stage runs on its own thread so they overlap and can sum up to more than `wall_seconds`
+struct VideoProcessingStats {
+    uint64_t frames = 0;
+    uint64_t inferred_frames = 0;
+    double decode_seconds = 0.0;
+    double detect_seconds = 0.0;
+    double censor_seconds = 0.0;
+    double encode_seconds = 0.0;
+    // Time the detector waited for decoded frames / for room in the encoder queue
+    double starved_seconds = 0.0;
+    double blocked_seconds = 0.0;
+    double wall_seconds = 0.0;
+
+    double fps() const { return wall_seconds > 0.0 ? frames / wall_seconds : 0.0; }
+};
+
+/**
+ * @brief Censors every frame of a video file and writes the result to `output_path`, without opening any window.
+ *
+ * cv::VideoCapture decodes on one thread, cv::VideoWriter encodes on another, detection and plot_results_censored run
+ * on the calling thread. The stages are connected by bounded SpscQueues, so frames stay in order and memory stays
+ * bounded when one stage is slower than the others. Frame buffers are recycled from the encoder back to the decoder.
+ *
+ * @return false when the input cannot be opened or the output cannot be created.
+ */
+bool process_video(AutoBackendOnnx& model, const std::string& input_path, const std::string& output_path,
+    const VideoProcessingOptions& options, VideoProcessingStats& stats);
+
+void print_video_stats(const VideoProcessingStats& stats);
+
+#endif // INCL_VIDEO_PIPELINE_H
@@ -0,0 +1,98 @@
+#include "allocation_counter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#include <opencv2/core/mat.hpp>
+
+namespace {
+
+std::atomic<bool> countAllocations{ false };
+std::atomic<uint64_t> allocationCount{ 0 };
+
+void count_allocation() {
+    if (countAllocations.load(std::memory_order_relaxed)) {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// Forwards to OpenCV's standard allocator, which sets itself as the owner of the buffers, so they are freed by it
+class CountingMatAllocator : public cv::MatAllocator {
+public:
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, cv::AccessFlag flags,
+        cv::UMatUsageFlags usageFlags) const override {
+        if (!data) {
+            count_allocation();
+        }
+        return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    }
+
+    bool allocate(cv::UMatData* data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override {
+        return cv::Mat::getStdAllocator()->allocate(data, accessFlags, usageFlags);
+    }
+
+    void deallocate(cv::UMatData* data) const override {
+        cv::Mat::getStdAllocator()->deallocate(data);
+    }
+};
+
+CountingMatAllocator countingMatAllocator;
+cv::MatAllocator* previousMatAllocator = nullptr;
+
+} // namespace
+
+// The default operator new[] / nothrow new end up here as well
+void* operator new(std::size_t size) {
+    count_allocation();
+    void* p = std::malloc(size > 0 ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+// Over-aligned types (alignas > __STDCPP_DEFAULT_NEW_ALIGNMENT__) use these; the array and nothrow forms forward here too
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    count_allocation();
+    const std::size_t align = std::max(static_cast<std::size_t>(alignment), sizeof(void*));
+#ifdef _WIN32
+    void* p = _aligned_malloc(size > 0 ? size : 1, align);
+#else
+    void* p = nullptr;
+    if (posix_memalign(&p, align, size > 0 ? size : 1) != 0) {
+        p = nullptr;
+    }
+#endif
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+#ifdef _WIN32
+void operator delete(void* p, std::align_val_t) noexcept { _aligned_free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { _aligned_free(p); }
+#else
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+#endif
+
+void start_counting_allocations() {
+    previousMatAllocator = cv::Mat::getDefaultAllocator();
+    cv::Mat::setDefaultAllocator(&countingMatAllocator);
+    allocationCount.store(0, std::memory_order_relaxed);
+    countAllocations.store(true, std::memory_order_release);
+}
+
+uint64_t stop_counting_allocations() {
+    countAllocations.store(false, std::memory_order_release);
+    cv::Mat::setDefaultAllocator(previousMatAllocator);
+    return allocationCount.load(std::memory_order_relaxed);
+}
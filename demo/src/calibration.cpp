@@ -0,0 +1,194 @@
+#include "calibration.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <opencv2/imgcodecs.hpp>
+
+#include "image_files.h"
+#include "nn_utils.h"
+
+namespace {
+
+// Fixed size, so the header can be rewritten with the final image count once every image was processed
+constexpr size_t NPY_HEADER_SIZE = 128;
+
+void write_npy_header(std::ostream& out, const std::vector<int64_t>& shape) {
+    std::ostringstream dict;
+    dict << "{'descr': '<f4', 'fortran_order': False, 'shape': (";
+    for (int64_t dim : shape) {
+        dict << dim << ", ";
+    }
+    dict << "), }";
+    std::string header = dict.str();
+    const size_t preamble = 10;  // magic, version and header length
+    header.append(NPY_HEADER_SIZE - preamble - header.size() - 1, ' ');
+    header += '\n';
+
+    const uint16_t header_length = static_cast<uint16_t>(header.size());
+    out.write("\x93NUMPY\x01\x00", 8);
+    out.put(static_cast<char>(header_length & 0xff));
+    out.put(static_cast<char>(header_length >> 8));
+    out.write(header.data(), header.size());
+}
+
+float box_iou(const cv::Rect_<float>& a, const cv::Rect_<float>& b) {
+    float inter = (a & b).area();
+    float uni = a.area() + b.area() - inter;
+    return uni > 0.0f ? inter / uni : 0.0f;
+}
+
+// Greedy per-class matching by descending IoU, adds the counts of this image to `classes`
+void match_detections(const std::vector<YoloResults>& reference, const std::vector<YoloResults>& candidate, float match_iou,
+    std::vector<ClassAgreement>& classes) {
+    struct Pair {
+        float iou;
+        size_t r;
+        size_t c;
+    };
+    std::vector<Pair> pairs;
+    for (size_t r = 0; r < reference.size(); ++r) {
+        for (size_t c = 0; c < candidate.size(); ++c) {
+            if (reference[r].class_idx == candidate[c].class_idx) {
+                float iou = box_iou(reference[r].bbox, candidate[c].bbox);
+                if (iou >= match_iou) {
+                    pairs.push_back({ iou, r, c });
+                }
+            }
+        }
+    }
+    std::sort(pairs.begin(), pairs.end(), [](const Pair& a, const Pair& b) { return a.iou > b.iou; });
+
+    auto grow = [&](int cls) {
+        if (cls >= static_cast<int>(classes.size())) {
+            classes.resize(cls + 1);
+        }
+        return cls >= 0;
+    };
+    std::vector<bool> reference_used(reference.size(), false);
+    std::vector<bool> candidate_used(candidate.size(), false);
+    for (const Pair& pair : pairs) {
+        if (reference_used[pair.r] || candidate_used[pair.c]) {
+            continue;
+        }
+        reference_used[pair.r] = candidate_used[pair.c] = true;
+        if (grow(reference[pair.r].class_idx)) {
+            ++classes[reference[pair.r].class_idx].matched;
+        }
+    }
+    for (const YoloResults& result : reference) {
+        if (grow(result.class_idx)) {
+            ++classes[result.class_idx].reference;
+        }
+    }
+    for (const YoloResults& result : candidate) {
+        if (grow(result.class_idx)) {
+            ++classes[result.class_idx].candidate;
+        }
+    }
+}
+
+} // namespace
+
+size_t write_calibration_tensors(AutoBackendOnnx& model, const std::string& image_dir, const std::string& output_path,
+    size_t max_images, int conversionCode) {
+    std::vector<std::string> images = list_images(image_dir);
+    if (max_images > 0 && images.size() > max_images) {
+        images.resize(max_images);
+    }
+    if (images.empty()) {
+        std::cerr << "Error: No images found in " << image_dir << std::endl;
+        return 0;
+    }
+
+    std::ofstream out(output_path, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "Error: Cannot write " << output_path << std::endl;
+        return 0;
+    }
+    const std::vector<int64_t> image_shape = { model.getCh(), model.getHeight(), model.getWidth() };
+    write_npy_header(out, { 0, image_shape[0], image_shape[1], image_shape[2] });
+
+    // the same preprocessing as predict_once, so the ranges match what the model sees at runtime
+    std::vector<float> blob(static_cast<size_t>(vector_product(image_shape)));
+    size_t written = 0;
+    for (const std::string& path : images) {
+        cv::Mat image = cv::imread(path, cv::IMREAD_COLOR);
+        if (image.empty()) {
+            std::cerr << "Warning: Cannot read " << path << ", skipped" << std::endl;
+            continue;
+        }
+        model.preprocess(image, blob.data(), conversionCode);
+        out.write(reinterpret_cast<const char*>(blob.data()), static_cast<std::streamsize>(blob.size() * sizeof(float)));
+        ++written;
+    }
+
+    out.seekp(0);
+    write_npy_header(out, { static_cast<int64_t>(written), image_shape[0], image_shape[1], image_shape[2] });
+    if (!out.good()) {
+        std::cerr << "Error: Writing " << output_path << " failed" << std::endl;
+        return 0;
+    }
+    return written;
+}
+
+ModelComparison compare_models(AutoBackendOnnx& reference, AutoBackendOnnx& candidate, const std::string& image_dir,
+    float conf, float iou, float mask_threshold, int conversionCode, float match_iou, size_t max_images) {
+    ModelComparison comparison;
+    std::vector<std::string> images = list_images(image_dir);
+    if (max_images > 0 && images.size() > max_images) {
+        images.resize(max_images);
+    }
+
+    for (const std::string& path : images) {
+        cv::Mat image = cv::imread(path, cv::IMREAD_COLOR);
+        if (image.empty()) {
+            std::cerr << "Warning: Cannot read " << path << ", skipped" << std::endl;
+            continue;
+        }
+        if (comparison.images == 0) {
+            // the first run of a session allocates its arenas, keep it out of the latency
+            reference.predict_once(image, conf, iou, mask_threshold, conversionCode);
+            candidate.predict_once(image, conf, iou, mask_threshold, conversionCode);
+        }
+        std::vector<YoloResults> reference_results = reference.predict_once(image, conf, iou, mask_threshold, conversionCode);
+        comparison.reference_seconds += reference.getLastStageTimes().total();
+        std::vector<YoloResults> candidate_results = candidate.predict_once(image, conf, iou, mask_threshold, conversionCode);
+        comparison.candidate_seconds += candidate.getLastStageTimes().total();
+        match_detections(reference_results, candidate_results, match_iou, comparison.classes);
+        ++comparison.images;
+    }
+    return comparison;
+}
+
+void print_model_comparison(const ModelComparison& comparison, const std::unordered_map<int, std::string>& names) {
+    if (comparison.images == 0) {
+        std::cout << "No images were compared" << std::endl;
+        return;
+    }
+
+    ClassAgreement total;
+    std::cout << std::fixed << std::setprecision(1);
+    for (size_t cls = 0; cls < comparison.classes.size(); ++cls) {
+        const ClassAgreement& agreement = comparison.classes[cls];
+        if (agreement.reference == 0 && agreement.candidate == 0) {
+            continue;
+        }
+        auto name = names.find(static_cast<int>(cls));
+        std::cout << std::left << std::setw(28) << (name != names.end() ? name->second : std::to_string(cls)) << std::right
+            << " fp32 " << std::setw(6) << agreement.reference << ", int8 " << std::setw(6) << agreement.candidate
+            << ", matched " << std::setw(6) << agreement.matched << " -> " << agreement.agreement() * 100.0 << "% agreement" << std::endl;
+        total.reference += agreement.reference;
+        total.candidate += agreement.candidate;
+        total.matched += agreement.matched;
+    }
+
+    const double reference_ms = comparison.reference_seconds * 1000.0 / comparison.images;
+    const double candidate_ms = comparison.candidate_seconds * 1000.0 / comparison.images;
+    std::cout
+        << "Overall agreement " << total.agreement() * 100.0 << "% over " << comparison.images << " image(s) ; latency "
+        << reference_ms << "ms fp32, " << candidate_ms << "ms int8 (" << std::setprecision(2) << reference_ms / candidate_ms << "x)" << std::endl;
+}
@@ -0,0 +1,374 @@
+#include "censor.h"
+
+#include <algorithm>
+#include <cstring>
+#include <opencv2/imgproc.hpp>
+
+#include "simd.h"
+
+namespace {
+
+// sums[x] += src[x]
+void accumulate_row(const uint8_t* src, uint16_t* sums, int n) {
+    int x = 0;
+#if NUDENET_AVX2
+    for (; x + 16 <= n; x += 16) {
+        __m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x)));
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sums + x));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(sums + x), _mm256_add_epi16(s, v));
+    }
+#endif
+#if NUDENET_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; x + 16 <= n; x += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+        __m128i s0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + x));
+        __m128i s1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + x + 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + x), _mm_add_epi16(s0, _mm_unpacklo_epi8(v, zero)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + x + 8), _mm_add_epi16(s1, _mm_unpackhi_epi8(v, zero)));
+    }
+#endif
+    for (; x < n; ++x) {
+        sums[x] = static_cast<uint16_t>(sums[x] + src[x]);
+    }
+}
+
+// sums[x] += add[x] - sub[x], moves the vertical blur window down by one row (uint16 wraps, the result is exact)
+void slide_sums(uint16_t* sums, const uint8_t* add, const uint8_t* sub, int n) {
+    int x = 0;
+#if NUDENET_AVX2
+    for (; x + 16 <= n; x += 16) {
+        __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(add + x)));
+        __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sub + x)));
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sums + x));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(sums + x), _mm256_sub_epi16(_mm256_add_epi16(s, a), b));
+    }
+#endif
+#if NUDENET_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; x + 16 <= n; x += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(add + x));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sub + x));
+        __m128i s0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + x));
+        __m128i s1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + x + 8));
+        s0 = _mm_sub_epi16(_mm_add_epi16(s0, _mm_unpacklo_epi8(a, zero)), _mm_unpacklo_epi8(b, zero));
+        s1 = _mm_sub_epi16(_mm_add_epi16(s1, _mm_unpackhi_epi8(a, zero)), _mm_unpackhi_epi8(b, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + x), s0);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + x + 8), s1);
+    }
+#endif
+    for (; x < n; ++x) {
+        sums[x] = static_cast<uint16_t>(sums[x] + add[x] - sub[x]);
+    }
+}
+
+// dst[x] = (sums[x] * mul) >> 16, i.e. the window average with mul = 65536 / window
+void store_average(const uint16_t* sums, uint16_t mul, uint8_t* dst, int n) {
+    int x = 0;
+#if NUDENET_AVX2
+    const __m256i vmul = _mm256_set1_epi16(static_cast<short>(mul));
+    for (; x + 16 <= n; x += 16) {
+        __m256i avg = _mm256_mulhi_epu16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(sums + x)), vmul);
+        // packus works per 128-bit lane, gather the low 8 bytes of both lanes
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(avg, avg), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm256_castsi256_si128(packed));
+    }
+#endif
+#if NUDENET_SSE2
+    const __m128i vmul4 = _mm_set1_epi16(static_cast<short>(mul));
+    for (; x + 16 <= n; x += 16) {
+        __m128i avg0 = _mm_mulhi_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + x)), vmul4);
+        __m128i avg1 = _mm_mulhi_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + x + 8)), vmul4);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(avg0, avg1));
+    }
+#endif
+    for (; x < n; ++x) {
+        dst[x] = static_cast<uint8_t>((static_cast<uint32_t>(sums[x]) * mul) >> 16);
+    }
+}
+
+// Horizontal box blur of one row, a sliding window sum per channel with replicated edges
+void blur_row(const uint8_t* src, uint8_t* dst, int width, int cn, int radius, uint32_t mul) {
+    for (int c = 0; c < cn; ++c) {
+        uint32_t sum = static_cast<uint32_t>(radius + 1) * src[c];
+        for (int i = 1; i <= radius; ++i) {
+            sum += src[std::min(i, width - 1) * cn + c];
+        }
+        for (int x = 0; x < width; ++x) {
+            dst[x * cn + c] = static_cast<uint8_t>((sum * mul) >> 16);
+            sum += src[std::min(x + radius + 1, width - 1) * cn + c];
+            sum -= src[std::max(x - radius, 0) * cn + c];
+        }
+    }
+}
+
+bool has_fast_path(const cv::Mat& image) {
+    return image.depth() == CV_8U && image.channels() <= 4;
+}
+
+// Mosaic of block_width x block_height blocks, the body of pixelate_region
+void pixelate_blocks(cv::Mat& image, const cv::Rect& region, int block_width, int block_height, CensorScratch& scratch) {
+    const int cn = image.channels();
+    const int n = region.width * cn;
+    scratch.sums.resize(n);
+    scratch.row.resize(n);
+    for (int y0 = region.y; y0 < region.br().y; y0 += block_height) {
+        const int rows = std::min(block_height, region.br().y - y0);
+        std::fill(scratch.sums.begin(), scratch.sums.end(), uint16_t(0));
+        for (int y = y0; y < y0 + rows; ++y) {
+            accumulate_row(image.ptr<uint8_t>(y) + region.x * cn, scratch.sums.data(), n);
+        }
+
+        // one mosaic row, then copied over every row of the block
+        for (int bx = 0; bx < region.width; bx += block_width) {
+            const int cols = std::min(block_width, region.width - bx);
+            const uint32_t count = static_cast<uint32_t>(cols * rows);
+            for (int c = 0; c < cn; ++c) {
+                uint32_t total = 0;
+                for (int x = bx; x < bx + cols; ++x) {
+                    total += scratch.sums[x * cn + c];
+                }
+                const uint8_t value = static_cast<uint8_t>((total + count / 2) / count);
+                for (int x = bx; x < bx + cols; ++x) {
+                    scratch.row[x * cn + c] = value;
+                }
+            }
+        }
+        for (int y = y0; y < y0 + rows; ++y) {
+            std::memcpy(image.ptr<uint8_t>(y) + region.x * cn, scratch.row.data(), n);
+        }
+    }
+}
+
+// Writes `count` copies of a `size` byte pattern, memset for single bytes, otherwise memcpy of the doubling filled part
+void fill_pattern(uint8_t* dst, const uint8_t* pattern, int size, int count) {
+    if (count <= 0) {
+        return;
+    }
+    if (size == 1) {
+        std::memset(dst, pattern[0], count);
+        return;
+    }
+    const size_t total = static_cast<size_t>(size) * count;
+    std::memcpy(dst, pattern, size);
+    for (size_t filled = size; filled < total;) {
+        const size_t chunk = std::min(filled, total - filled);
+        std::memcpy(dst + filled, dst, chunk);
+        filled += chunk;
+    }
+}
+
+// CensorOptions::fill_color (BGR) as Y, U, V samples
+void yuv_fill_color(const cv::Scalar& bgr, YuvMatrix matrix, bool full_range, uint8_t yuv[3]) {
+    const double kr = matrix == YuvMatrix::BT709 ? 0.2126 : 0.299;
+    const double kb = matrix == YuvMatrix::BT709 ? 0.0722 : 0.114;
+    const double y = kr * bgr[2] + (1.0 - kr - kb) * bgr[1] + kb * bgr[0];
+    const double u = (bgr[0] - y) / (2.0 * (1.0 - kb));
+    const double v = (bgr[2] - y) / (2.0 * (1.0 - kr));
+    const double luma_range = full_range ? 1.0 : 219.0 / 255.0;
+    const double chroma_range = full_range ? 1.0 : 224.0 / 255.0;
+    yuv[0] = cv::saturate_cast<uint8_t>((full_range ? 0.0 : 16.0) + y * luma_range);
+    yuv[1] = cv::saturate_cast<uint8_t>(128.0 + u * chroma_range);
+    yuv[2] = cv::saturate_cast<uint8_t>(128.0 + v * chroma_range);
+}
+
+} // namespace
+
+bool parse_censor_mode(const std::string& name, CensorMode& mode) {
+    if (name == "fill") {
+        mode = CensorMode::Fill;
+    }
+    else if (name == "pixelate") {
+        mode = CensorMode::Pixelate;
+    }
+    else if (name == "blur") {
+        mode = CensorMode::Blur;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+std::string censor_mode_name(CensorMode mode) {
+    switch (mode) {
+    case CensorMode::Pixelate: return "pixelate";
+    case CensorMode::Blur: return "blur";
+    default: return "fill";
+    }
+}
+
+void pixelate_region(cv::Mat& image, const cv::Rect& roi, int block_size, CensorScratch& scratch) {
+    const cv::Rect region = roi & cv::Rect(0, 0, image.cols, image.rows);
+    // 256 rows of 255 still fit the uint16 column sums
+    block_size = std::clamp(block_size, 1, 256);
+    if (region.empty() || block_size == 1) {
+        return;
+    }
+    if (!has_fast_path(image)) {
+        cv::Mat view = image(region);
+        cv::blur(view, view, cv::Size(block_size, block_size));
+        return;
+    }
+
+    pixelate_blocks(image, region, block_size, block_size, scratch);
+}
+
+void box_blur_region(cv::Mat& image, const cv::Rect& roi, int radius, int passes, CensorScratch& scratch) {
+    const cv::Rect region = roi & cv::Rect(0, 0, image.cols, image.rows);
+    // the window (2 * radius + 1 rows of 255) has to fit the uint16 sums
+    radius = std::clamp(radius, 1, 127);
+    if (region.empty() || passes <= 0) {
+        return;
+    }
+    if (!has_fast_path(image)) {
+        cv::Mat view = image(region);
+        for (int pass = 0; pass < passes; ++pass) {
+            cv::blur(view, view, cv::Size(2 * radius + 1, 2 * radius + 1), cv::Point(-1, -1), cv::BORDER_REPLICATE);
+        }
+        return;
+    }
+
+    const int cn = image.channels();
+    const int n = region.width * cn;
+    const int h = region.height;
+    const uint32_t window = static_cast<uint32_t>(2 * radius + 1);
+    const uint16_t mul = static_cast<uint16_t>((65536 + window / 2) / window);
+    scratch.sums.resize(n);
+    scratch.region.resize(static_cast<size_t>(n) * h);
+    auto blurred_row = [&](int y) { return scratch.region.data() + static_cast<size_t>(n) * std::clamp(y, 0, h - 1); };
+
+    for (int pass = 0; pass < passes; ++pass) {
+        // image -> scratch.region along x (scalar, the window slides along the row)
+        for (int y = 0; y < h; ++y) {
+            blur_row(image.ptr<uint8_t>(region.y + y) + region.x * cn, blurred_row(y), region.width, cn, radius, mul);
+        }
+
+        // scratch.region -> image along y, every column slides at once, so this pass is vectorized
+        std::fill(scratch.sums.begin(), scratch.sums.end(), uint16_t(0));
+        for (int i = -radius; i <= radius; ++i) {
+            accumulate_row(blurred_row(i), scratch.sums.data(), n);
+        }
+        for (int y = 0; y < h; ++y) {
+            store_average(scratch.sums.data(), mul, image.ptr<uint8_t>(region.y + y) + region.x * cn, n);
+            slide_sums(scratch.sums.data(), blurred_row(y + radius + 1), blurred_row(y - radius), n);
+        }
+    }
+}
+
+void censor_region(cv::Mat& image, const cv::Rect& roi, const CensorOptions& options, CensorScratch& scratch) {
+    const cv::Rect region = roi & cv::Rect(0, 0, image.cols, image.rows);
+    if (region.empty()) {
+        return;
+    }
+    const int kernel = std::max(options.min_kernel, static_cast<int>(static_cast<float>(std::min(region.width, region.height)) * options.strength));
+    switch (options.mode) {
+    case CensorMode::Pixelate:
+        pixelate_region(image, region, kernel, scratch);
+        break;
+    case CensorMode::Blur:
+        box_blur_region(image, region, kernel, options.blur_passes, scratch);
+        break;
+    default:
+        cv::rectangle(image, region, options.fill_color, -1);
+        break;
+    }
+}
+
+void censor_yuv_region(YuvPlanes& frame, const cv::Rect& roi, const CensorOptions& options, CensorScratch& scratch) {
+    // grown to whole chroma samples, the frame size is even, so clipping keeps the alignment
+    const bool halfHeight = frame.layout != YuvLayout::YUY2;
+    const int left = roi.x & ~1;
+    const int top = halfHeight ? roi.y & ~1 : roi.y;
+    const int right = (roi.br().x + 1) & ~1;
+    const int bottom = halfHeight ? (roi.br().y + 1) & ~1 : roi.br().y;
+    const cv::Rect region = cv::Rect(left, top, right - left, bottom - top) & cv::Rect(0, 0, frame.width, frame.height);
+    if (region.empty()) {
+        return;
+    }
+    const int rowScale = halfHeight ? 2 : 1;
+    const cv::Rect chroma(region.x / 2, region.y / rowScale, region.width / 2, region.height / rowScale);
+    const int chromaHeight = frame.height / rowScale;
+    const int kernel = std::max(options.min_kernel, static_cast<int>(static_cast<float>(std::min(region.width, region.height)) * options.strength));
+
+    if (frame.layout == YuvLayout::YUY2) {
+        // Y0 U Y1 V pixel pairs, every 4 byte pair is one "pixel" of the chroma grid
+        cv::Mat pairs(frame.height, frame.width / 2, CV_8UC4, frame.data[0], frame.stride[0]);
+        switch (options.mode) {
+        case CensorMode::Pixelate: {
+            const int block = (std::clamp(kernel, 2, 256) + 1) & ~1;
+            pixelate_blocks(pairs, chroma, block / 2, block, scratch);
+            // Y0 and Y1 were averaged separately, over the same pixel count, so their mean is the block mean
+            for (int y = region.y; y < region.br().y; ++y) {
+                uint8_t* pair = pairs.ptr<uint8_t>(y) + chroma.x * 4;
+                for (int x = 0; x < chroma.width; ++x, pair += 4) {
+                    pair[0] = pair[2] = static_cast<uint8_t>((pair[0] + pair[2] + 1) / 2);
+                }
+            }
+            break;
+        }
+        case CensorMode::Blur:
+            // the radius counts pairs, so the blur reaches twice as far horizontally
+            box_blur_region(pairs, chroma, std::max(kernel / 2, 1), options.blur_passes, scratch);
+            break;
+        default: {
+            uint8_t yuv[3];
+            yuv_fill_color(options.fill_color, frame.matrix, frame.fullRange, yuv);
+            const uint8_t pattern[4] = { yuv[0], yuv[1], yuv[0], yuv[2] };
+            for (int y = region.y; y < region.br().y; ++y) {
+                fill_pattern(pairs.ptr<uint8_t>(y) + chroma.x * 4, pattern, 4, chroma.width);
+            }
+            break;
+        }
+        }
+        return;
+    }
+
+    cv::Mat luma(frame.height, frame.width, CV_8UC1, frame.data[0], frame.stride[0]);
+    // NV12: one interleaved UV plane, I420: separate U and V planes
+    cv::Mat chromaPlanes[2];
+    int chromaCount = 1;
+    if (frame.layout == YuvLayout::NV12) {
+        chromaPlanes[0] = cv::Mat(chromaHeight, frame.width / 2, CV_8UC2, frame.data[1], frame.stride[1]);
+    }
+    else {
+        chromaPlanes[0] = cv::Mat(chromaHeight, frame.width / 2, CV_8UC1, frame.data[1], frame.stride[1]);
+        chromaPlanes[1] = cv::Mat(chromaHeight, frame.width / 2, CV_8UC1, frame.data[2], frame.stride[2]);
+        chromaCount = 2;
+    }
+
+    switch (options.mode) {
+    case CensorMode::Pixelate: {
+        // even blocks, so every luma block covers whole chroma samples
+        const int block = (std::clamp(kernel, 2, 256) + 1) & ~1;
+        pixelate_blocks(luma, region, block, block, scratch);
+        for (int i = 0; i < chromaCount; ++i) {
+            pixelate_blocks(chromaPlanes[i], chroma, block / 2, block / 2, scratch);
+        }
+        break;
+    }
+    case CensorMode::Blur:
+        box_blur_region(luma, region, kernel, options.blur_passes, scratch);
+        for (int i = 0; i < chromaCount; ++i) {
+            box_blur_region(chromaPlanes[i], chroma, std::max(kernel / 2, 1), options.blur_passes, scratch);
+        }
+        break;
+    default: {
+        uint8_t yuv[3];
+        yuv_fill_color(options.fill_color, frame.matrix, frame.fullRange, yuv);
+        for (int y = region.y; y < region.br().y; ++y) {
+            std::memset(luma.ptr<uint8_t>(y) + region.x, yuv[0], region.width);
+        }
+        for (int y = chroma.y; y < chroma.br().y; ++y) {
+            if (chromaCount == 1) {
+                fill_pattern(chromaPlanes[0].ptr<uint8_t>(y) + chroma.x * 2, yuv + 1, 2, chroma.width);
+            }
+            else {
+                std::memset(chromaPlanes[0].ptr<uint8_t>(y) + chroma.x, yuv[1], chroma.width);
+                std::memset(chromaPlanes[1].ptr<uint8_t>(y) + chroma.x, yuv[2], chroma.width);
+            }
+        }
+        break;
+    }
+    }
+}
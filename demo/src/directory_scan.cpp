@@ -0,0 +1,196 @@
+#include "directory_scan.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <opencv2/imgcodecs.hpp>
+
+#include "image_files.h"
+#include "nn_utils.h"
+#include "spsc_queue.h"
+
+namespace {
+
+void write_record(std::ostream& out, const std::string& path, const cv::Mat& image, const std::vector<YoloResults>& results,
+    const std::unordered_map<int, std::string>& names) {
+    out << "{\"path\": \"" << json_escape(path) << "\", ";
+    if (image.empty()) {
+        out << "\"error\": \"unreadable\"}\n";
+        return;
+    }
+    out << "\"width\": " << image.cols << ", \"height\": " << image.rows << ", \"detections\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const YoloResults& result = results[i];
+        auto name = names.find(result.class_idx);
+        out << (i == 0 ? "" : ", ")
+            << "{\"class\": \"" << (name != names.end() ? json_escape(name->second) : std::to_string(result.class_idx)) << "\", "
+            << "\"class_id\": " << result.class_idx << ", \"confidence\": " << std::setprecision(4) << result.conf << ", "
+            << "\"box\": [" << std::setprecision(1) << result.bbox.x << ", " << result.bbox.y << ", "
+            << result.bbox.width << ", " << result.bbox.height << "]}";
+    }
+    out << "]}\n";
+}
+
+} // namespace
+
+bool scan_directory(AutoBackendOnnx& model, const std::string& directory, const std::string& output_path,
+    const ScanOptions& options, ScanStats& stats) {
+    std::vector<std::string> paths = list_images(directory, options.recursive);
+    if (paths.empty()) {
+        std::cerr << "Error: No images found in " << directory << std::endl;
+        return false;
+    }
+    std::ofstream file;
+    if (output_path != "-") {
+        file.open(output_path);
+        if (!file.is_open()) {
+            std::cerr << "Error: Cannot write " << output_path << std::endl;
+            return false;
+        }
+    }
+    std::ostream& out = output_path != "-" ? static_cast<std::ostream&>(file) : std::cout;
+    out << std::fixed;
+
+    size_t readers = options.reader_threads > 0 ? options.reader_threads : std::max(2u, std::thread::hardware_concurrency()) - 1;
+    readers = std::min(readers, paths.size());
+    const size_t batch_size = std::max<size_t>(options.batch_size, 1);
+
+    stats = ScanStats();
+    std::vector<std::unique_ptr<SpscQueue<cv::Mat>>> queues;
+    for (size_t r = 0; r < readers; ++r) {
+        queues.push_back(std::make_unique<SpscQueue<cv::Mat>>(options.queue_capacity));
+    }
+    std::vector<double> decodeSeconds(readers, 0.0);
+    std::vector<std::exception_ptr> readerErrors(readers);
+    std::atomic<bool> cancelled{ false };
+    auto wall_start = std::chrono::steady_clock::now();
+
+    // reader r decodes the files r, r + readers, r + 2 * readers, ... in order, an empty Mat marks an unreadable file.
+    // A reader that throws cancels the scan, its exception is rethrown to the caller once every thread has joined.
+    std::vector<std::thread> readerThreads;
+    for (size_t r = 0; r < readers; ++r) {
+        readerThreads.emplace_back([&, r]() {
+            try {
+                Backoff backoff;
+                for (size_t i = r; i < paths.size() && !cancelled.load(std::memory_order_acquire); i += readers) {
+                    Timer decode_timer = Timer(decodeSeconds[r], true);
+                    cv::Mat image = cv::imread(paths[i], cv::IMREAD_COLOR);
+                    decode_timer.Stop();
+                    backoff.reset();
+                    while (!queues[r]->try_push(image)) {
+                        if (cancelled.load(std::memory_order_acquire)) {
+                            return;
+                        }
+                        backoff.pause();
+                    }
+                }
+            }
+            catch (...) {
+                readerErrors[r] = std::current_exception();
+                cancelled.store(true, std::memory_order_release);
+            }
+        });
+    }
+
+    std::exception_ptr error;
+    try {
+        std::unordered_map<int, std::string> names = model.getNames();
+        float conf = options.conf;
+        float iou = options.iou;
+        float mask_threshold = options.mask_threshold;
+        std::vector<cv::Mat> decoded;
+        std::vector<cv::Mat> batch;
+        std::vector<std::vector<YoloResults>> results;
+        for (size_t next = 0; next < paths.size(); next += decoded.size()) {
+            // take the next files in order, waiting only for the first one of the batch
+            decoded.clear();
+            double starved_seconds = 0.0;
+            Timer starved_timer = Timer(starved_seconds, true);
+            Backoff backoff;
+            while (decoded.size() < batch_size && next + decoded.size() < paths.size()) {
+                size_t index = next + decoded.size();
+                cv::Mat image;
+                if (queues[index % readers]->try_pop(image)) {
+                    decoded.push_back(image);
+                    continue;
+                }
+                if (!decoded.empty() || cancelled.load(std::memory_order_acquire)) {
+                    break;
+                }
+                backoff.pause();
+            }
+            starved_timer.Stop();
+            stats.starved_seconds += starved_seconds;
+            if (decoded.empty()) {
+                break;  // a reader failed
+            }
+
+            batch.clear();
+            for (const cv::Mat& image : decoded) {
+                if (!image.empty()) {
+                    batch.push_back(image);
+                }
+            }
+            Timer detect_timer = Timer(stats.detect_seconds, true);
+            if (batch.size() == 1) {
+                results.assign(1, model.predict_once(batch[0], conf, iou, mask_threshold, options.conversion_code));
+            }
+            else if (!batch.empty()) {
+                results = model.predict_batch(batch, conf, iou, mask_threshold, options.conversion_code);
+            }
+            detect_timer.Stop();
+
+            size_t result_idx = 0;
+            for (size_t i = 0; i < decoded.size(); ++i) {
+                if (decoded[i].empty()) {
+                    write_record(out, paths[next + i], decoded[i], {}, names);
+                    ++stats.unreadable;
+                    continue;
+                }
+                write_record(out, paths[next + i], decoded[i], results[result_idx], names);
+                stats.detections += results[result_idx].size();
+                ++result_idx;
+                ++stats.images;
+            }
+        }
+    }
+    catch (...) {
+        error = std::current_exception();
+        cancelled.store(true, std::memory_order_release);
+    }
+
+    for (std::thread& thread : readerThreads) {
+        thread.join();
+    }
+    out.flush();
+    stats.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    for (double seconds : decodeSeconds) {
+        stats.decode_seconds += seconds;
+    }
+    for (const std::exception_ptr& reader_error : readerErrors) {
+        if (!error && reader_error) {
+            error = reader_error;
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return out.good();
+}
+
+void print_scan_stats(const ScanStats& stats) {
+    const size_t files = stats.images + stats.unreadable;
+    std::cerr << std::fixed << std::setprecision(1)
+        << "Scanned " << files << " file(s) (" << stats.unreadable << " unreadable, " << stats.detections << " detection(s)) in "
+        << stats.wall_seconds << "s, " << stats.imagesPerSecond() << " images/s" << std::endl
+        << std::setprecision(2)
+        << "  decode  " << (files > 0 ? stats.decode_seconds * 1000.0 / files : 0.0) << "ms/image (summed over the reader threads)" << std::endl
+        << "  detect  " << (stats.images > 0 ? stats.detect_seconds * 1000.0 / stats.images : 0.0) << "ms/image" << std::endl
+        << "  detector waited " << stats.starved_seconds << "s for decoded images" << std::endl;
+}
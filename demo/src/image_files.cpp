@@ -0,0 +1,39 @@
+#include "image_files.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+std::vector<std::string> list_images(const std::string& directory, bool recursive) {
+    std::vector<std::string> images;
+    std::error_code error;
+    auto add_image = [&](const fs::directory_entry& entry) {
+        std::error_code entry_error;
+        if (!entry.is_regular_file(entry_error)) {
+            return;
+        }
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        if (extension == ".jpg" || extension == ".jpeg" || extension == ".png" || extension == ".bmp" || extension == ".webp") {
+            images.push_back(entry.path().string());
+        }
+    };
+    if (recursive) {
+        for (const fs::directory_entry& entry : fs::recursive_directory_iterator(directory, fs::directory_options::skip_permission_denied, error)) {
+            add_image(entry);
+        }
+    }
+    else {
+        for (const fs::directory_entry& entry : fs::directory_iterator(directory, error)) {
+            add_image(entry);
+        }
+    }
+    if (error) {
+        std::cerr << "Warning: Cannot list " << directory << ": " << error.message() << std::endl;
+    }
+    std::sort(images.begin(), images.end());
+    return images;
+}
@@ -0,0 +1,173 @@
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+// Index of the highest set bit, v must not be 0
+inline int highest_bit(uint64_t v) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, v);
+    return static_cast<int>(index);
+#else
+    return 63 - __builtin_clzll(v);
+#endif
+}
+
+std::atomic<bool> metricsEnabled{ true };
+std::array<LatencyHistogram, static_cast<size_t>(LatencyStage::Count)> stageHistograms;
+std::atomic<uint64_t> sceneChangeSkips{ 0 };
+
+} // namespace
+
+double HistogramSnapshot::percentile(double p) const {
+    if (count == 0 || counts.empty()) {
+        return 0.0;
+    }
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(std::clamp(p, 0.0, 1.0) * static_cast<double>(count))));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            uint64_t mid = (LatencyHistogram::bucketLowest(i) + LatencyHistogram::bucketHighest(i)) / 2;
+            return static_cast<double>(std::min(mid, max_us)) / 1e6;
+        }
+    }
+    return max();
+}
+
+size_t LatencyHistogram::bucketIndex(uint64_t us) {
+    us = std::min(us, (uint64_t(1) << MAX_VALUE_BITS) - 1);
+    if (us < SUB_BUCKETS) {
+        return static_cast<size_t>(us);
+    }
+    const int shift = highest_bit(us) - (SUB_BUCKET_BITS - 1);
+    return static_cast<size_t>(shift * HALF_SUB_BUCKETS + (us >> shift));
+}
+
+uint64_t LatencyHistogram::bucketLowest(size_t index) {
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+    const uint64_t shift = index / HALF_SUB_BUCKETS - 1;
+    return (index - shift * HALF_SUB_BUCKETS) << shift;
+}
+
+uint64_t LatencyHistogram::bucketHighest(size_t index) {
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+    const uint64_t shift = index / HALF_SUB_BUCKETS - 1;
+    return ((index - shift * HALF_SUB_BUCKETS + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(double seconds) {
+    recordMicroseconds(seconds > 0.0 ? static_cast<uint64_t>(seconds * 1e6 + 0.5) : 0);
+}
+
+void LatencyHistogram::recordMicroseconds(uint64_t us) {
+    counts_[bucketIndex(us)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_us_.fetch_add(us, std::memory_order_relaxed);
+    uint64_t max = max_us_.load(std::memory_order_relaxed);
+    while (us > max && !max_us_.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+    }
+}
+
+HistogramSnapshot LatencyHistogram::snapshot() const {
+    HistogramSnapshot snapshot;
+    snapshot.counts.resize(BUCKETS);
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        snapshot.counts[i] = counts_[i].load(std::memory_order_relaxed);
+    }
+    snapshot.count = count_.load(std::memory_order_relaxed);
+    snapshot.sum_us = sum_us_.load(std::memory_order_relaxed);
+    snapshot.max_us = max_us_.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+void LatencyHistogram::reset() {
+    for (std::atomic<uint64_t>& count : counts_) {
+        count.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sum_us_.store(0, std::memory_order_relaxed);
+    max_us_.store(0, std::memory_order_relaxed);
+}
+
+const char* latency_stage_name(LatencyStage stage) {
+    switch (stage) {
+    case LatencyStage::Preprocess: return "preprocess";
+    case LatencyStage::Inference: return "inference";
+    case LatencyStage::Postprocess: return "postprocess";
+    case LatencyStage::Total: return "total";
+    case LatencyStage::Tracking: return "tracking";
+    case LatencyStage::SceneChange: return "scene_change";
+    case LatencyStage::Filter: return "filter";
+    default: return "unknown";
+    }
+}
+
+bool latency_metrics_enabled() {
+    return metricsEnabled.load(std::memory_order_relaxed);
+}
+
+void set_latency_metrics_enabled(bool enabled) {
+    metricsEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+LatencyHistogram& latency_histogram(LatencyStage stage) {
+    return stageHistograms[static_cast<size_t>(stage)];
+}
+
+void reset_latency_metrics() {
+    for (LatencyHistogram& histogram : stageHistograms) {
+        histogram.reset();
+    }
+    sceneChangeSkips.store(0, std::memory_order_relaxed);
+}
+
+void record_scene_change_skip() {
+    if (latency_metrics_enabled()) {
+        sceneChangeSkips.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+uint64_t scene_change_skips() {
+    return sceneChangeSkips.load(std::memory_order_relaxed);
+}
+
+std::string format_latency_report() {
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(2);
+    for (size_t i = 0; i < stageHistograms.size(); ++i) {
+        HistogramSnapshot snapshot = stageHistograms[i].snapshot();
+        if (snapshot.count == 0) {
+            continue;
+        }
+        report << latency_stage_name(static_cast<LatencyStage>(i)) << ": " << snapshot.count << " samples, mean "
+            << snapshot.mean() * 1000.0 << "ms, p50 " << snapshot.percentile(0.50) * 1000.0 << "ms, p95 "
+            << snapshot.percentile(0.95) * 1000.0 << "ms, p99 " << snapshot.percentile(0.99) * 1000.0 << "ms, max "
+            << snapshot.max() * 1000.0 << "ms\n";
+    }
+
+    // every scene change check is one frame, the skipped ones would have cost a whole predict_once each
+    HistogramSnapshot checks = latency_histogram(LatencyStage::SceneChange).snapshot();
+    if (checks.count > 0) {
+        const uint64_t skipped = scene_change_skips();
+        const double saved = static_cast<double>(skipped) * latency_histogram(LatencyStage::Total).snapshot().mean()
+            - static_cast<double>(checks.sum_us) / 1e6;
+        report << "scene_change skipped: " << skipped << "/" << checks.count << " frames ("
+            << static_cast<double>(skipped) * 100.0 / static_cast<double>(checks.count) << "%), ~" << saved * 1000.0
+            << "ms saved\n";
+    }
+    return report.str();
+}
@@ -1,11 +1,33 @@
 #include <random>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
 #include <filesystem>
-#include <opencv2/opencv.hpp>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <opencv2/highgui.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <thread>
 #include <vector>
 
+#include "calibration.h"
+#include "directory_scan.h"
 #include "constants.h"
 #include "nn_utils.h"
+#include "nn/async_engine.h"
+#include "nn/frame_filter.h"
+#include "nn/scene_change_predictor.h"
+#include "nn/scheduled_frame_filter.h"
+#include "nn/scheduled_predictor.h"
+#include "nn/tracking_predictor.h"
+#include "nn/session_config.h"
+#include "preprocess.h"
+#include "scheduler.h"
+#include "stage_benchmark.h"
+#include "video_pipeline.h"
 
 namespace fs = std::filesystem;
 
@@ -18,6 +40,7 @@ void benchmark(uint number_of_frames, AutoBackendOnnx& model, cv::Mat img, float
         << "--------------------------------------------------------" << std::endl
         << std::endl;
 
+    reset_latency_metrics();
     double time_for_completion = 0.0;
     Timer timer = Timer(time_for_completion, true);
 
@@ -45,45 +68,721 @@ void benchmark(uint number_of_frames, AutoBackendOnnx& model, cv::Mat img, float
         << std::endl
         << "It took " << time_for_completion << "ms (" << time_for_completion / 1000 << "s) to complete " << number_of_frames << " frames." << std::endl
         << "That's average of " << (time_for_completion / static_cast<double>(number_of_frames)) << "ms per frame." << std::endl
-        << "(this includes the TIMING_INFO overhead)" << std::endl << std::endl;
+        << "(this includes cloning and plotting)" << std::endl << std::endl
+        << format_latency_report() << std::endl;
+}
+
+// Compares the original letterbox -> cvtColor -> convertTo -> split chain with the fused letterbox_to_blob kernel
+void benchmark_preprocess(uint iterations, cv::Mat img, const cv::Size& model_size, int stride) {
+    std::vector<float> blob(3 * model_size.area());
+    double chain_time = 0.0;
+    double fused_time = 0.0;
+
+    for (uint i = 0; i < iterations; i++) {
+        Timer timer = Timer(chain_time, true);
+        cv::Mat preprocessed_img;
+        letterbox(img, preprocessed_img, model_size, false, false, true, stride);
+        cv::cvtColor(preprocessed_img, preprocessed_img, cv::COLOR_BGR2RGB);
+        cv::Mat float_img;
+        preprocessed_img.convertTo(float_img, CV_32FC3, 1.0f / 255.0);
+        std::vector<cv::Mat> chw(float_img.channels());
+        for (int c = 0; c < float_img.channels(); ++c) {
+            chw[c] = cv::Mat(model_size, CV_32FC1, blob.data() + c * model_size.area());
+        }
+        cv::split(float_img, chw);
+        timer.Stop();
+    }
+
+    PreprocessScratch scratch;
+    for (uint i = 0; i < iterations; i++) {
+        Timer timer = Timer(fused_time, true);
+        LetterboxGeometry geometry = letterbox_geometry(img.size(), model_size, false, false, true, stride);
+        letterbox_to_blob(img, blob.data(), geometry, true, scratch);
+        timer.Stop();
+    }
+
+    chain_time *= 1000.0 / iterations;
+    fused_time *= 1000.0 / iterations;
+    std::cout << std::fixed << std::setprecision(3)
+        << "Preprocess " << img.cols << "x" << img.rows << " -> " << model_size.width << "x" << model_size.height
+        << " (" << iterations << " iterations): "
+        << chain_time << "ms chain, " << fused_time << "ms fused (" << std::setprecision(1) << chain_time / fused_time << "x)" << std::endl;
+}
+
+// Reports per-image latency and throughput of predict_batch for a few batch sizes
+void benchmark_batch(uint iterations, AutoBackendOnnx& model, cv::Mat img, float conf_threshold, float iou_threshold, float mask_threshold, int conversion_code) {
+    for (int batch_size : { 1, 2, 4, 8 }) {
+        std::vector<cv::Mat> images(batch_size, img);
+        model.predict_batch(images, conf_threshold, iou_threshold, mask_threshold, conversion_code);  // warmup, binds the tensors
+
+        double time_for_completion = 0.0;
+        Timer timer = Timer(time_for_completion, true);
+        for (uint i = 0; i < iterations; i++) {
+            model.predict_batch(images, conf_threshold, iou_threshold, mask_threshold, conversion_code);
+        }
+        timer.Stop();
+
+        double per_image_ms = time_for_completion * 1000.0 / (static_cast<double>(iterations) * batch_size);
+        std::cout << std::fixed << std::setprecision(2)
+            << "Batch " << batch_size << ": " << per_image_ms << "ms per image, " << 1000.0 / per_image_ms << " images/s" << std::endl;
+    }
+}
+
+// Compares sustained fps of sequential predict_once calls with the pipelined AsyncInferenceEngine
+void benchmark_async(uint number_of_frames, AutoBackendOnnx& model, cv::Mat img, float conf_threshold, float iou_threshold, float mask_threshold, int conversion_code) {
+    double sequential_time = 0.0;
+    Timer sequential_timer = Timer(sequential_time, true);
+    for (uint i = 0; i < number_of_frames; i++) {
+        model.predict_once(img, conf_threshold, iou_threshold, mask_threshold, conversion_code);
+    }
+    sequential_timer.Stop();
+
+    double pipelined_time = 0.0;
+    {
+        AsyncInferenceEngine engine(model, conf_threshold, iou_threshold, conversion_code);
+        std::vector<std::future<std::vector<YoloResults>>> pending;
+        pending.reserve(number_of_frames);
+        Timer pipelined_timer = Timer(pipelined_time, true);
+        for (uint i = 0; i < number_of_frames; i++) {
+            pending.push_back(engine.submit(img));
+        }
+        for (std::future<std::vector<YoloResults>>& result : pending) {
+            result.get();
+        }
+        pipelined_timer.Stop();
+    }
+
+    std::cout << std::fixed << std::setprecision(1)
+        << "Sequential: " << number_of_frames / sequential_time << " fps, "
+        << "pipelined: " << number_of_frames / pipelined_time << " fps" << std::endl;
+}
+
+// Measures time-to-first-inference (session creation, metadata parsing and the first predict_once), which is what
+// the OBS filter pays on every scene switch. Compares loading the model from its path with a memory mapped model.
+void benchmark_startup(uint iterations, const std::string& model_path, cv::Mat img, float conf_threshold, float iou_threshold, float mask_threshold, int conversion_code, SessionConfig session_config) {
+    for (bool memory_map : { false, true }) {
+        session_config.memory_map_model = memory_map;
+        double create_time = 0.0;
+        double first_inference_time = 0.0;
+        for (uint i = 0; i < iterations; i++) {
+            Timer create_timer = Timer(create_time, true);
+            AutoBackendOnnx model(model_path.c_str(), "NudeNetCPPDemo_startup", OnnxProviders::CPU.c_str(), session_config);
+            create_timer.Stop();
+
+            Timer inference_timer = Timer(first_inference_time, true);
+            model.predict_once(img, conf_threshold, iou_threshold, mask_threshold, conversion_code);
+            inference_timer.Stop();
+        }
+
+        create_time *= 1000.0 / iterations;
+        first_inference_time *= 1000.0 / iterations;
+        std::cout << std::fixed << std::setprecision(1)
+            << "Startup (" << (memory_map ? "memory mapped" : "from path") << "): "
+            << create_time << "ms create + " << first_inference_time << "ms first inference = "
+            << create_time + first_inference_time << "ms to first result" << std::endl;
+    }
+}
+
+// Simulates a mostly static stream: the same frame, with a region that changes every `change_every` frames
+void benchmark_scene_change(uint number_of_frames, uint change_every, AutoBackendOnnx& model, cv::Mat img, float conf_threshold, float iou_threshold, float mask_threshold, int conversion_code) {
+    SceneChangePredictor predictor(model);
+    cv::Mat frame = img.clone();
+    double time_for_completion = 0.0;
+    Timer timer = Timer(time_for_completion, true);
+    for (uint i = 0; i < number_of_frames; i++) {
+        if (change_every > 0 && i % change_every == 0) {
+            cv::Rect region((i / change_every) * 40 % std::max(1, frame.cols - 80), frame.rows / 4, 80, frame.rows / 2);
+            frame(region & cv::Rect(0, 0, frame.cols, frame.rows)).setTo(cv::Scalar::all((i / change_every) % 2 ? 255 : 0));
+        }
+        predictor.predict_once(frame, conf_threshold, iou_threshold, mask_threshold, conversion_code);
+    }
+    timer.Stop();
+
+    const SceneChangeStats& stats = predictor.getStats();
+    std::cout << std::fixed << std::setprecision(1)
+        << "Scene change: " << number_of_frames / time_for_completion << " fps, skipped " << stats.skipped << "/" << stats.frames
+        << " frames (" << stats.skipRatio() * 100.0 << "%), ~" << stats.savedSeconds() * 1000.0 << "ms saved, "
+        << std::setprecision(3) << stats.detector_seconds * 1000.0 / stats.frames << "ms per change check" << std::endl;
+}
+
+// Pans a window across the image to simulate motion and censors every frame, inferring every `interval` frames
+void benchmark_tracking(uint number_of_frames, AutoBackendOnnx& model, cv::Mat img, float conf_threshold, float iou_threshold, float mask_threshold, int conversion_code) {
+    cv::Rect window(0, 0, img.cols * 3 / 4, img.rows * 3 / 4);
+    for (int interval : { 1, 2, 3, 5 }) {
+        TrackingPredictor predictor(model, interval);
+        double time_for_completion = 0.0;
+        Timer timer = Timer(time_for_completion, true);
+        for (uint i = 0; i < number_of_frames; i++) {
+            window.x = static_cast<int>(i * 2) % std::max(1, img.cols - window.width);
+            cv::Mat frame = img(window).clone();
+            std::vector<YoloResults> objs = predictor.predict_once(frame, conf_threshold, iou_threshold, mask_threshold, conversion_code);
+            plot_results_fast(frame, objs);
+        }
+        timer.Stop();
+        std::cout << std::fixed << std::setprecision(1)
+            << "Tracking, inference every " << interval << " frame(s): " << number_of_frames / time_for_completion << " fps" << std::endl;
+    }
+}
+
+// Feeds a simulated `stream_fps` stream through ScheduledPredictor and reports where the scheduler settled for a few CPU budgets
+void benchmark_scheduler(uint number_of_frames, double stream_fps, AutoBackendOnnx& model, cv::Mat img, float conf_threshold, float iou_threshold, float mask_threshold, int conversion_code) {
+    for (double max_cpu_share : { 0.25, 0.5, 1.0 }) {
+        SchedulerOptions options;
+        options.target_latency = 1.0 / stream_fps;
+        options.max_cpu_share = max_cpu_share;
+        ScheduledPredictor predictor(model, options);
+        double time_for_completion = 0.0;
+        Timer timer = Timer(time_for_completion, true);
+        for (uint i = 0; i < number_of_frames; i++) {
+            predictor.predict_once(img, conf_threshold, iou_threshold, mask_threshold, conversion_code, 1.0 / stream_fps);
+        }
+        timer.Stop();
+
+        const InferenceScheduler& scheduler = predictor.getScheduler();
+        std::cout << std::fixed << std::setprecision(1)
+            << "Scheduler, max cpu share " << max_cpu_share * 100.0 << "%: inference every " << scheduler.getInterval()
+            << " frame(s) at " << scheduler.getInputScale() * 100.0 << "% input size, " << scheduler.getLatency() * 1000.0
+            << "ms latency, " << scheduler.getCpuShare() * 100.0 << "% estimated share, " << scheduler.getAdjustments()
+            << " adjustment(s) ; busy " << time_for_completion * stream_fps * 100.0 / number_of_frames << "% of the stream time" << std::endl;
+    }
+}
+
+// Compares whole-frame and tiled inference on `img` upscaled to `frame_size` (e.g. 4K), reported per megapixel
+void benchmark_tiled(uint iterations, const cv::Size& frame_size, AutoBackendOnnx& model, cv::Mat img, float conf_threshold, float iou_threshold, float mask_threshold, int conversion_code) {
+    cv::Mat frame;
+    cv::resize(img, frame, frame_size);
+    const double megapixels = frame.total() / 1e6;
+
+    auto report = [&](const std::string& label, const std::function<std::vector<YoloResults>()>& run) {
+        run();  // warmup, binds the tensors for the batch size
+        size_t objects = 0;
+        double time_for_completion = 0.0;
+        Timer timer = Timer(time_for_completion, true);
+        for (uint i = 0; i < iterations; i++) {
+            objects = run().size();
+        }
+        timer.Stop();
+        double per_frame_ms = time_for_completion * 1000.0 / iterations;
+        std::cout << std::fixed << std::setprecision(1)
+            << label << ": " << per_frame_ms << "ms per frame, " << per_frame_ms / megapixels << "ms per megapixel, "
+            << std::setprecision(2) << megapixels * iterations / time_for_completion << " MP/s, " << objects << " object(s)" << std::endl;
+    };
+
+    report("Whole frame", [&]() { return model.predict_once(frame, conf_threshold, iou_threshold, mask_threshold, conversion_code); });
+    for (float tile_scale : { 1.0f, 2.0f }) {
+        TilingOptions options;
+        options.tile_size = cv::Size(static_cast<int>(model.getWidth() * tile_scale), static_cast<int>(model.getHeight() * tile_scale));
+        std::vector<cv::Rect> tiles = tile_grid(frame.size(), options.tile_size, options.overlap);
+        report("Tiled " + std::to_string(tiles.size()) + "x " + std::to_string(options.tile_size.width) + "x" + std::to_string(options.tile_size.height),
+            [&]() { return model.predict_tiled(frame, conf_threshold, iou_threshold, mask_threshold, conversion_code, options); });
+    }
+}
+
+// Compares the fixed metadata input size with per-frame dynamic resolution at `quality` for a few source resolutions
+void benchmark_dynamic_resolution(uint iterations, float quality, AutoBackendOnnx& model, cv::Mat img, float conf_threshold, float iou_threshold, float mask_threshold, int conversion_code) {
+    if (!model.hasDynamicInputSize()) {
+        std::cout << "Dynamic resolution: the model has a fixed input size, export it with dynamic height/width axes" << std::endl;
+        return;
+    }
+    const DynamicResolutionOptions previous = model.getDynamicResolution();
+    for (const cv::Size& source_size : { cv::Size(640, 480), cv::Size(1280, 720), cv::Size(1920, 1080), cv::Size(1080, 1920) }) {
+        cv::Mat frame;
+        cv::resize(img, frame, source_size);
+        for (bool dynamic : { false, true }) {
+            model.setDynamicResolution({ dynamic, quality });
+            model.predict_once(frame, conf_threshold, iou_threshold, mask_threshold, conversion_code);  // warmup, binds the tensors
+
+            size_t objects = 0;
+            double time_for_completion = 0.0;
+            Timer timer = Timer(time_for_completion, true);
+            for (uint i = 0; i < iterations; i++) {
+                objects = model.predict_once(frame, conf_threshold, iou_threshold, mask_threshold, conversion_code).size();
+            }
+            timer.Stop();
+            std::cout << std::fixed << std::setprecision(1)
+                << "Source " << source_size.width << "x" << source_size.height << ", "
+                << (dynamic ? "quality " + std::to_string(static_cast<int>(quality * 100.0f)) + "%" : std::string("fixed"))
+                << " -> input " << model.getWidth() << "x" << model.getHeight() << ": "
+                << time_for_completion * 1000.0 / iterations << "ms per frame, " << objects << " object(s)" << std::endl;
+        }
+    }
+    model.setDynamicResolution(previous);
+}
+
+// Censor kernels on a 1080p frame with four boxes covering ~20% of it, reported per megapixel censored
+void benchmark_censor(uint iterations, cv::Mat img) {
+    cv::Mat frame;
+    cv::resize(img, frame, cv::Size(1920, 1080));
+    std::vector<YoloResults> boxes = {
+        { 0, 1.0f, cv::Rect_<float>(100.5f, 120.5f, 400.0f, 300.0f) },
+        { 0, 1.0f, cv::Rect_<float>(700.0f, 200.0f, 260.0f, 260.0f) },
+        { 0, 1.0f, cv::Rect_<float>(1200.0f, 500.0f, 500.0f, 320.0f) },
+        { 0, 1.0f, cv::Rect_<float>(1800.0f, 900.0f, 300.0f, 300.0f) },  // partly outside the frame
+    };
+    double megapixels = 0.0;
+    for (const YoloResults& box : boxes) {
+        megapixels += (box.bbox & cv::Rect_<float>(0.0f, 0.0f, 1920.0f, 1080.0f)).area() / 1e6;
+    }
+
+    CensorScratch scratch;
+    for (CensorMode mode : { CensorMode::Fill, CensorMode::Pixelate, CensorMode::Blur }) {
+        CensorOptions options;
+        options.mode = mode;
+        cv::Mat canvas = frame.clone();
+        plot_results_censored(canvas, boxes, options, scratch);  // warmup, sizes the scratch buffers
+        double time_for_completion = 0.0;
+        Timer timer = Timer(time_for_completion, true);
+        for (uint i = 0; i < iterations; i++) {
+            plot_results_censored(canvas, boxes, options, scratch);
+        }
+        timer.Stop();
+        double per_frame_ms = time_for_completion * 1000.0 / iterations;
+        std::cout << std::fixed << std::setprecision(3)
+            << "Censor " << censor_mode_name(mode) << ": " << per_frame_ms << "ms per frame, "
+            << per_frame_ms / megapixels << "ms per megapixel censored" << std::endl;
+    }
+
+    // reference: the naive full-box gaussian blur the kernels replace
+    cv::Mat canvas = frame.clone();
+    double time_for_completion = 0.0;
+    Timer timer = Timer(time_for_completion, true);
+    for (uint i = 0; i < iterations; i++) {
+        for (const YoloResults& box : boxes) {
+            cv::Mat view = canvas(cv::Rect(box.bbox) & cv::Rect(0, 0, canvas.cols, canvas.rows));
+            cv::GaussianBlur(view, view, cv::Size(0, 0), 20.0);
+        }
+    }
+    timer.Stop();
+    double per_frame_ms = time_for_completion * 1000.0 / iterations;
+    std::cout << std::fixed << std::setprecision(3)
+        << "Censor cv::GaussianBlur: " << per_frame_ms << "ms per frame, " << per_frame_ms / megapixels << "ms per megapixel censored" << std::endl;
 }
 #endif
 
 
-int main(int argc, char** argv) {
-    const std::string& modelPath = "./nudenet-best.onnx";
+// NudeNetCPPDemo calibrate <image_dir> [model] [calibration.npy]
+int run_calibrate(const std::vector<std::string>& args, const SessionConfig& session_config, int conversion_code) {
+    if (args.size() < 2 || args.size() > 4) {
+        std::cout << "Usage: NudeNetCPPDemo calibrate <image_dir> [model.onnx] [calibration.npy]" << std::endl;
+        return 1;
+    }
+    const std::string model_path = args.size() > 2 ? args[2] : "./nudenet-best.onnx";
+    const std::string output_path = args.size() > 3 ? args[3] : "./calibration.npy";
+    AutoBackendOnnx model(model_path.c_str(), "NudeNetCPPDemo_calibrate", OnnxProviders::CPU.c_str(), session_config);
+    size_t written = write_calibration_tensors(model, args[1], output_path, 500, conversion_code);
+    if (written == 0) {
+        return 1;
+    }
+    std::cout << "Wrote " << written << " calibration tensor(s) to " << output_path
+        << ", next: python tools/quantize_int8.py " << model_path << " " << output_path << " nudenet-best.int8.onnx" << std::endl;
+    return 0;
+}
 
-    if (argc != 2) {
-        std::cout << "Error: You have pass an image path as an argument" << std::endl;
+// NudeNetCPPDemo compare <image_dir> <fp32 model> <int8 model>
+int run_compare(const std::vector<std::string>& args, const SessionConfig& session_config, const std::string& provider, float conf_threshold, float iou_threshold, float mask_threshold, int conversion_code) {
+    if (args.size() != 4) {
+        std::cout << "Usage: NudeNetCPPDemo compare <image_dir> <fp32 model> <int8 model>" << std::endl;
         return 1;
     }
-    std::string img_path = argv[1];
-    if (!fs::exists(img_path)) {
-        std::cout << "Error: Specified image path does not exist" << std::endl;
+    AutoBackendOnnx reference(args[2].c_str(), "NudeNetCPPDemo_fp32", provider.c_str(), session_config);
+    AutoBackendOnnx candidate(args[3].c_str(), "NudeNetCPPDemo_int8", provider.c_str(), session_config);
+    ModelComparison comparison = compare_models(reference, candidate, args[1], conf_threshold, iou_threshold, mask_threshold, conversion_code);
+    print_model_comparison(comparison, reference.getNames());
+    return comparison.images > 0 ? 0 : 1;
+}
+
+// Removes `--<name> <value>` / `--<name>=<value>` from args, the rest are session flags and positional arguments
+std::string take_option_arg(std::vector<std::string>& args, const std::string& name, const std::string& fallback) {
+    const std::string flag = "--" + name;
+    std::string value = fallback;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == flag && i + 1 < args.size()) {
+            value = args[i + 1];
+            args.erase(args.begin() + i, args.begin() + i + 2);
+            --i;
+        }
+        else if (args[i].rfind(flag + "=", 0) == 0) {
+            value = args[i].substr(flag.size() + 1);
+            args.erase(args.begin() + i);
+            --i;
+        }
+    }
+    return value;
+}
+
+// Removes every `--<name>` from args, returns whether there was one
+bool take_flag_arg(std::vector<std::string>& args, const std::string& name) {
+    const std::string flag = "--" + name;
+    const size_t count = args.size();
+    args.erase(std::remove(args.begin(), args.end(), flag), args.end());
+    return args.size() != count;
+}
+
+// Modes of `bench` besides the per-stage latency percentiles, each selected with --<mode>
+const std::vector<std::string> BENCH_MODES = {
+    "allocations", "tiled", "preprocess", "batch", "async", "startup", "scene-change", "tracking", "scheduler", "censor-kernels",
+    "end-to-end",
+};
+
+// Removes the bench mode flags from args, `mode` is "stages" without one. False when more than one was given.
+// `--dynamic-resolution <quality>` is the one mode with a value, the quality (0..1] of AutoBackendOnnx::setDynamicResolution
+bool take_bench_mode(std::vector<std::string>& args, std::string& mode, float& dynamic_quality) {
+    mode = "stages";
+    int selected = 0;
+    for (const std::string& name : BENCH_MODES) {
+        if (take_flag_arg(args, name)) {
+            mode = name;
+            ++selected;
+        }
+    }
+    const std::string quality = take_option_arg(args, "dynamic-resolution", "");
+    if (!quality.empty()) {
+        mode = "dynamic-resolution";
+        ++selected;
+        dynamic_quality = static_cast<float>(std::atof(quality.c_str()));
+        if (dynamic_quality <= 0.0f || dynamic_quality > 1.0f) {
+            std::cerr << "Error: --dynamic-resolution takes a quality in (0, 1], got '" << quality << "'" << std::endl;
+            return false;
+        }
+    }
+    if (selected > 1) {
+        std::cerr << "Error: Pass at most one bench mode" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// NudeNetCPPDemo bench <image> [model] [results.json] [--<mode>]
+int run_bench(const std::vector<std::string>& args, const SessionConfig& session_config, const std::string& provider, const std::string& mode, float dynamic_quality, float conf_threshold, float iou_threshold, float mask_threshold, int conversion_code) {
+    if (args.size() < 2 || args.size() > 4) {
+        std::string modes;
+        for (const std::string& name : BENCH_MODES) {
+            modes += (modes.empty() ? "--" : "|--") + name;
+        }
+        std::cout << "Usage: NudeNetCPPDemo bench <image> [model.onnx] [results.json] [" << modes << "|--dynamic-resolution <quality>]" << std::endl;
+        return 1;
+    }
+    cv::Mat img = cv::imread(args[1], cv::IMREAD_COLOR);
+    if (img.empty()) {
+        std::cerr << "Error: Unable to load image" << std::endl;
+        return 1;
+    }
+    const std::string model_path = args.size() > 2 ? args[2] : "./nudenet-best.onnx";
+    AutoBackendOnnx model(model_path.c_str(), "NudeNetCPPDemo_bench", provider.c_str(), session_config);
+
+    StageBenchmarkOptions options;
+    options.conf = conf_threshold;
+    options.iou = iou_threshold;
+    options.conversion_code = conversion_code;
+    if (mode == "allocations") {
+        AllocationStats allocations = measure_allocations(model, img, options);
+        std::cout << std::fixed << std::setprecision(1)
+            << "Allocations per frame: predict_once " << allocations.predict_once << ", onnxruntime Run alone " << allocations.forward << std::endl;
+        if (allocations.predict_once > allocations.forward) {
+            std::cerr << "Error: predict_once allocates " << allocations.predict_once - allocations.forward << " time(s) per frame outside onnxruntime" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (mode != "stages") {
+#if TIMING_INFO
+        if (mode == "tiled") {
+            benchmark_tiled(20, cv::Size(3840, 2160), model, img, conf_threshold, iou_threshold, mask_threshold, conversion_code);
+        }
+        else if (mode == "preprocess") {
+            benchmark_preprocess(1000, img, model.getCvSize(), model.getStride());
+        }
+        else if (mode == "batch") {
+            benchmark_batch(50, model, img, conf_threshold, iou_threshold, mask_threshold, conversion_code);
+        }
+        else if (mode == "async") {
+            benchmark_async(300, model, img, conf_threshold, iou_threshold, mask_threshold, conversion_code);
+        }
+        else if (mode == "startup") {
+            benchmark_startup(10, model_path, img, conf_threshold, iou_threshold, mask_threshold, conversion_code, session_config);
+        }
+        else if (mode == "scene-change") {
+            benchmark_scene_change(300, 20, model, img, conf_threshold, iou_threshold, mask_threshold, conversion_code);
+        }
+        else if (mode == "tracking") {
+            benchmark_tracking(300, model, img, conf_threshold, iou_threshold, mask_threshold, conversion_code);
+        }
+        else if (mode == "scheduler") {
+            benchmark_scheduler(600, 60.0, model, img, conf_threshold, iou_threshold, mask_threshold, conversion_code);
+        }
+        else if (mode == "censor-kernels") {
+            benchmark_censor(200, img);
+        }
+        else if (mode == "end-to-end") {
+            benchmark(1000, model, img, conf_threshold, iou_threshold, mask_threshold, conversion_code, true);
+        }
+        else if (mode == "dynamic-resolution") {
+            benchmark_dynamic_resolution(50, dynamic_quality, model, img, conf_threshold, iou_threshold, mask_threshold, conversion_code);
+        }
+        return 0;
+#else
+        std::cerr << "Error: bench --" << mode << " is compiled out, set TIMING_INFO in constants.h" << std::endl;
+        return 1;
+#endif
+    }
+    std::vector<StageStats> stats = run_stage_benchmarks(model, img, options);
+    print_stage_stats(stats);
+    if (args.size() > 3 && !write_stage_stats_json(args[3], stats, model)) {
+        return 1;
+    }
+    return 0;
+}
+
+// NudeNetCPPDemo video <input> <output> [model] [inference_interval]
+int run_video(const std::vector<std::string>& args, const SessionConfig& session_config, const std::string& provider, const CensorOptions& censor_options, float conf_threshold, float iou_threshold, float mask_threshold, int conversion_code) {
+    if (args.size() < 3 || args.size() > 5) {
+        std::cout << "Usage: NudeNetCPPDemo video <input> <output> [model.onnx] [inference_interval]" << std::endl;
+        return 1;
+    }
+    const std::string model_path = args.size() > 3 ? args[3] : "./nudenet-best.onnx";
+    AutoBackendOnnx model(model_path.c_str(), "NudeNetCPPDemo_video", provider.c_str(), session_config);
+
+    VideoProcessingOptions options;
+    options.inference_interval = args.size() > 4 ? std::max(std::atoi(args[4].c_str()), 1) : 1;
+    options.conf = conf_threshold;
+    options.iou = iou_threshold;
+    options.mask_threshold = mask_threshold;
+    options.conversion_code = conversion_code;
+    options.censor = censor_options;
+    VideoProcessingStats stats;
+    if (!process_video(model, args[1], args[2], options, stats)) {
+        return 1;
+    }
+    print_video_stats(stats);
+    return 0;
+}
+
+// NudeNetCPPDemo scan <directory> [results.jsonl|-] [model] [reader_threads] [batch_size]
+int run_scan(const std::vector<std::string>& args, const SessionConfig& session_config, const std::string& provider, float conf_threshold, float iou_threshold, float mask_threshold, int conversion_code) {
+    if (args.size() < 2 || args.size() > 6) {
+        std::cout << "Usage: NudeNetCPPDemo scan <directory> [results.jsonl|-] [model.onnx] [reader_threads] [batch_size]" << std::endl;
+        return 1;
+    }
+    const std::string output_path = args.size() > 2 ? args[2] : "-";
+    const std::string model_path = args.size() > 3 ? args[3] : "./nudenet-best.onnx";
+    AutoBackendOnnx model(model_path.c_str(), "NudeNetCPPDemo_scan", provider.c_str(), session_config);
+
+    ScanOptions options;
+    options.reader_threads = args.size() > 4 ? static_cast<size_t>(std::max(std::atoi(args[4].c_str()), 0)) : 0;
+    options.batch_size = args.size() > 5 ? static_cast<size_t>(std::max(std::atoi(args[5].c_str()), 1)) : 1;
+    options.conf = conf_threshold;
+    options.iou = iou_threshold;
+    options.mask_threshold = mask_threshold;
+    options.conversion_code = conversion_code;
+    ScanStats stats;
+    if (!scan_directory(model, args[1], output_path, options, stats)) {
+        return 1;
+    }
+    print_scan_stats(stats);
+    return 0;
+}
+
+// Converts a BGR image into the compact buffer layout of frame_view_of(), like a capture source would deliver it
+bool make_synthetic_frame(const cv::Mat& bgr, FrameFormat format, std::vector<uint8_t>& buffer) {
+    const int w = bgr.cols;
+    const int h = bgr.rows;
+    buffer.resize(frame_buffer_size(format, w, h));
+    if (buffer.empty()) {
+        return false;
+    }
+    cv::Mat i420;
+    switch (format) {
+    case FrameFormat::BGRA:
+    case FrameFormat::BGRX:
+        cv::cvtColor(bgr, cv::Mat(h, w, CV_8UC4, buffer.data()), cv::COLOR_BGR2BGRA);
+        return true;
+    case FrameFormat::RGBA:
+        cv::cvtColor(bgr, cv::Mat(h, w, CV_8UC4, buffer.data()), cv::COLOR_BGR2RGBA);
+        return true;
+    case FrameFormat::I420:
+        cv::cvtColor(bgr, cv::Mat(h * 3 / 2, w, CV_8UC1, buffer.data()), cv::COLOR_BGR2YUV_I420);
+        return true;
+    default:
+        break;
+    }
+
+    // NV12 and YUY2 are rearranged from I420
+    cv::cvtColor(bgr, i420, cv::COLOR_BGR2YUV_I420);
+    const uint8_t* y_plane = i420.data;
+    const uint8_t* u_plane = y_plane + w * h;
+    const uint8_t* v_plane = u_plane + (w / 2) * (h / 2);
+    if (format == FrameFormat::NV12) {
+        std::copy(y_plane, y_plane + w * h, buffer.begin());
+        uint8_t* uv = buffer.data() + w * h;
+        for (int i = 0; i < (w / 2) * (h / 2); ++i) {
+            uv[2 * i] = u_plane[i];
+            uv[2 * i + 1] = v_plane[i];
+        }
+        return true;
+    }
+    for (int y = 0; y < h; ++y) {
+        uint8_t* row = buffer.data() + static_cast<size_t>(y) * w * 2;
+        for (int x = 0; x < w; x += 2) {
+            const int chroma = (y / 2) * (w / 2) + x / 2;
+            row[2 * x] = y_plane[y * w + x];
+            row[2 * x + 1] = u_plane[chroma];
+            row[2 * x + 2] = y_plane[y * w + x + 1];
+            row[2 * x + 3] = v_plane[chroma];
+        }
+    }
+    return true;
+}
+
+// NudeNetCPPDemo filter <image> [model] [frames] [bgra|rgba|nv12|i420|yuy2] [fps]
+// Feeds a fresh frame every 1/fps through ScheduledFrameFilter, the same per-frame loop the OBS filter_video callback
+// runs, and reports the time it keeps the video thread busy. No libobs needed.
+int run_filter_harness(const std::vector<std::string>& args, const SessionConfig& session_config, const std::string& provider, const CensorOptions& censor_options, float conf_threshold, float iou_threshold) {
+    if (args.size() < 2 || args.size() > 6) {
+        std::cout << "Usage: NudeNetCPPDemo filter <image> [model.onnx] [frames] [bgra|rgba|nv12|i420|yuy2] [fps]" << std::endl;
+        return 1;
+    }
+    cv::Mat img = cv::imread(args[1], cv::IMREAD_COLOR);
+    if (img.empty()) {
+        std::cerr << "Error: Unable to load image" << std::endl;
+        return 1;
+    }
+    const std::string model_path = args.size() > 2 ? args[2] : "./nudenet-best.onnx";
+    const int frames = args.size() > 3 ? std::max(std::atoi(args[3].c_str()), 1) : 600;
+    const std::string format_name = args.size() > 4 ? args[4] : "nv12";
+    const double fps = args.size() > 5 ? std::max(std::atof(args[5].c_str()), 1.0) : 60.0;
+    const std::unordered_map<std::string, FrameFormat> formats = {
+        { "bgra", FrameFormat::BGRA }, { "rgba", FrameFormat::RGBA }, { "nv12", FrameFormat::NV12 },
+        { "i420", FrameFormat::I420 }, { "yuy2", FrameFormat::YUY2 },
+    };
+    auto format = formats.find(format_name);
+    if (format == formats.end()) {
+        std::cerr << "Error: Unknown frame format '" << format_name << "'" << std::endl;
+        return 1;
+    }
+
+    cv::Mat bgr;
+    cv::resize(img, bgr, cv::Size(1920, 1080));
+    std::vector<uint8_t> source;
+    make_synthetic_frame(bgr, format->second, source);
+    std::vector<uint8_t> pixels(source.size());
+
+    ScheduledFrameFilter scheduled_filter(model_path, session_config, provider);
+    FrameFilter& filter = scheduled_filter.getFilter();
+    FrameFilterOptions options;
+    options.conf = conf_threshold;
+    options.iou = iou_threshold;
+    options.censor = censor_options;
+    filter.setOptions(options);
+    for (int i = 0; i < 300 && !filter.isModelLoaded(); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    if (!filter.isModelLoaded()) {
+        std::cerr << "Error: The model did not load" << std::endl;
+        return 1;
+    }
+
+    const auto frame_period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / fps));
+    auto next_frame = std::chrono::steady_clock::now();
+    latency_histogram(LatencyStage::Filter).reset();
+    for (int i = 0; i < frames; ++i) {
+        std::this_thread::sleep_until(next_frame);
+        next_frame += frame_period;
+        std::copy(source.begin(), source.end(), pixels.begin());  // a fresh frame, the last one was censored in place
+        FrameView view = frame_view_of(format->second, bgr.cols, bgr.rows, pixels.data());
+        scheduled_filter.filter(view, 1.0 / fps);
+    }
+
+    HistogramSnapshot overhead = latency_histogram(LatencyStage::Filter).snapshot();
+    FrameFilterStats stats = filter.getStats();
+    std::cout << std::fixed << std::setprecision(3)
+        << format_name << " 1920x1080 @ " << fps << " fps, " << stats.frames << " frame(s): "
+        << stats.submitted << " submitted, " << stats.inferred << " inferred, " << stats.dropped << " dropped, "
+        << stats.reused << " censored with reused detections, " << stats.failed << " failed, scheduler interval " << scheduled_filter.getInterval() << std::endl
+        << "Video thread overhead per frame: mean " << overhead.mean() * 1000.0 << "ms, p50 " << overhead.percentile(0.5) * 1000.0
+        << "ms, p99 " << overhead.percentile(0.99) * 1000.0 << "ms, max " << overhead.max() * 1000.0 << "ms" << std::endl;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    // Usage: NudeNetCPPDemo <image> [model.onnx|model.ort] [--provider cpu|xnnpack|dnnl|openvino|auto] [--censor fill|pixelate|blur] [--session-config <file>] [--intra-op-threads <n>] ...
+    //        NudeNetCPPDemo calibrate|compare ... (INT8 quantization workflow, see calibration.h)
+    //        NudeNetCPPDemo bench <image> [model] [results.json] [--allocations|--tiled|--dynamic-resolution <quality>|...] (per-stage latency percentiles, see stage_benchmark.h, or one of BENCH_MODES)
+    //        NudeNetCPPDemo video <input> <output> [model] [inference_interval] (headless, see video_pipeline.h)
+    //        NudeNetCPPDemo filter <image> [model] [frames] [format] [fps] (FrameFilter harness, see nn/frame_filter.h)
+    //        NudeNetCPPDemo scan <directory> [results.jsonl|-] [model] [reader_threads] [batch_size] (see directory_scan.h)
+    std::vector<std::string> args(argv + 1, argv + argc);
+    const std::string onnx_provider = take_option_arg(args, "provider", OnnxProviders::CPU);
+    std::string bench_mode;
+    float dynamic_quality = 1.0f;
+    if (!take_bench_mode(args, bench_mode, dynamic_quality)) {
+        return 1;
+    }
+    CensorOptions censor_options;
+    const std::string censor_mode = take_option_arg(args, "censor", "fill");
+    if (!parse_censor_mode(censor_mode, censor_options.mode)) {
+        std::cerr << "Error: Unknown censor mode '" << censor_mode << "', expected fill, pixelate or blur" << std::endl;
+        return 1;
+    }
+    SessionConfig session_config;
+    std::vector<std::string> positional_args;
+    if (!parse_session_config_args(args, session_config, positional_args)) {
         return 1;
     }
 
-    fs::path imageFilePath(img_path);
-    const std::string& onnx_provider = OnnxProviders::CPU; // "cpu";
     const std::string& onnx_logid = "NudeNetCPPDemo_onnx_log";
     float mask_threshold = 0.5f;  // in python it's 0.5 and you can see that at ultralytics/utils/ops.process_mask line 705 (ultralytics.__version__ == .160)
     float conf_threshold = 0.30f;
     float iou_threshold = 0.45f;  //  0.70f;
     int conversion_code = cv::COLOR_BGR2RGB;
 
+    if (!positional_args.empty() && positional_args[0] == "calibrate") {
+        return run_calibrate(positional_args, session_config, conversion_code);
+    }
+    if (!positional_args.empty() && positional_args[0] == "bench") {
+        return run_bench(positional_args, session_config, onnx_provider, bench_mode, dynamic_quality, conf_threshold, iou_threshold, mask_threshold, conversion_code);
+    }
+    if (!positional_args.empty() && positional_args[0] == "filter") {
+        return run_filter_harness(positional_args, session_config, onnx_provider, censor_options, conf_threshold, iou_threshold);
+    }
+    if (!positional_args.empty() && positional_args[0] == "scan") {
+        return run_scan(positional_args, session_config, onnx_provider, conf_threshold, iou_threshold, mask_threshold, conversion_code);
+    }
+    if (!positional_args.empty() && positional_args[0] == "video") {
+        return run_video(positional_args, session_config, onnx_provider, censor_options, conf_threshold, iou_threshold, mask_threshold, conversion_code);
+    }
+    if (!positional_args.empty() && positional_args[0] == "compare") {
+        return run_compare(positional_args, session_config, onnx_provider, conf_threshold, iou_threshold, mask_threshold, conversion_code);
+    }
+
+    if (positional_args.empty() || positional_args.size() > 2) {
+        std::cout << "Error: You have pass an image path as an argument" << std::endl;
+        return 1;
+    }
+    std::string img_path = positional_args[0];
+    const std::string modelPath = positional_args.size() > 1 ? positional_args[1] : "./nudenet-best.onnx";
+    if (!fs::exists(img_path)) {
+        std::cout << "Error: Specified image path does not exist" << std::endl;
+        return 1;
+    }
+
+    fs::path imageFilePath(img_path);
     cv::Mat img = cv::imread(img_path, cv::IMREAD_UNCHANGED);
     if (img.empty()) {
         std::cerr << "Error: Unable to load image" << std::endl;
         return 1;
     }
-    AutoBackendOnnx model(modelPath.c_str(), onnx_logid.c_str(), onnx_provider.c_str());
-
-    // benchmark(1000, model, img, conf_threshold, iou_threshold, mask_threshold, conversion_code, true);
+    AutoBackendOnnx model(modelPath.c_str(), onnx_logid.c_str(), onnx_provider.c_str(), session_config);
 
     std::vector<YoloResults> objs = model.predict_once(img, conf_threshold, iou_threshold, mask_threshold, conversion_code);
     std::unordered_map<int, std::string> names = model.getNames();
     // plot_results_fast(img, objs);
-    plot_results_with_classifications(img, objs, names, false);
+    if (censor_options.mode != CensorMode::Fill) {
+        CensorScratch censor_scratch;
+        plot_results_censored(img, objs, censor_options, censor_scratch);
+    }
+    else {
+        plot_results_with_classifications(img, objs, names, false);
+    }
     cv::imshow("img", img);
     cv::waitKey();
 
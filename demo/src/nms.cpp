@@ -0,0 +1,126 @@
+#include "nms.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "simd.h"
+
+namespace {
+
+// Marks every box after i that overlaps box i by more than iou_threshold (and shares its class, when class aware)
+void suppress_overlaps(int i, int m, bool class_aware, float iou_threshold, NmsScratch& s) {
+    const float bx1 = s.x1[i];
+    const float by1 = s.y1[i];
+    const float bx2 = s.x2[i];
+    const float by2 = s.y2[i];
+    const float barea = s.area[i];
+    const int32_t bcls = s.cls[i];
+    int j = i + 1;
+
+    // iou > t <=> inter > t * union, so there is no division in the hot loop
+#if NUDENET_AVX2
+    const __m256 vx1 = _mm256_set1_ps(bx1), vy1 = _mm256_set1_ps(by1);
+    const __m256 vx2 = _mm256_set1_ps(bx2), vy2 = _mm256_set1_ps(by2);
+    const __m256 varea = _mm256_set1_ps(barea), vthr = _mm256_set1_ps(iou_threshold);
+    const __m256 vzero = _mm256_setzero_ps();
+    const __m256i vcls = _mm256_set1_epi32(bcls);
+    for (; j + 8 <= m; j += 8) {
+        __m256 w = _mm256_max_ps(vzero, _mm256_sub_ps(_mm256_min_ps(vx2, _mm256_loadu_ps(&s.x2[j])), _mm256_max_ps(vx1, _mm256_loadu_ps(&s.x1[j]))));
+        __m256 h = _mm256_max_ps(vzero, _mm256_sub_ps(_mm256_min_ps(vy2, _mm256_loadu_ps(&s.y2[j])), _mm256_max_ps(vy1, _mm256_loadu_ps(&s.y1[j]))));
+        __m256 inter = _mm256_mul_ps(w, h);
+        __m256 uni = _mm256_sub_ps(_mm256_add_ps(varea, _mm256_loadu_ps(&s.area[j])), inter);
+        __m256 over = _mm256_cmp_ps(inter, _mm256_mul_ps(vthr, uni), _CMP_GT_OQ);
+        if (class_aware) {
+            __m256i same = _mm256_cmpeq_epi32(vcls, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&s.cls[j])));
+            over = _mm256_and_ps(over, _mm256_castsi256_ps(same));
+        }
+        __m256i* supp = reinterpret_cast<__m256i*>(&s.suppressed[j]);
+        _mm256_storeu_si256(supp, _mm256_or_si256(_mm256_loadu_si256(supp), _mm256_castps_si256(over)));
+    }
+#endif
+#if NUDENET_SSE2
+    const __m128 sx1 = _mm_set1_ps(bx1), sy1 = _mm_set1_ps(by1);
+    const __m128 sx2 = _mm_set1_ps(bx2), sy2 = _mm_set1_ps(by2);
+    const __m128 sarea = _mm_set1_ps(barea), sthr = _mm_set1_ps(iou_threshold);
+    const __m128 szero = _mm_setzero_ps();
+    const __m128i scls = _mm_set1_epi32(bcls);
+    for (; j + 4 <= m; j += 4) {
+        __m128 w = _mm_max_ps(szero, _mm_sub_ps(_mm_min_ps(sx2, _mm_loadu_ps(&s.x2[j])), _mm_max_ps(sx1, _mm_loadu_ps(&s.x1[j]))));
+        __m128 h = _mm_max_ps(szero, _mm_sub_ps(_mm_min_ps(sy2, _mm_loadu_ps(&s.y2[j])), _mm_max_ps(sy1, _mm_loadu_ps(&s.y1[j]))));
+        __m128 inter = _mm_mul_ps(w, h);
+        __m128 uni = _mm_sub_ps(_mm_add_ps(sarea, _mm_loadu_ps(&s.area[j])), inter);
+        __m128 over = _mm_cmpgt_ps(inter, _mm_mul_ps(sthr, uni));
+        if (class_aware) {
+            __m128i same = _mm_cmpeq_epi32(scls, _mm_loadu_si128(reinterpret_cast<const __m128i*>(&s.cls[j])));
+            over = _mm_and_ps(over, _mm_castsi128_ps(same));
+        }
+        __m128i* supp = reinterpret_cast<__m128i*>(&s.suppressed[j]);
+        _mm_storeu_si128(supp, _mm_or_si128(_mm_loadu_si128(supp), _mm_castps_si128(over)));
+    }
+#endif
+    for (; j < m; ++j) {
+        float w = std::max(0.0f, std::min(bx2, s.x2[j]) - std::max(bx1, s.x1[j]));
+        float h = std::max(0.0f, std::min(by2, s.y2[j]) - std::max(by1, s.y1[j]));
+        float inter = w * h;
+        float uni = barea + s.area[j] - inter;
+        bool over = inter > iou_threshold * uni && (!class_aware || s.cls[j] == bcls);
+        s.suppressed[j] |= over ? -1 : 0;
+    }
+}
+
+} // namespace
+
+size_t nms_boxes(const DetectionCandidates& candidates, const NmsOptions& options, std::vector<int>& keep, NmsScratch& scratch) {
+    keep.clear();
+    const int n = static_cast<int>(candidates.size());
+    if (n == 0) {
+        return 0;
+    }
+
+    // sort by descending score, ties keep the decoding order
+    std::vector<int>& order = scratch.order;
+    order.resize(n);
+    std::iota(order.begin(), order.end(), 0);
+    const float* score = candidates.score.data();
+    auto by_score = [score](int a, int b) { return score[a] > score[b] || (score[a] == score[b] && a < b); };
+    int m = n;
+    if (options.max_candidates > 0 && n > options.max_candidates) {
+        m = options.max_candidates;
+        std::partial_sort(order.begin(), order.begin() + m, order.end(), by_score);
+    }
+    else {
+        std::sort(order.begin(), order.end(), by_score);
+    }
+
+    scratch.x1.resize(m);
+    scratch.y1.resize(m);
+    scratch.x2.resize(m);
+    scratch.y2.resize(m);
+    scratch.area.resize(m);
+    scratch.cls.resize(m);
+    scratch.suppressed.assign(m, 0);
+    for (int k = 0; k < m; ++k) {
+        int idx = order[k];
+        float w = candidates.w[idx];
+        float h = candidates.h[idx];
+        scratch.x1[k] = candidates.x[idx];
+        scratch.y1[k] = candidates.y[idx];
+        scratch.x2[k] = candidates.x[idx] + w;
+        scratch.y2[k] = candidates.y[idx] + h;
+        scratch.area[k] = w * h;
+        scratch.cls[k] = candidates.class_id[idx];
+    }
+
+    const bool class_aware = !options.class_agnostic;
+    for (int i = 0; i < m; ++i) {
+        if (scratch.suppressed[i]) {
+            continue;
+        }
+        keep.push_back(order[i]);
+        if (options.top_k > 0 && static_cast<int>(keep.size()) >= options.top_k) {
+            break;
+        }
+        suppress_overlaps(i, m, class_aware, options.iou_threshold, scratch);
+    }
+    return keep.size();
+}
@@ -0,0 +1,210 @@
+#include "nn/async_engine.h"
+
+#include <iostream>
+#include <stdexcept>
+
+#include "nn_utils.h"
+
+AsyncInferenceEngine::AsyncInferenceEngine(AutoBackendOnnx& model, float conf, float iou, int conversionCode, size_t max_in_flight)
+    : model_(model), conf_(conf), iou_(iou), conversionCode_(conversionCode),
+    freeSlots_(max_in_flight), preprocessQueue_(max_in_flight), inferenceQueue_(max_in_flight), postprocessQueue_(max_in_flight)
+{
+    if (max_in_flight == 0) {
+        throw std::invalid_argument("AsyncInferenceEngine: max_in_flight must be at least 1");
+    }
+
+    // a model exported with a fixed batch > 1 still runs the whole batch, only the first image is used
+    int64_t batch = model_.hasDynamicBatch() ? 1 : model_.getBatch();
+    std::vector<int64_t> inputShape = model_.getInputTensorShape();
+    inputShape[0] = batch;
+    std::vector<int64_t> outputShape = { batch, model_.getOutputFeatures(), model_.getOutputAnchors() };
+    staticOutput_ = outputShape[1] > 0 && outputShape[2] > 0;
+    if (!staticOutput_) {
+        std::cerr << "Warning: output0 has dynamic axes, output tensors will be allocated on every run" << std::endl;
+    }
+
+    Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+    for (size_t i = 0; i < max_in_flight; ++i) {
+        std::unique_ptr<Slot> slot = std::make_unique<Slot>();
+        int inputSize = static_cast<int>(vector_product(inputShape));
+        slot->blob.create(1, inputSize, CV_32F);
+        slot->inputTensors.push_back(Ort::Value::CreateTensor<float>(
+            memoryInfo, slot->blob.ptr<float>(), inputSize, inputShape.data(), inputShape.size()));
+        if (staticOutput_) {
+            slot->output.create(static_cast<int>(batch * outputShape[1]), static_cast<int>(outputShape[2]), CV_32F);
+            slot->outputTensors.push_back(Ort::Value::CreateTensor<float>(
+                memoryInfo, slot->output.ptr<float>(), slot->output.total(), outputShape.data(), outputShape.size()));
+        }
+        slots_.push_back(std::move(slot));
+        freeSlots_.try_push(i);
+    }
+
+    preprocessThread_ = std::thread(&AsyncInferenceEngine::_preprocess_worker, this);
+    inferenceThread_ = std::thread(&AsyncInferenceEngine::_inference_worker, this);
+    postprocessThread_ = std::thread(&AsyncInferenceEngine::_postprocess_worker, this);
+}
+
+AsyncInferenceEngine::~AsyncInferenceEngine() {
+    stop();
+}
+
+std::future<std::vector<YoloResults>> AsyncInferenceEngine::submit(const cv::Mat& image) {
+    size_t slot_idx;
+    _acquire_slot(slot_idx);
+    Slot& slot = *slots_[slot_idx];
+    image.copyTo(slot.image);
+    slot.promise = std::promise<std::vector<YoloResults>>();
+    slot.callback = nullptr;
+    std::future<std::vector<YoloResults>> future = slot.promise.get_future();
+    _enqueue(slot_idx);
+    return future;
+}
+
+void AsyncInferenceEngine::submit(const cv::Mat& image, Callback callback) {
+    size_t slot_idx;
+    _acquire_slot(slot_idx);
+    Slot& slot = *slots_[slot_idx];
+    image.copyTo(slot.image);
+    slot.callback = std::move(callback);
+    _enqueue(slot_idx);
+}
+
+void AsyncInferenceEngine::stop() {
+    if (stopping_.exchange(true)) {
+        return;
+    }
+    preprocessSignal_.notify();
+    freeSlotSignal_.notify();
+    if (preprocessThread_.joinable()) {
+        preprocessThread_.join();
+    }
+    if (inferenceThread_.joinable()) {
+        inferenceThread_.join();
+    }
+    if (postprocessThread_.joinable()) {
+        postprocessThread_.join();
+    }
+}
+
+void AsyncInferenceEngine::_acquire_slot(size_t& slot_idx) {
+    if (std::this_thread::get_id() == postprocessThread_.get_id()) {
+        throw std::logic_error("AsyncInferenceEngine::submit called from a result callback");
+    }
+    // back-pressure: wait until the postprocess worker recycles a slot
+    while (!freeSlots_.try_pop(slot_idx)) {
+        if (stopping_.load(std::memory_order_acquire)) {
+            throw std::logic_error("AsyncInferenceEngine::submit called after stop()");
+        }
+        freeSlotSignal_.wait([this] { return !freeSlots_.empty() || stopping_.load(std::memory_order_acquire); });
+    }
+    if (stopping_.load(std::memory_order_acquire)) {
+        // the workers may already have drained their queues and exited, the frame would never be processed.
+        // The slot is not handed back, only the postprocess worker may push to freeSlots_.
+        throw std::logic_error("AsyncInferenceEngine::submit called after stop()");
+    }
+    slots_[slot_idx]->error = nullptr;
+}
+
+void AsyncInferenceEngine::_enqueue(size_t slot_idx) {
+    // cannot fail, there are never more slot indices in flight than the queue capacity
+    preprocessQueue_.try_push(slot_idx);
+    preprocessSignal_.notify();
+}
+
+void AsyncInferenceEngine::_preprocess_worker() {
+    size_t slot_idx;
+    while (true) {
+        preprocessSignal_.wait([this] { return !preprocessQueue_.empty() || stopping_.load(std::memory_order_acquire); });
+        if (!preprocessQueue_.try_pop(slot_idx)) {
+            break;  // stopped and drained
+        }
+        Slot& slot = *slots_[slot_idx];
+        try {
+            model_.preprocess(slot.image, slot.blob.ptr<float>(), conversionCode_);
+        }
+        catch (...) {
+            slot.error = std::current_exception();
+        }
+        inferenceQueue_.try_push(slot_idx);
+        inferenceSignal_.notify();
+    }
+    preprocessDone_.store(true, std::memory_order_release);
+    inferenceSignal_.notify();
+}
+
+void AsyncInferenceEngine::_inference_worker() {
+    size_t slot_idx;
+    while (true) {
+        inferenceSignal_.wait([this] { return !inferenceQueue_.empty() || preprocessDone_.load(std::memory_order_acquire); });
+        if (!inferenceQueue_.try_pop(slot_idx)) {
+            break;  // the preprocess worker is done and nothing is left
+        }
+        Slot& slot = *slots_[slot_idx];
+        if (!slot.error) {
+            try {
+                if (staticOutput_) {
+                    model_.forward(slot.inputTensors, slot.outputTensors);
+                }
+                else {
+                    slot.outputTensors = model_.forward(slot.inputTensors);
+                }
+            }
+            catch (...) {
+                slot.error = std::current_exception();
+            }
+        }
+        postprocessQueue_.try_push(slot_idx);
+        postprocessSignal_.notify();
+    }
+    inferenceDone_.store(true, std::memory_order_release);
+    postprocessSignal_.notify();
+}
+
+void AsyncInferenceEngine::_postprocess_worker() {
+    size_t slot_idx;
+    while (true) {
+        postprocessSignal_.wait([this] { return !postprocessQueue_.empty() || inferenceDone_.load(std::memory_order_acquire); });
+        if (!postprocessQueue_.try_pop(slot_idx)) {
+            break;  // the inference worker is done and nothing is left
+        }
+        Slot& slot = *slots_[slot_idx];
+        if (!slot.error) {
+            try {
+                cv::Mat output0;
+                if (staticOutput_) {
+                    output0 = slot.output.rowRange(0, static_cast<int>(model_.getOutputFeatures()));
+                }
+                else {
+                    std::vector<int64_t> shape = slot.outputTensors[0].GetTensorTypeAndShapeInfo().GetShape();
+                    output0 = cv::Mat(static_cast<int>(shape[1]), static_cast<int>(shape[2]), CV_32F, slot.outputTensors[0].GetTensorMutableData<float>());
+                }
+                model_.postprocess(output0, slot.image.size(), slot.results, conf_, iou_);
+            }
+            catch (...) {
+                slot.error = std::current_exception();
+            }
+        }
+
+        if (slot.callback) {
+            // user code, an exception escaping it would terminate the worker thread
+            try {
+                slot.callback(std::move(slot.results), slot.error);
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Warning: AsyncInferenceEngine result callback threw (" << e.what() << ")" << std::endl;
+            }
+            catch (...) {
+                std::cerr << "Warning: AsyncInferenceEngine result callback threw" << std::endl;
+            }
+        }
+        else if (slot.error) {
+            slot.promise.set_exception(slot.error);
+        }
+        else {
+            slot.promise.set_value(std::move(slot.results));
+        }
+        slot.results = std::vector<YoloResults>();
+        freeSlots_.try_push(slot_idx);
+        freeSlotSignal_.notify();
+    }
+}
@@ -1,56 +1,106 @@
 #include "nn/autobackend.h"
 
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <ostream>
 #include <filesystem>
 
-#include <opencv2/opencv.hpp>
-#include <opencv2/imgcodecs.hpp>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/core/mat.hpp>
 
 #include "constants.h"
 #include "nn_utils.h"
+#include "nms.h"
+#include "postprocess.h"
+#include "preprocess.h"
 
 namespace fs = std::filesystem;
 
-AutoBackendOnnx::AutoBackendOnnx(const char* modelPath, const char* logid, const char* provider)
-    : OnnxModelBase(modelPath, logid, provider) {
-    const std::unordered_map<std::string, std::string>& base_metadata = OnnxModelBase::getMetadata();
+namespace {
 
-    auto imgsz_iterator = base_metadata.find(MetadataConstants::IMGSZ);
-    if (imgsz_iterator != base_metadata.end()) {
-        std::vector<int> imgsz = parse_imgsz_from_metadata(imgsz_iterator->second);
+// Filters are re-created on every OBS scene switch, so the parsed metadata of a model is kept for the whole process.
+// The key is built from the raw metadata values themselves, so a changed model can never hit a stale entry.
+std::shared_ptr<const YoloMetadata> parse_yolo_metadata_cached(const std::unordered_map<std::string, std::string>& metadata) {
+    static std::mutex cacheMutex;
+    static std::unordered_map<std::string, std::shared_ptr<const YoloMetadata>> cache;
+
+    std::string key;
+    for (const std::string& name : { MetadataConstants::IMGSZ, MetadataConstants::STRIDE, MetadataConstants::NAMES, MetadataConstants::TASK, MetadataConstants::BATCH }) {
+        auto it = metadata.find(name);
+        key += it != metadata.end() ? it->second : std::string();
+        key += '\x1f';
+    }
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto cached = cache.find(key);
+    if (cached != cache.end()) {
+        return cached->second;
+    }
+
+    std::shared_ptr<YoloMetadata> parsed = std::make_shared<YoloMetadata>();
+    auto imgsz_item = metadata.find(MetadataConstants::IMGSZ);
+    if (imgsz_item != metadata.end()) {
+        parsed->imgsz = parse_imgsz_from_metadata(imgsz_item->second);
+    }
+    auto stride_item = metadata.find(MetadataConstants::STRIDE);
+    if (stride_item != metadata.end()) {
+        parsed->stride = std::stoi(stride_item->second);
+    }
+    auto names_item = metadata.find(MetadataConstants::NAMES);
+    if (names_item != metadata.end()) {
+        parsed->names = parse_names_from_metadata(names_item->second);
+    }
+    auto task_item = metadata.find(MetadataConstants::TASK);
+    if (task_item != metadata.end()) {
+        parsed->task = task_item->second;
+    }
+    // the exported batch size is informational, the input shape tells whether the batch axis is dynamic
+    auto batch_item = metadata.find(MetadataConstants::BATCH);
+    if (batch_item != metadata.end()) {
+        parsed->batch = std::stoi(batch_item->second);
+    }
+
+    cache.emplace(key, parsed);
+    return parsed;
+}
+
+} // namespace
+
+AutoBackendOnnx::AutoBackendOnnx(const char* modelPath, const char* logid, const char* provider, const SessionConfig& sessionConfig)
+    : OnnxModelBase(modelPath, logid, provider, sessionConfig) {
+    std::shared_ptr<const YoloMetadata> parsed = parse_yolo_metadata_cached(OnnxModelBase::getMetadata());
+
+    if (!parsed->imgsz.empty()) {
         if (imgsz_.empty()) {
-            imgsz_ = imgsz;
+            imgsz_ = parsed->imgsz;
         }
     }
     else {
         std::cerr << "Warning: Cannot get imgsz value from metadata" << std::endl;
     }
 
-    auto stride_item = base_metadata.find(MetadataConstants::STRIDE);
-    if (stride_item != base_metadata.end()) {
-        int stide_int = std::stoi(stride_item->second);
+    if (parsed->stride != OnnxInitializers::UNINITIALIZED_STRIDE) {
         if (stride_ == OnnxInitializers::UNINITIALIZED_STRIDE) {
-            stride_ = stide_int;
+            stride_ = parsed->stride;
         }
     }
     else {
         std::cerr << "Warning: Cannot get stride value from metadata" << std::endl;
     }
 
-    auto names_item = base_metadata.find(MetadataConstants::NAMES);
-    if (names_item != base_metadata.end()) {
-        std::unordered_map<int, std::string> names = parse_names_from_metadata(names_item->second);
+    if (!parsed->names.empty()) {
 #if DEBUG_INFO
         std::cout << "***Names from metadata***" << std::endl;
-        for (const auto& pair : names) {
+        for (const auto& pair : parsed->names) {
             std::cout << "Key: " << pair.first << ", Value: " << pair.second << std::endl;
         }
 #endif
         if (names_.empty()) {
-            names_ = names;
+            names_ = parsed->names;
         }
     }
     else {
@@ -71,19 +121,86 @@ AutoBackendOnnx::AutoBackendOnnx(const char* modelPath, const char* logid, const
 
     if (!imgsz_.empty()) {
         cvSize_ = cv::Size(getWidth(), getHeight());
+        metadataCvSize_ = cvSize_;
     }
 
     // task init
-    auto task_item = base_metadata.find(MetadataConstants::TASK);
-    if (task_item != base_metadata.end()) {
-        std::string task = std::string(task_item->second);
+    if (!parsed->task.empty()) {
         if (task_.empty()) {
-            task_ = task;
+            task_ = parsed->task;
         }
     }
     else {
         std::cerr << "Warning: Cannot get task value from metadata" << std::endl;
     }
+
+    batch_ = parsed->batch;
+
+    _init_io_tensors();
+}
+
+void AutoBackendOnnx::_init_io_tensors() {
+    if (inputTensorShape_.empty()) {
+        std::cerr << "Warning: Cannot allocate input tensor, input shape is unknown" << std::endl;
+        return;
+    }
+
+    // input is [bs, ch, H, W], bs <= 0 means that the model was exported with a dynamic batch axis
+    Ort::TypeInfo inputTypeInfo = session.GetInputTypeInfo(0);
+    std::vector<int64_t> inputShape = inputTypeInfo.GetTensorTypeAndShapeInfo().GetShape();
+    modelBatch_ = (inputShape.size() == 4 && inputShape[0] > 0) ? inputShape[0] : -1;
+    if (modelBatch_ > 0) {
+        batch_ = static_cast<int>(modelBatch_);
+    }
+    dynamicInputSize_ = inputShape.size() == 4 && (inputShape[2] <= 0 || inputShape[3] <= 0);
+
+    // output0 is expected to be [bs, features, preds_num]
+    Ort::TypeInfo outputTypeInfo = session.GetOutputTypeInfo(0);
+    std::vector<int64_t> outputShape = outputTypeInfo.GetTensorTypeAndShapeInfo().GetShape();
+    if (outputShape.size() == 3 && outputShape[1] > 0 && outputShape[2] > 0) {
+        outputFeatures_ = outputShape[1];
+        outputAnchors_ = outputShape[2];
+    }
+    else {
+        std::cerr << "Warning: output0 has dynamic axes, output tensor will be allocated on every run" << std::endl;
+    }
+
+    _bind_io_tensors(modelBatch_ > 0 ? modelBatch_ : 1);
+}
+
+void AutoBackendOnnx::_bind_io_tensors(int64_t batch) {
+    if (batch == boundBatch_ || inputTensorShape_.empty()) {
+        return;
+    }
+    Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+
+    // the blobs only ever grow, so going back to a smaller batch just re-wraps the same memory
+    boundInputShape_ = inputTensorShape_;
+    boundInputShape_[0] = batch;
+    size_t inputSize = static_cast<size_t>(vector_product(boundInputShape_));
+    if (inputBlob_.total() < inputSize) {
+        inputBlob_.create(1, static_cast<int>(inputSize), CV_32F);
+    }
+    inputTensors_.clear();
+    inputTensors_.push_back(Ort::Value::CreateTensor<float>(
+        memoryInfo, inputBlob_.ptr<float>(), inputSize,
+        boundInputShape_.data(), boundInputShape_.size()
+    ));
+
+    outputTensors_.clear();
+    dynamicOutputShapeKnown_ = false;
+    if (outputFeatures_ > 0 && outputAnchors_ > 0) {
+        boundOutputShape_ = { batch, outputFeatures_, outputAnchors_ };
+        size_t outputSize = static_cast<size_t>(vector_product(boundOutputShape_));
+        if (outputBlob_.total() < outputSize) {
+            outputBlob_.create(1, static_cast<int>(outputSize), CV_32F);
+        }
+        outputTensors_.push_back(Ort::Value::CreateTensor<float>(
+            memoryInfo, outputBlob_.ptr<float>(), outputSize,
+            boundOutputShape_.data(), boundOutputShape_.size()
+        ));
+    }
+    boundBatch_ = batch;
 }
 
 const std::vector<int>& AutoBackendOnnx::getImgsz() { return imgsz_; }
@@ -96,138 +213,326 @@ const std::unordered_map<int, std::string>& AutoBackendOnnx::getNames() { return
 const cv::Size& AutoBackendOnnx::getCvSize() { return cvSize_; }
 const std::vector<int64_t>& AutoBackendOnnx::getInputTensorShape() { return inputTensorShape_; }
 const std::string& AutoBackendOnnx::getTask() { return task_; }
+const int& AutoBackendOnnx::getBatch() { return batch_; }
+bool AutoBackendOnnx::hasDynamicBatch() { return modelBatch_ <= 0; }
+const int64_t& AutoBackendOnnx::getOutputFeatures() { return outputFeatures_; }
+const int64_t& AutoBackendOnnx::getOutputAnchors() { return outputAnchors_; }
+const NmsOptions& AutoBackendOnnx::getNmsOptions() { return nmsOptions_; }
+void AutoBackendOnnx::setNmsOptions(const NmsOptions& options) { nmsOptions_ = options; }
+const StageTimes& AutoBackendOnnx::getLastStageTimes() { return lastStageTimes_; }
+bool AutoBackendOnnx::hasDynamicInputSize() { return dynamicInputSize_; }
+const cv::Size& AutoBackendOnnx::getMetadataCvSize() { return metadataCvSize_; }
+
+const DynamicResolutionOptions& AutoBackendOnnx::getDynamicResolution() { return dynamicResolution_; }
+
+void AutoBackendOnnx::setDynamicResolution(const DynamicResolutionOptions& options) {
+    if (options.enabled && !dynamicInputSize_) {
+        std::cerr << "Warning: The model has a fixed input size, dynamic resolution is ignored" << std::endl;
+    }
+    dynamicResolution_ = options;
+    if (!options.enabled) {
+        setInputSize(metadataCvSize_);
+    }
+}
 
-std::vector<YoloResults> AutoBackendOnnx::predict_once(cv::Mat& image, float& conf, float& iou, float& mask_threshold, int conversionCode) {
+cv::Size AutoBackendOnnx::_dynamic_input_size(const cv::Size& image_size) {
+    const int stride = std::max(getStride(), 1);
+    auto align = [&](int length) {
+        int aligned = static_cast<int>(std::lround(static_cast<float>(length) * dynamicResolution_.quality / static_cast<float>(stride))) * stride;
+        return std::max(aligned, stride);
+    };
+    cv::Size max_shape(align(metadataCvSize_.width), align(metadataCvSize_.height));
+    return letterbox_auto_shape(image_size, max_shape, stride);
+}
+
+bool AutoBackendOnnx::setInputSize(const cv::Size& size) {
+    if (size == cvSize_) {
+        return true;
+    }
+    if (!dynamicInputSize_ || size.empty() || imgsz_.size() < 2) {
+        return false;
+    }
+    imgsz_[0] = size.height;
+    imgsz_[1] = size.width;
+    cvSize_ = size;
+    inputTensorShape_ = { 1, ch_, size.height, size.width };
+    // the number of anchors follows the input size, so output0 is always allocated by onnxruntime for these models
+    boundBatch_ = 0;
+    return true;
+}
 
-    // 1. preprocess
-#if TIMING_INFO
+template <typename Preprocess>
+void AutoBackendOnnx::_predict_once(const cv::Size& image_size, std::vector<YoloResults>& results, float& conf, float& iou, Preprocess&& fill_input) {
+
+    // 1. preprocess, the stage times feed InferenceScheduler (getLastStageTimes) and the latency histograms
     double preprocess_time = 0.0;
     double inference_time = 0.0;
     double postprocess_time = 0.0;
-    Timer preprocess_timer = Timer(preprocess_time, true);
-#endif
-    cv::Mat preprocessed_img;
-    cv::Size new_shape = cv::Size(getWidth(), getHeight());
-    letterbox(image, preprocessed_img, new_shape, false, false, true, getStride());
-
-    cv::cvtColor(preprocessed_img, preprocessed_img, conversionCode);
-
-    float* blob = nullptr;
-    std::vector<int64_t> inputTensorShape;
-    _fill_blob(preprocessed_img, blob, inputTensorShape);
-
-    std::vector<Ort::Value> inputTensors;
-    int64_t inputTensorSize = vector_product(inputTensorShape);
-    std::vector<float> inputTensorValues(blob, blob + inputTensorSize);
-    Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
-    inputTensors.push_back(Ort::Value::CreateTensor<float>(
-        memoryInfo, inputTensorValues.data(), inputTensorSize,
-        inputTensorShape.data(), inputTensorShape.size()
-    ));
+    Timer preprocess_timer = Timer(preprocess_time, LatencyStage::Preprocess);
+    if (dynamicResolution_.enabled && dynamicInputSize_) {
+        setInputSize(_dynamic_input_size(image_size));
+    }
+    // a model exported with a fixed batch > 1 still runs the whole batch, only the first slot is used
+    _bind_io_tensors(modelBatch_ > 0 ? modelBatch_ : 1);
+    fill_input(inputBlob_.ptr<float>());
 
     // 2. inference
-#if TIMING_INFO
     preprocess_timer.Stop();
-    Timer inference_timer = Timer(inference_time, true);
-#endif
-    std::vector<Ort::Value> outputTensors = forward(inputTensors);
-#if TIMING_INFO
+    Timer inference_timer = Timer(inference_time, LatencyStage::Inference);
+    cv::Mat rawOutput0 = _forward_bound();  // [bs * features, preds_num]
     inference_timer.Stop();
-    Timer postprocess_timer = Timer(postprocess_time, true);
-#endif
+    Timer postprocess_timer = Timer(postprocess_time, LatencyStage::Postprocess);
 
     // 3. postprocess
-    std::vector<YoloResults> results;
-    std::unordered_map<int, std::string> names = this->getNames();
-    int class_names_num = names.size();
+    int class_names_num = static_cast<int>(names_.size());
 
-    ImageInfo img_info = { image.size() };
-    std::vector<int64_t> outputTensor0Shape = outputTensors[0].GetTensorTypeAndShapeInfo().GetShape();
-    float* all_data0 = outputTensors[0].GetTensorMutableData<float>();
-    cv::Mat output0 = cv::Mat(cv::Size((int)outputTensor0Shape[2], (int)outputTensor0Shape[1]), CV_32F, all_data0).t();  // [bs, features, preds_num]=>[bs, preds_num, features]
+    ImageInfo img_info = { image_size };
+    cv::Mat output0 = _output_of(rawOutput0, 0);
     _postprocess_detects(output0, img_info, results, class_names_num, conf, iou);
 
-#if TIMING_INFO
     postprocess_timer.Stop();
-
-    std::cout << std::fixed << std::setprecision(1)
-        << "Speed (" << (preprocess_time + inference_time + postprocess_time) * 1000.0 << "ms" << "): "
-        << (preprocess_time * 1000.0) << "ms preprocess, " << (inference_time * 1000.0) << "ms inference, "
-        << (postprocess_time * 1000.0) << "ms postprocess ; with img shape "
-        << "(1, " << image.channels() << ", " << preprocessed_img.rows << ", " << preprocessed_img.cols << ")" << std::endl;
-#endif
+    lastStageTimes_ = { preprocess_time, inference_time, postprocess_time };
+    if (latency_metrics_enabled()) {
+        latency_histogram(LatencyStage::Total).record(lastStageTimes_.total());
+    }
 #if DEBUG_INFO
-    std::cout << "image: " << preprocessed_img.rows << "x" << preprocessed_img.cols << ", " << results.size() << " object(s), shape: (1, " << image.channels() << ", " << preprocessed_img.rows << ", " << preprocessed_img.cols << ")" << std::endl;
+    std::cout << "image: " << getHeight() << "x" << getWidth() << ", " << results.size() << " object(s), shape: (1, " << ch_ << ", " << getHeight() << ", " << getWidth() << ")" << std::endl;
 #endif
+}
+
+std::vector<YoloResults> AutoBackendOnnx::predict_once(cv::Mat& image, float& conf, float& iou, float& mask_threshold, int conversionCode) {
+    std::vector<YoloResults> results;
+    predict_once(image, results, conf, iou, mask_threshold, conversionCode);
+    return results;
+}
+
+std::vector<YoloResults> AutoBackendOnnx::predict_once(const YuvImage& image, float& conf, float& iou, float& mask_threshold) {
+    std::vector<YoloResults> results;
+    predict_once(image, results, conf, iou, mask_threshold);
+    return results;
+}
+
+void AutoBackendOnnx::predict_once(cv::Mat& image, std::vector<YoloResults>& results, float& conf, float& iou, float& /*mask_threshold*/, int conversionCode) {
+    _predict_once(image.size(), results, conf, iou, [&](float* blob) { preprocess(image, blob, conversionCode); });
+}
+
+void AutoBackendOnnx::predict_once(const YuvImage& image, std::vector<YoloResults>& results, float& conf, float& iou, float& /*mask_threshold*/) {
+    _predict_once(image.size(), results, conf, iou, [&](float* blob) { preprocess(image, blob); });
+}
+
+std::vector<std::vector<YoloResults>> AutoBackendOnnx::predict_batch(const std::vector<cv::Mat>& images, float& conf, float& iou, float& /*mask_threshold*/, int conversionCode) {
+    std::vector<std::vector<YoloResults>> results(images.size());
+    if (images.empty()) {
+        return results;
+    }
+
+    // dynamic batch axis: everything in one run, fixed batch: chunks of the exported batch size
+    size_t chunk = modelBatch_ > 0 ? static_cast<size_t>(modelBatch_) : images.size();
+    size_t imageSize = static_cast<size_t>(ch_) * getHeight() * getWidth();
+    int class_names_num = static_cast<int>(getNames().size());
+    lastStageTimes_ = StageTimes();
+
+    for (size_t start = 0; start < images.size(); start += chunk) {
+        size_t count = std::min(chunk, images.size() - start);
+
+        // 1. preprocess
+        double preprocess_time = 0.0;
+        double inference_time = 0.0;
+        double postprocess_time = 0.0;
+        Timer preprocess_timer = Timer(preprocess_time, true);
+        _bind_io_tensors(modelBatch_ > 0 ? modelBatch_ : static_cast<int64_t>(count));
+        for (size_t i = 0; i < count; ++i) {
+            cv::Mat image = images[start + i];
+            preprocess(image, inputBlob_.ptr<float>() + i * imageSize, conversionCode);
+        }
+
+        // 2. inference
+        preprocess_timer.Stop();
+        Timer inference_timer = Timer(inference_time, true);
+        cv::Mat rawOutput0 = _forward_bound();
+        inference_timer.Stop();
+        Timer postprocess_timer = Timer(postprocess_time, true);
+
+        // 3. postprocess, every image is scaled back with its own geometry
+        for (size_t i = 0; i < count; ++i) {
+            ImageInfo img_info = { images[start + i].size() };
+            cv::Mat output0 = _output_of(rawOutput0, static_cast<int>(i));
+            _postprocess_detects(output0, img_info, results[start + i], class_names_num, conf, iou);
+        }
+
+        postprocess_timer.Stop();
+        lastStageTimes_.preprocess_seconds += preprocess_time;
+        lastStageTimes_.inference_seconds += inference_time;
+        lastStageTimes_.postprocess_seconds += postprocess_time;
+    }
 
     return results;
 }
 
+std::vector<YoloResults> AutoBackendOnnx::predict_tiled(cv::Mat& image, float& conf, float& iou, float& mask_threshold, int conversionCode,
+    const TilingOptions& options) {
+    cv::Size tile_size = options.tile_size.empty() ? getCvSize() : options.tile_size;
+    std::vector<cv::Rect> tiles = tile_grid(image.size(), tile_size, options.overlap);
+    if (tiles.size() <= 1) {
+        return predict_once(image, conf, iou, mask_threshold, conversionCode);
+    }
+
+    tileViews_.clear();
+    for (const cv::Rect& tile : tiles) {
+        tileViews_.push_back(image(tile));
+    }
+    if (options.include_full_frame) {
+        tileViews_.push_back(image);
+    }
+    // every view is scaled back to its own size, so only the tile offset is left to add
+    std::vector<std::vector<YoloResults>> tile_results = predict_batch(tileViews_, conf, iou, mask_threshold, conversionCode);
+
+    double merge_time = 0.0;
+    Timer merge_timer = Timer(merge_time, true);
+    tileCandidates_.clear();
+    for (size_t t = 0; t < tile_results.size(); ++t) {
+        cv::Point2f offset = t < tiles.size() ? cv::Point2f(static_cast<float>(tiles[t].x), static_cast<float>(tiles[t].y)) : cv::Point2f();
+        for (const YoloResults& result : tile_results[t]) {
+            tileCandidates_.push_back(result.bbox.x + offset.x, result.bbox.y + offset.y, result.bbox.width, result.bbox.height, result.conf, result.class_idx);
+        }
+    }
+
+    NmsOptions nms_options = nmsOptions_;
+    nms_options.iou_threshold = iou;
+    nms_boxes(tileCandidates_, nms_options, nmsResult_, nmsScratch_);
+    std::vector<YoloResults> results;
+    results.reserve(nmsResult_.size());
+    for (int idx : nmsResult_) {
+        cv::Rect_<float> box(tileCandidates_.x[idx], tileCandidates_.y[idx], tileCandidates_.w[idx], tileCandidates_.h[idx]);
+        results.push_back({ tileCandidates_.class_id[idx], tileCandidates_.score[idx], box });
+    }
+    merge_timer.Stop();
+    lastStageTimes_.postprocess_seconds += merge_time;
+
+    return results;
+}
+
+void AutoBackendOnnx::preprocess(cv::Mat& image, float* blob, int conversionCode) {
+    cv::Size new_shape = cv::Size(getWidth(), getHeight());
+    bool swapRB = false;
+    if (_can_fuse_preprocess(image, conversionCode, swapRB)) {
+        // single pass: resize + pad + channel swap + normalization + hwc -> chw, straight into the input tensor
+        LetterboxGeometry geometry = letterbox_geometry(image.size(), new_shape, false, false, true, getStride());
+        letterbox_to_blob(image, blob, geometry, swapRB, preprocessScratch_);
+    }
+    else {
+        // letterbox() step by step, into scratch images that keep their buffers while the frame size does not change
+        LetterboxGeometry geometry = letterbox_geometry(image.size(), new_shape, false, false, true, getStride());
+        cv::resize(image, preprocessScratch_.resized, geometry.newUnpad);
+        cv::copyMakeBorder(preprocessScratch_.resized, preprocessScratch_.letterboxed, geometry.top, geometry.bottom,
+            geometry.left, geometry.right, cv::BORDER_CONSTANT, Utils::LETTERBOX_COLOR);
+        cv::Mat* preprocessed_img = &preprocessScratch_.letterboxed;
+        if (conversionCode >= 0) {
+            // not in place, an in-place cvtColor copies the source first
+            cv::cvtColor(preprocessScratch_.letterboxed, preprocessScratch_.converted, conversionCode);
+            preprocessed_img = &preprocessScratch_.converted;
+        }
+        // writes straight into the buffer that inputTensors_ wraps, no per-frame tensor allocation
+        _fill_blob(*preprocessed_img, blob);
+    }
+}
+
+void AutoBackendOnnx::preprocess(const YuvImage& image, float* blob) {
+    CV_Assert(ch_ == 3);
+    LetterboxGeometry geometry = letterbox_geometry(image.size(), cv::Size(getWidth(), getHeight()), false, false, true, getStride());
+    // resize + pad + YUV -> RGB + normalization + hwc -> chw, the model expects RGB like the COLOR_BGR2RGB path
+    yuv_letterbox_to_blob(image, blob, geometry, preprocessScratch_);
+}
+
+void AutoBackendOnnx::postprocess(cv::Mat& output0, const cv::Size& image_size, std::vector<YoloResults>& output, float conf, float iou) {
+    int class_names_num = static_cast<int>(names_.size());
+    ImageInfo img_info = { image_size };
+    _postprocess_detects(output0, img_info, output, class_names_num, conf, iou);
+}
+
+cv::Mat AutoBackendOnnx::_forward_bound() {
+    if (!outputTensors_.empty()) {
+        forward(inputTensors_, outputTensors_);
+        return cv::Mat(static_cast<int>(boundBatch_ * outputFeatures_), static_cast<int>(outputAnchors_), CV_32F, outputBlob_.ptr<float>());
+    }
+
+    // output0 could not be pre-allocated, keep onnxruntime's tensor alive until the next run
+    dynamicOutputTensors_ = forward(inputTensors_);
+    // the shape only follows the bound input shape, so it is read once per binding and without GetShape()'s vector
+    if (!dynamicOutputShapeKnown_) {
+        Ort::TensorTypeAndShapeInfo outputInfo = dynamicOutputTensors_[0].GetTensorTypeAndShapeInfo();
+        CV_Assert(outputInfo.GetDimensionsCount() == 3);
+        outputInfo.GetDimensions(dynamicOutputShape_, 3);
+        dynamicOutputShapeKnown_ = true;
+    }
+    float* all_data0 = dynamicOutputTensors_[0].GetTensorMutableData<float>();
+    return cv::Mat(static_cast<int>(dynamicOutputShape_[0] * dynamicOutputShape_[1]), static_cast<int>(dynamicOutputShape_[2]), CV_32F, all_data0);
+}
+
+cv::Mat AutoBackendOnnx::_output_of(const cv::Mat& rawOutput0, int index) {
+    int features = rawOutput0.rows / static_cast<int>(boundBatch_);
+    return rawOutput0.rowRange(index * features, (index + 1) * features);
+}
 
 void AutoBackendOnnx::_postprocess_detects(cv::Mat& output0, ImageInfo image_info, std::vector<YoloResults>& output,
     int& class_names_num, float& conf_threshold, float& iou_threshold)
 {
     output.clear();
-    std::vector<int> class_ids;
-    std::vector<float> confidences;
-    std::vector<cv::Rect> boxes;
-    std::vector<std::vector<float>> masks;
 
-    // 4 - your default number of rect parameters {x, y, w, h}
-    int data_width = class_names_num + 4;
-    int rows = output0.rows;
-    float* pdata = (float*)output0.data;
-
-    for (int r = 0; r < rows; ++r)
-    {
-        cv::Mat scores(1, class_names_num, CV_32FC1, pdata + 4);
-        cv::Point class_id;
-        double max_conf;
-        minMaxLoc(scores, nullptr, &max_conf, nullptr, &class_id);
-
-        if (max_conf > conf_threshold)
-        {
-            masks.emplace_back(pdata + 4 + class_names_num, pdata + data_width);
-            class_ids.push_back(class_id.x);
-            confidences.push_back((float)max_conf);
-
-            float out_w = pdata[2];
-            float out_h = pdata[3];
-            float out_left = MAX((pdata[0] - 0.5 * out_w + 0.5), 0);
-            float out_top = MAX((pdata[1] - 0.5 * out_h + 0.5), 0);
-
-            cv::Rect_ <float> bbox = cv::Rect_ <float>(out_left, out_top, (out_w + 0.5), (out_h + 0.5));
-            cv::Rect_<float> scaled_bbox = scale_boxes(getCvSize(), bbox, image_info.raw_size);
-
-            boxes.push_back(scaled_bbox);
-        }
-        pdata += data_width; // next pred
+    // output0 is [features, preds_num], 4 - your default number of rect parameters {x, y, w, h}
+    int num_classes = std::min(class_names_num, output0.rows - 4);
+    decode_detections(output0.ptr<float>(), output0.cols, num_classes, conf_threshold, candidates_);
+
+    // only the survivors are scaled back to the original image
+    for (size_t i = 0; i < candidates_.size(); ++i) {
+        cv::Rect_<float> bbox(candidates_.x[i], candidates_.y[i], candidates_.w[i], candidates_.h[i]);
+        cv::Rect_<float> scaled_bbox = scale_boxes(getCvSize(), bbox, image_info.raw_size);
+        candidates_.x[i] = scaled_bbox.x;
+        candidates_.y[i] = scaled_bbox.y;
+        candidates_.w[i] = scaled_bbox.width;
+        candidates_.h[i] = scaled_bbox.height;
     }
 
-    std::vector<int> nms_result;
-    cv::dnn::NMSBoxes(boxes, confidences, conf_threshold, iou_threshold, nms_result); // , nms_eta, top_k);
-    for (int idx : nms_result)
+    NmsOptions nms_options = nmsOptions_;
+    nms_options.iou_threshold = iou_threshold;
+    nms_boxes(candidates_, nms_options, nmsResult_, nmsScratch_);
+    cv::Rect_<float> image_rect(0.0f, 0.0f, static_cast<float>(image_info.raw_size.width), static_cast<float>(image_info.raw_size.height));
+    for (int idx : nmsResult_)
     {
-        boxes[idx] = boxes[idx] & cv::Rect(0, 0, image_info.raw_size.width, image_info.raw_size.height);
-        YoloResults result = { class_ids[idx] ,confidences[idx] ,boxes[idx] };
+        cv::Rect_<float> box(candidates_.x[idx], candidates_.y[idx], candidates_.w[idx], candidates_.h[idx]);
+        YoloResults result = { candidates_.class_id[idx], candidates_.score[idx], box & image_rect };
         output.push_back(result);
     }
 }
 
-void AutoBackendOnnx::_fill_blob(cv::Mat& image, float*& blob, std::vector<int64_t>& inputTensorShape) {
-    cv::Mat floatImage;
-    if (inputTensorShape.empty()) {
-        inputTensorShape = getInputTensorShape();
+bool AutoBackendOnnx::_can_fuse_preprocess(const cv::Mat& image, int conversionCode, bool& swapRB) {
+    if (image.depth() != CV_8U || ch_ != 3) {
+        return false;
     }
-    image.convertTo(floatImage, CV_32FC3, 1.0f / 255.0);
-    blob = new float[floatImage.cols * floatImage.rows * floatImage.channels()];
-    cv::Size floatImageSize{ floatImage.cols, floatImage.rows };
-
-    // hwc -> chw
-    std::vector<cv::Mat> chw(floatImage.channels());
-    for (int i = 0; i < floatImage.channels(); ++i) {
-        chw[i] = cv::Mat(floatImageSize, CV_32FC1, blob + i * floatImageSize.width * floatImageSize.height);
+    int channels = image.channels();
+    if (channels == 1) {
+        swapRB = false;
+        return conversionCode < 0;
+    }
+    if (channels != 3 && channels != 4) {
+        return false;
+    }
+    switch (conversionCode) {
+    case -1:
+        swapRB = false;
+        return true;
+    case cv::COLOR_BGR2RGB:   // same code as cv::COLOR_RGB2BGR
+    case cv::COLOR_BGRA2RGB:  // same code as cv::COLOR_RGBA2BGR
+        swapRB = true;
+        return true;
+    case cv::COLOR_BGRA2BGR:  // same code as cv::COLOR_RGBA2RGB
+        swapRB = false;
+        return true;
+    default:
+        return false;
     }
-    cv::split(floatImage, chw);
 }
 
+void AutoBackendOnnx::_fill_blob(cv::Mat& image, float* blob) {
+    fill_blob(image, blob);
+}
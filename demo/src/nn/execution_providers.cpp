@@ -0,0 +1,105 @@
+#include "nn/execution_providers.h"
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+
+#include "constants.h"
+
+namespace {
+
+void append_xnnpack(Ort::SessionOptions& options, const SessionConfig& config) {
+    // XNNPACK runs its own thread pool, the onnxruntime intra-op pool should stay small (see the XNNPACK EP docs)
+    int threads = config.intra_op_threads > 0 ? config.intra_op_threads : static_cast<int>(std::max(1u, std::thread::hardware_concurrency() / 2));
+    options.AppendExecutionProvider("XNNPACK", { { "intra_op_num_threads", std::to_string(threads) } });
+}
+
+void append_dnnl(Ort::SessionOptions& options, const SessionConfig& config) {
+    const OrtApi& api = Ort::GetApi();
+    OrtDnnlProviderOptions* dnnl_options = nullptr;
+    Ort::ThrowOnError(api.CreateDnnlProviderOptions(&dnnl_options));
+    const char* keys[] = { "use_arena" };
+    const char* values[] = { config.cpu_mem_arena ? "1" : "0" };
+    OrtStatus* status = api.UpdateDnnlProviderOptions(dnnl_options, keys, values, 1);
+    if (status == nullptr) {
+        status = api.SessionOptionsAppendExecutionProvider_Dnnl(options, dnnl_options);
+    }
+    api.ReleaseDnnlProviderOptions(dnnl_options);
+    Ort::ThrowOnError(status);
+}
+
+void append_openvino(Ort::SessionOptions& options, const SessionConfig& config) {
+    OrtOpenVINOProviderOptions openvino_options;
+    openvino_options.device_type = "CPU_FP32";
+    openvino_options.num_of_threads = static_cast<size_t>(config.intra_op_threads);
+    options.AppendExecutionProvider_OpenVINO(openvino_options);
+}
+
+void append_cuda(Ort::SessionOptions& options, const SessionConfig&) {
+    OrtCUDAProviderOptions cuda_options;
+    options.AppendExecutionProvider_CUDA(cuda_options);
+}
+
+} // namespace
+
+ExecutionProviderRegistry::ExecutionProviderRegistry() {
+    add({ OnnxProviders::CPU, "CPUExecutionProvider", true, [](Ort::SessionOptions&, const SessionConfig&) {} });
+    add({ OnnxProviders::XNNPACK, "XnnpackExecutionProvider", true, append_xnnpack });
+    add({ OnnxProviders::DNNL, "DnnlExecutionProvider", true, append_dnnl });
+    add({ OnnxProviders::OPENVINO, "OpenVINOExecutionProvider", true, append_openvino });
+    add({ OnnxProviders::CUDA, "CUDAExecutionProvider", false, append_cuda });
+}
+
+ExecutionProviderRegistry& ExecutionProviderRegistry::instance() {
+    static ExecutionProviderRegistry registry;
+    return registry;
+}
+
+void ExecutionProviderRegistry::add(const ExecutionProvider& provider) {
+    auto existing = std::find_if(providers_.begin(), providers_.end(), [&](const ExecutionProvider& p) { return p.name == provider.name; });
+    if (existing != providers_.end()) {
+        *existing = provider;
+    }
+    else {
+        providers_.push_back(provider);
+    }
+}
+
+const ExecutionProvider* ExecutionProviderRegistry::find(const std::string& name) const {
+    auto it = std::find_if(providers_.begin(), providers_.end(), [&](const ExecutionProvider& p) { return p.name == name; });
+    return it != providers_.end() ? &*it : nullptr;
+}
+
+std::vector<const ExecutionProvider*> ExecutionProviderRegistry::available(bool cpu_only) const {
+    std::vector<std::string> built = Ort::GetAvailableProviders();
+    std::vector<const ExecutionProvider*> result;
+    for (const ExecutionProvider& provider : providers_) {
+        bool in_build = std::find(built.begin(), built.end(), provider.ort_name) != built.end();
+        if (in_build && (!cpu_only || provider.cpu)) {
+            result.push_back(&provider);
+        }
+    }
+    return result;
+}
+
+bool ExecutionProviderRegistry::attach(const std::string& name, Ort::SessionOptions& options, const SessionConfig& config) const {
+    const ExecutionProvider* provider = find(name);
+    if (provider == nullptr) {
+        std::cerr << "Warning: Unknown execution provider '" << name << "', using cpu" << std::endl;
+        return false;
+    }
+    std::vector<std::string> built = Ort::GetAvailableProviders();
+    if (std::find(built.begin(), built.end(), provider->ort_name) == built.end()) {
+        std::cerr << "Warning: " << provider->ort_name << " is not part of this onnxruntime build, using cpu" << std::endl;
+        return false;
+    }
+    try {
+        provider->append(options, config);
+    }
+    catch (const Ort::Exception& e) {
+        std::cerr << "Warning: Cannot attach " << provider->ort_name << " (" << e.what() << "), using cpu" << std::endl;
+        return false;
+    }
+    return true;
+}
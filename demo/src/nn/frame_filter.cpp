@@ -0,0 +1,360 @@
+#include "nn/frame_filter.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <opencv2/imgproc.hpp>
+
+#include "nn_utils.h"
+
+namespace {
+
+struct PlaneLayout {
+    int row_bytes = 0;
+    int rows = 0;
+};
+
+// Rows and bytes per row of every plane of a compact frame, returns the number of planes (0 when unsupported)
+int frame_planes(FrameFormat format, int width, int height, PlaneLayout planes[3]) {
+    if (width <= 0 || height <= 0) {
+        return 0;
+    }
+    const bool even = width % 2 == 0 && height % 2 == 0;
+    switch (format) {
+    case FrameFormat::BGRA:
+    case FrameFormat::BGRX:
+    case FrameFormat::RGBA:
+        planes[0] = { width * 4, height };
+        return 1;
+    case FrameFormat::YUY2:
+        if (width % 2 != 0) {
+            return 0;
+        }
+        planes[0] = { width * 2, height };
+        return 1;
+    case FrameFormat::NV12:
+        if (!even) {
+            return 0;
+        }
+        planes[0] = { width, height };
+        planes[1] = { width, height / 2 };
+        return 2;
+    case FrameFormat::I420:
+        if (!even) {
+            return 0;
+        }
+        planes[0] = { width, height };
+        planes[1] = { width / 2, height / 2 };
+        planes[2] = { width / 2, height / 2 };
+        return 3;
+    default:
+        return 0;
+    }
+}
+
+// NV12, I420 or YUY2 only
+YuvLayout yuv_layout_of(FrameFormat format) {
+    switch (format) {
+    case FrameFormat::NV12: return YuvLayout::NV12;
+    case FrameFormat::I420: return YuvLayout::I420;
+    default: return YuvLayout::YUY2;
+    }
+}
+
+// Runs the detector on a frame straight from its own pixel format, the boxes are in frame coordinates.
+// `results` is reused, so the worker does not allocate per frame either
+void detect(AutoBackendOnnx& model, const FrameView& frame, float conf, float iou, std::vector<YoloResults>& results) {
+    float mask_threshold = 0.5f;
+    switch (frame.format) {
+    case FrameFormat::BGRA:
+    case FrameFormat::BGRX: {
+        // the fused letterbox_to_blob path drops the 4th channel and swaps to RGB while resizing
+        cv::Mat image(frame.height, frame.width, CV_8UC4, frame.data[0], frame.linesize[0]);
+        model.predict_once(image, results, conf, iou, mask_threshold, cv::COLOR_BGRA2RGB);
+        break;
+    }
+    case FrameFormat::RGBA: {
+        cv::Mat image(frame.height, frame.width, CV_8UC4, frame.data[0], frame.linesize[0]);
+        model.predict_once(image, results, conf, iou, mask_threshold, cv::COLOR_RGBA2RGB);
+        break;
+    }
+    case FrameFormat::NV12:
+    case FrameFormat::I420:
+    case FrameFormat::YUY2: {
+        YuvImage image;
+        image.layout = yuv_layout_of(frame.format);
+        for (int i = 0; i < 3; ++i) {
+            image.data[i] = frame.data[i];
+            image.stride[i] = frame.linesize[i];
+        }
+        image.width = frame.width;
+        image.height = frame.height;
+        image.matrix = frame.matrix;
+        image.fullRange = frame.fullRange;
+        model.predict_once(image, results, conf, iou, mask_threshold);
+        break;
+    }
+    default:
+        results.clear();
+        break;
+    }
+}
+
+} // namespace
+
+size_t frame_buffer_size(FrameFormat format, int width, int height) {
+    PlaneLayout planes[3];
+    const int count = frame_planes(format, width, height, planes);
+    size_t size = 0;
+    for (int i = 0; i < count; ++i) {
+        size += static_cast<size_t>(planes[i].row_bytes) * planes[i].rows;
+    }
+    return size;
+}
+
+FrameView frame_view_of(FrameFormat format, int width, int height, uint8_t* pixels) {
+    FrameView view;
+    PlaneLayout planes[3];
+    const int count = frame_planes(format, width, height, planes);
+    if (count == 0) {
+        return view;
+    }
+    view.format = format;
+    view.width = width;
+    view.height = height;
+    for (int i = 0; i < count; ++i) {
+        view.data[i] = pixels;
+        view.linesize[i] = planes[i].row_bytes;
+        pixels += static_cast<size_t>(planes[i].row_bytes) * planes[i].rows;
+    }
+    return view;
+}
+
+FrameFilter::FrameFilter(const std::string& model_path, const SessionConfig& session_config, const std::string& provider)
+    : modelPath_(model_path), provider_(provider), sessionConfig_(session_config) {
+    worker_ = std::thread(&FrameFilter::_worker, this);
+}
+
+FrameFilter::~FrameFilter() {
+    stopping_.store(true, std::memory_order_release);
+    _wake_worker(true);
+    worker_.join();
+}
+
+void FrameFilter::filter(FrameView& frame, bool infer) {
+    double seconds = 0.0;
+    Timer timer = Timer(seconds, LatencyStage::Filter);
+    frameCount_.fetch_add(1, std::memory_order_relaxed);
+    PlaneLayout planes[3];
+    const int plane_count = frame_planes(frame.format, frame.width, frame.height, planes);
+    if (plane_count == 0) {
+        return;
+    }
+    if (options_.update()) {
+        frameOptions_ = options_.front();
+    }
+
+    if (infer && modelLoaded_.load(std::memory_order_acquire)) {
+        // compact copy into the back slot, the worker reads it after the frame went back to libobs
+        FrameCopy& copy = frames_.back();
+        copy.format = frame.format;
+        copy.width = frame.width;
+        copy.height = frame.height;
+        copy.matrix = frame.matrix;
+        copy.fullRange = frame.fullRange;
+        copy.conf = frameOptions_.conf;
+        copy.iou = frameOptions_.iou;
+        copy.pixels.resize(frame_buffer_size(frame.format, frame.width, frame.height));
+        uint8_t* dst = copy.pixels.data();
+        for (int i = 0; i < plane_count; ++i) {
+            for (int y = 0; y < planes[i].rows; ++y) {
+                std::memcpy(dst, frame.data[i] + static_cast<size_t>(y) * frame.linesize[i], planes[i].row_bytes);
+                dst += planes[i].row_bytes;
+            }
+        }
+        if (frames_.publish()) {
+            droppedCount_.fetch_add(1, std::memory_order_relaxed);
+        }
+        submittedCount_.fetch_add(1, std::memory_order_relaxed);
+        _wake_worker(false);
+    }
+
+    const bool fresh = detections_.update();
+    const Detections& detections = detections_.front();
+    if (!detections.frameSize.empty()) {
+        if (!fresh) {
+            reusedCount_.fetch_add(1, std::memory_order_relaxed);
+        }
+        frameResults_.assign(detections.results.begin(), detections.results.end());
+        if (detections.frameSize.width != frame.width || detections.frameSize.height != frame.height) {
+            const float sx = static_cast<float>(frame.width) / static_cast<float>(detections.frameSize.width);
+            const float sy = static_cast<float>(frame.height) / static_cast<float>(detections.frameSize.height);
+            for (YoloResults& result : frameResults_) {
+                result.bbox = cv::Rect_<float>(result.bbox.x * sx, result.bbox.y * sy, result.bbox.width * sx, result.bbox.height * sy);
+            }
+        }
+        _censor(frame, frameResults_);
+    }
+    timer.Stop();
+}
+
+void FrameFilter::_censor(FrameView& frame, std::vector<YoloResults>& results) {
+    if (results.empty()) {
+        return;
+    }
+    CensorOptions censor = frameOptions_.censor;
+    switch (frame.format) {
+    case FrameFormat::BGRA:
+    case FrameFormat::BGRX:
+    case FrameFormat::RGBA: {
+        cv::Mat image(frame.height, frame.width, CV_8UC4, frame.data[0], frame.linesize[0]);
+        censor.fill_color[3] = 255;  // opaque, BGRX ignores it
+        if (frame.format == FrameFormat::RGBA) {
+            std::swap(censor.fill_color[0], censor.fill_color[2]);
+        }
+        plot_results_censored(image, results, censor, censorScratch_);
+        break;
+    }
+    case FrameFormat::NV12:
+    case FrameFormat::I420:
+    case FrameFormat::YUY2: {
+        YuvPlanes planes;
+        planes.layout = yuv_layout_of(frame.format);
+        for (int i = 0; i < 3; ++i) {
+            planes.data[i] = frame.data[i];
+            planes.stride[i] = frame.linesize[i];
+        }
+        planes.width = frame.width;
+        planes.height = frame.height;
+        planes.matrix = frame.matrix;
+        planes.fullRange = frame.fullRange;
+        plot_results_censored(planes, results, censor, censorScratch_);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void FrameFilter::setOptions(const FrameFilterOptions& options) {
+    options_.back() = options;
+    options_.publish();
+}
+
+void FrameFilter::setSessionConfig(const SessionConfig& session_config) {
+    {
+        std::lock_guard<std::mutex> lock(sessionConfigMutex_);
+        sessionConfig_ = session_config;
+    }
+    reload_.store(true, std::memory_order_release);
+    _wake_worker(true);
+}
+
+void FrameFilter::setInputScale(float scale) {
+    inputScale_.store(scale, std::memory_order_relaxed);
+}
+
+bool FrameFilter::takeInferenceSeconds(double& seconds) {
+    const uint64_t totals = inferenceTotals_.exchange(0, std::memory_order_relaxed);
+    if ((totals >> INFERENCE_COUNT_SHIFT) == 0) {
+        return false;
+    }
+    const uint64_t count = totals >> INFERENCE_COUNT_SHIFT;
+    const uint64_t nanoseconds = totals & ((uint64_t(1) << INFERENCE_COUNT_SHIFT) - 1);
+    seconds = static_cast<double>(nanoseconds) * 1e-9 / static_cast<double>(count);
+    return true;
+}
+
+bool FrameFilter::isModelLoaded() const {
+    return modelLoaded_.load(std::memory_order_acquire);
+}
+
+bool FrameFilter::hasDynamicInputSize() const {
+    return modelLoaded_.load(std::memory_order_acquire) && dynamicInputSize_.load(std::memory_order_relaxed);
+}
+
+FrameFilterStats FrameFilter::getStats() const {
+    FrameFilterStats stats;
+    stats.frames = frameCount_.load(std::memory_order_relaxed);
+    stats.submitted = submittedCount_.load(std::memory_order_relaxed);
+    stats.dropped = droppedCount_.load(std::memory_order_relaxed);
+    stats.inferred = inferredCount_.load(std::memory_order_relaxed);
+    stats.reused = reusedCount_.load(std::memory_order_relaxed);
+    stats.failed = failedCount_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+bool FrameFilter::_load_model(std::unique_ptr<AutoBackendOnnx>& model) {
+    SessionConfig session_config;
+    {
+        std::lock_guard<std::mutex> lock(sessionConfigMutex_);
+        session_config = sessionConfig_;
+    }
+    model.reset();
+    try {
+        model = std::make_unique<AutoBackendOnnx>(modelPath_.c_str(), "nsfw_filter", provider_.c_str(), session_config);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Warning: Cannot load " << modelPath_ << " (" << e.what() << "), frames pass through uncensored" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void FrameFilter::_wake_worker(bool synchronize) {
+    wakeRequested_.store(true, std::memory_order_release);
+    if (synchronize) {
+        // the worker checks wakeRequested_ under the mutex, so it is either before its check or already waiting
+        std::lock_guard<std::mutex> lock(wakeMutex_);
+    }
+    wake_.notify_one();
+}
+
+void FrameFilter::_worker() {
+    std::unique_ptr<AutoBackendOnnx> model;
+    while (!stopping_.load(std::memory_order_acquire)) {
+        if (reload_.exchange(false, std::memory_order_acq_rel)) {
+            modelLoaded_.store(false, std::memory_order_release);
+            const bool loaded = _load_model(model);
+            dynamicInputSize_.store(loaded && model->hasDynamicInputSize(), std::memory_order_relaxed);
+            modelLoaded_.store(loaded, std::memory_order_release);
+            continue;
+        }
+        // frames published while the model was reloading are simply older than the next one
+        if (!frames_.update() || !model) {
+            // parked until filter() submits a frame, the session config changes or the filter is destroyed
+            std::unique_lock<std::mutex> lock(wakeMutex_);
+            wake_.wait(lock, [this] {
+                return wakeRequested_.exchange(false, std::memory_order_acq_rel) || stopping_.load(std::memory_order_acquire);
+            });
+            continue;
+        }
+
+        FrameCopy& frame = frames_.front();
+        try {
+            double seconds = 0.0;
+            Timer timer = Timer(seconds, true);
+            if (model->hasDynamicInputSize()) {
+                model->setDynamicResolution({ true, inputScale_.load(std::memory_order_relaxed) });
+            }
+            FrameView view = frame_view_of(frame.format, frame.width, frame.height, frame.pixels.data());
+            view.matrix = frame.matrix;
+            view.fullRange = frame.fullRange;
+            Detections& detections = detections_.back();
+            detect(*model, view, frame.conf, frame.iou, detections.results);
+            detections.frameSize = cv::Size(frame.width, frame.height);
+            timer.Stop();
+            detections_.publish();
+
+            // clamped so a single sample can never carry into the count
+            const uint64_t nanoseconds = std::min(static_cast<uint64_t>(seconds * 1e9), (uint64_t(1) << (INFERENCE_COUNT_SHIFT - 1)) - 1);
+            inferenceTotals_.fetch_add((uint64_t(1) << INFERENCE_COUNT_SHIFT) | nanoseconds, std::memory_order_relaxed);
+            inferredCount_.fetch_add(1, std::memory_order_relaxed);
+        }
+        catch (const std::exception& e) {
+            if (failedCount_.fetch_add(1, std::memory_order_relaxed) == 0) {
+                std::cerr << "Warning: Inference failed (" << e.what() << "), keeping the previous detections" << std::endl;
+            }
+        }
+    }
+}
@@ -1,16 +1,129 @@
 #include "nn/onnx_model_base.h"
 
 #include <iostream>
+#include <algorithm>
+#include <chrono>
 #include <codecvt>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <mutex>
+#include <unordered_map>
 #include <onnxruntime_cxx_api.h>
 #include <onnxruntime_c_api.h>
 
 #include "constants.h"
+#include "mapped_file.h"
+#include "nn/execution_providers.h"
 #include "nn_utils.h"
 
+namespace fs = std::filesystem;
 
-OnnxModelBase::OnnxModelBase(const char* modelPath, const char* logid, const char* provider)
-    : modelPath_(modelPath)
+namespace {
+
+#ifdef _WIN32
+std::wstring to_ort_path(const std::string& path) {
+    return std::wstring_convert<std::codecvt_utf8<wchar_t>>().from_bytes(path);
+}
+#else
+std::string to_ort_path(const std::string& path) {
+    return path;
+}
+#endif
+
+void apply_session_config(const SessionConfig& config, Ort::SessionOptions& session_options) {
+    static const GraphOptimizationLevel optimizationLevels[] = { ORT_DISABLE_ALL, ORT_ENABLE_BASIC, ORT_ENABLE_EXTENDED, ORT_ENABLE_ALL };
+    session_options.SetGraphOptimizationLevel(optimizationLevels[static_cast<int>(config.optimization_level)]);
+    session_options.SetIntraOpNumThreads(config.intra_op_threads);
+    session_options.SetInterOpNumThreads(config.inter_op_threads);
+    session_options.SetExecutionMode(config.execution_mode == SessionExecutionMode::Parallel ? ORT_PARALLEL : ORT_SEQUENTIAL);
+    if (config.mem_pattern) {
+        session_options.EnableMemPattern();
+    }
+    else {
+        session_options.DisableMemPattern();
+    }
+    if (config.cpu_mem_arena) {
+        session_options.EnableCpuMemArena();
+    }
+    else {
+        session_options.DisableCpuMemArena();
+    }
+    const char* spinning = config.allow_spinning ? "1" : "0";
+    session_options.AddConfigEntry("session.intra_op.allow_spinning", spinning);
+    session_options.AddConfigEntry("session.inter_op.allow_spinning", spinning);
+}
+
+// The cached graph is only valid while it is newer than the model it was optimized from
+bool is_optimized_model_fresh(const std::string& optimizedPath, const char* modelPath) {
+    std::error_code ec;
+    if (!fs::exists(optimizedPath, ec)) {
+        return false;
+    }
+    fs::file_time_type optimizedTime = fs::last_write_time(optimizedPath, ec);
+    if (ec) {
+        return false;
+    }
+    fs::file_time_type modelTime = fs::last_write_time(modelPath, ec);
+    return !ec && optimizedTime >= modelTime;
+}
+
+bool has_ort_extension(const std::string& path) {
+    return fs::path(path).extension() == ".ort";
+}
+
+// ORT format models are flatbuffers with the "ORTM" file identifier right after the root table offset
+bool is_ort_format(const void* data, size_t size) {
+    return size >= 8 && std::memcmp(static_cast<const char*>(data) + 4, "ORTM", 4) == 0;
+}
+
+// Best of CALIBRATION_RUNS inferences on zero inputs (after one warmup run), dynamic axes get a fixed size
+double measure_session_latency(Ort::Session& session) {
+    Ort::AllocatorWithDefaultOptions allocator;
+    Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+    std::vector<Ort::AllocatedStringPtr> names;
+    std::vector<const char*> inputNames;
+    std::vector<const char*> outputNames;
+    std::vector<std::vector<float>> inputData;
+    std::vector<std::vector<int64_t>> inputShapes;
+    std::vector<Ort::Value> inputs;
+    for (size_t i = 0; i < session.GetInputCount(); ++i) {
+        names.push_back(session.GetInputNameAllocated(i, allocator));
+        inputNames.push_back(names.back().get());
+        std::vector<int64_t> shape = session.GetInputTypeInfo(i).GetTensorTypeAndShapeInfo().GetShape();
+        for (size_t d = 0; d < shape.size(); ++d) {
+            if (shape[d] <= 0) {
+                shape[d] = d == 0 ? 1 : Calibration::CALIBRATION_DYNAMIC_DIM;
+            }
+        }
+        inputShapes.push_back(shape);
+        inputData.emplace_back(static_cast<size_t>(vector_product(shape)), 0.0f);
+    }
+    for (size_t i = 0; i < inputData.size(); ++i) {
+        inputs.push_back(Ort::Value::CreateTensor<float>(memoryInfo, inputData[i].data(), inputData[i].size(), inputShapes[i].data(), inputShapes[i].size()));
+    }
+    for (size_t i = 0; i < session.GetOutputCount(); ++i) {
+        names.push_back(session.GetOutputNameAllocated(i, allocator));
+        outputNames.push_back(names.back().get());
+    }
+
+    double best = 0.0;
+    for (int run = 0; run <= Calibration::CALIBRATION_RUNS; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        session.Run(Ort::RunOptions{ nullptr }, inputNames.data(), inputs.data(), inputs.size(), outputNames.data(), outputNames.size());
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (run == 1 || (run > 1 && seconds < best)) {
+            best = seconds;
+        }
+    }
+    return best;
+}
+
+} // namespace
+
+
+OnnxModelBase::OnnxModelBase(const char* modelPath, const char* logid, const char* provider, const SessionConfig& sessionConfig)
+    : modelPath_(modelPath), sessionConfig_(sessionConfig)
 {
     env = Ort::Env(
 #if ORT_VERBOSE
@@ -22,10 +135,8 @@ OnnxModelBase::OnnxModelBase(const char* modelPath, const char* logid, const cha
 #endif
         logid);
 
-    std::vector<std::string> availableProviders = Ort::GetAvailableProviders();
-    auto cudaAvailable = std::find(availableProviders.begin(), availableProviders.end(), "CUDAExecutionProvider");
-
 #if DEBUG_INFO || ORT_VERBOSE
+    std::vector<std::string> availableProviders = Ort::GetAvailableProviders();
     std::cout << "availableProviders: [";
     for (const auto& provider : availableProviders) {
         std::cout << provider << ", ";
@@ -34,37 +145,73 @@ OnnxModelBase::OnnxModelBase(const char* modelPath, const char* logid, const cha
 #endif
 
     Ort::SessionOptions session_options = Ort::SessionOptions();
-    if (provider == OnnxProviders::CUDA.c_str()) {
-        if (cudaAvailable == availableProviders.end()) {
-            std::cout << "CUDA is not supported by your ONNXRuntime build. Fallback to CPU." << std::endl;
-            std::cout << "Inference device: CPU" << std::endl;
-        }
-        else {
-            // todo: try to get cuda working
-            // std::cout << "Appending cuda provider" << std::endl;
-            // OrtTensorRTProviderOptions tensor_options = {};
-            // session_options.AppendExecutionProvider_TensorRT(tensor_options);
-            // std::cout << "Inference device: CUDA" << std::endl;
-
-            std::cout << "Haven't really implemented cuda yet lol :D" << std::endl;
-        }
+    apply_session_config(sessionConfig_, session_options);
+#if DEBUG_INFO
+    std::cout << "Session: optimization=" << optimization_level_name(sessionConfig_.optimization_level)
+        << ", intra_op_threads=" << sessionConfig_.intra_op_threads
+        << ", inter_op_threads=" << sessionConfig_.inter_op_threads
+        << ", execution_mode=" << execution_mode_name(sessionConfig_.execution_mode)
+        << ", mem_pattern=" << sessionConfig_.mem_pattern
+        << ", allow_spinning=" << sessionConfig_.allow_spinning << std::endl;
+#endif
+
+    // the options without any provider attached are kept to fall back to the default CPU EP
+    Ort::SessionOptions cpu_options = session_options.Clone();
+    provider_ = provider != nullptr && provider[0] != '\0' ? provider : OnnxProviders::CPU;
+    if (provider_ == OnnxProviders::AUTO) {
+        provider_ = _select_fastest_provider(cpu_options);
+    }
+    if (!ExecutionProviderRegistry::instance().attach(provider_, session_options, sessionConfig_)) {
+        provider_ = OnnxProviders::CPU;
     }
+#if DEBUG_INFO
+    std::cout << "Inference device: " << provider_ << std::endl;
+#endif
 
-#ifdef _WIN32
-    auto model_path_w = std::wstring_convert<std::codecvt_utf8<wchar_t>>().from_bytes(modelPath);
-    auto model_path_processed = model_path_w.c_str();
-#else
-    auto model_path_processed = modelPath;
+    // The optimized graph is loaded as is, so optimizations (already applied) are disabled for it.
+    // When it is missing, stale or cannot be loaded, the source model is optimized and serialized again.
+    // ORT format models are optimized offline already, there is nothing to cache for them, and graphs
+    // optimized for other providers may contain their compiled nodes, so only the CPU EP graph is cached.
+    const std::string& optimizedPath = sessionConfig_.optimized_model_path;
+    bool useOptimizedCache = !optimizedPath.empty() && !has_ort_extension(modelPath) && provider_ == OnnxProviders::CPU;
+    if (useOptimizedCache && is_optimized_model_fresh(optimizedPath, modelPath)) {
+        try {
+            Ort::SessionOptions cached_options = session_options.Clone();
+            cached_options.SetGraphOptimizationLevel(ORT_DISABLE_ALL);
+            session = _create_session(optimizedPath, cached_options);
+#if DEBUG_INFO
+            std::cout << "Loaded optimized model from " << optimizedPath << std::endl;
 #endif
-    session = Ort::Session(env, model_path_processed, session_options);
+        }
+        catch (const Ort::Exception& e) {
+            std::cerr << "Warning: Cannot load optimized model " << optimizedPath << " (" << e.what() << "), re-optimizing" << std::endl;
+        }
+    }
+    if (!session) {
+        auto optimized_path_processed = to_ort_path(optimizedPath);
+        if (useOptimizedCache) {
+            session_options.SetOptimizedModelFilePath(optimized_path_processed.c_str());
+        }
+        try {
+            session = _create_session(modelPath, session_options);
+        }
+        catch (const Ort::Exception& e) {
+            // shared provider libraries (dnnl, openvino) are only loaded here, a missing one shows up as a session error
+            if (provider_ == OnnxProviders::CPU) {
+                throw;
+            }
+            std::cerr << "Warning: Cannot create the session with " << provider_ << " (" << e.what() << "), using cpu" << std::endl;
+            provider_ = OnnxProviders::CPU;
+            session = _create_session(modelPath, cpu_options);
+        }
+    }
 
     // ----------------
     // init input names
-    inputNodeNames;
     std::vector<Ort::AllocatedStringPtr> inputNodeNameAllocatedStrings; // <-- newly added
     Ort::AllocatorWithDefaultOptions allocator;
     auto inputNodesNum = session.GetInputCount();
-    for (int i = 0; i < inputNodesNum; i++) {
+    for (size_t i = 0; i < inputNodesNum; i++) {
         auto input_name = session.GetInputNameAllocated(i, allocator);
         inputNodeNameAllocatedStrings.push_back(std::move(input_name));
         inputNodeNames.push_back(inputNodeNameAllocatedStrings.back().get());
@@ -72,11 +219,10 @@ OnnxModelBase::OnnxModelBase(const char* modelPath, const char* logid, const cha
 
     // -----------------
     // init output names
-    outputNodeNames;
     auto outputNodesNum = session.GetOutputCount();
     std::vector<Ort::AllocatedStringPtr> outputNodeNameAllocatedStrings; // <-- newly added
     Ort::AllocatorWithDefaultOptions output_names_allocator;
-    for (int i = 0; i < outputNodesNum; i++) {
+    for (size_t i = 0; i < outputNodesNum; i++) {
         auto output_name = session.GetOutputNameAllocated(i, output_names_allocator);
         outputNodeNameAllocatedStrings.push_back(std::move(output_name));
         outputNodeNames.push_back(outputNodeNameAllocatedStrings.back().get());
@@ -114,11 +260,89 @@ OnnxModelBase::OnnxModelBase(const char* modelPath, const char* logid, const cha
     }
 }
 
+OnnxModelBase::~OnnxModelBase() {
+    // an ORT format session may reference modelFile_ directly, so it has to go first
+    session = Ort::Session{ nullptr };
+}
+
+Ort::Session OnnxModelBase::_create_session(const std::string& path, const Ort::SessionOptions& baseOptions) {
+    MappedFile file;
+    if (sessionConfig_.memory_map_model) {
+        file = MappedFile(path);
+    }
+    bool ortFormat = file.isOpen() ? is_ort_format(file.data(), file.size()) : has_ort_extension(path);
+
+    Ort::SessionOptions options = baseOptions.Clone();
+    if (ortFormat) {
+        options.AddConfigEntry("session.load_model_format", "ORT");
+    }
+    if (!file.isOpen()) {
+        return Ort::Session(env, to_ort_path(path).c_str(), options);
+    }
+
+    if (ortFormat) {
+        // the session reads the graph and initializers straight from the mapped pages instead of copying them,
+        // which requires the mapping to outlive the session
+        options.AddConfigEntry("session.use_ort_model_bytes_directly", "1");
+        options.AddConfigEntry("session.use_ort_model_bytes_for_initializers", "1");
+        Ort::Session ortSession(env, file.data(), file.size(), options);
+        modelFile_ = std::move(file);
+        return ortSession;
+    }
+    // an onnx protobuf is parsed into the session's own graph, the mapping can be dropped right away
+    return Ort::Session(env, file.data(), file.size(), options);
+}
+
+std::string OnnxModelBase::_select_fastest_provider(const Ort::SessionOptions& baseOptions) {
+    static std::mutex cacheMutex;
+    static std::unordered_map<std::string, std::string> cache;
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto cached = cache.find(modelPath_);
+        if (cached != cache.end()) {
+            return cached->second;
+        }
+    }
+
+    const ExecutionProviderRegistry& registry = ExecutionProviderRegistry::instance();
+    std::string fastest = OnnxProviders::CPU;
+    double fastestSeconds = 0.0;
+    for (const ExecutionProvider* candidate : registry.available(true)) {
+        Ort::SessionOptions options = baseOptions.Clone();
+        if (!registry.attach(candidate->name, options, sessionConfig_)) {
+            continue;
+        }
+        try {
+            Ort::Session candidateSession = _create_session(modelPath_, options);
+            double seconds = measure_session_latency(candidateSession);
+#if DEBUG_INFO
+            std::cout << std::fixed << std::setprecision(1)
+                << "Execution provider " << candidate->name << ": " << seconds * 1000.0 << "ms calibration inference" << std::endl;
+#endif
+            if (fastestSeconds == 0.0 || seconds < fastestSeconds) {
+                fastest = candidate->name;
+                fastestSeconds = seconds;
+            }
+        }
+        catch (const Ort::Exception& e) {
+            std::cerr << "Warning: Skipping execution provider " << candidate->name << " (" << e.what() << ")" << std::endl;
+        }
+    }
+    // the calibration sessions may have mapped the model, the real session maps it again
+    modelFile_.close();
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cache.emplace(modelPath_, fastest);
+    return fastest;
+}
+
 const std::vector<std::string>& OnnxModelBase::getInputNames() { return inputNodeNames; }
 const std::vector<std::string>& OnnxModelBase::getOutputNames() { return outputNodeNames; }
 const Ort::ModelMetadata& OnnxModelBase::getModelMetadata() { return model_metadata; }
 const std::unordered_map<std::string, std::string>& OnnxModelBase::getMetadata() { return metadata; }
 const Ort::Session& OnnxModelBase::getSession() { return session; }
+const SessionConfig& OnnxModelBase::getSessionConfig() { return sessionConfig_; }
+const std::string& OnnxModelBase::getProvider() { return provider_; }
 const char* OnnxModelBase::getModelPath() { return modelPath_; }
 const std::vector<const char*> OnnxModelBase::getOutputNamesCStr() { return outputNamesCStr; }
 const std::vector<const char*> OnnxModelBase::getInputNamesCStr() { return inputNamesCStr; }
@@ -130,4 +354,14 @@ std::vector<Ort::Value> OnnxModelBase::forward(std::vector<Ort::Value>& inputTen
         inputNamesCStr.size(),
         outputNamesCStr.data(),
         outputNamesCStr.size());
+}
+
+void OnnxModelBase::forward(std::vector<Ort::Value>& inputTensors, std::vector<Ort::Value>& outputTensors) {
+    session.Run(Ort::RunOptions{ nullptr },
+        inputNamesCStr.data(),
+        inputTensors.data(),
+        inputTensors.size(),
+        outputNamesCStr.data(),
+        outputTensors.data(),
+        outputTensors.size());
 }
\ No newline at end of file
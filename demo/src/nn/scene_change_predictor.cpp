@@ -0,0 +1,51 @@
+#include "nn/scene_change_predictor.h"
+
+#include <chrono>
+
+#include "latency_histogram.h"
+#include "nn_utils.h"
+
+namespace {
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+SceneChangePredictor::SceneChangePredictor(AutoBackendOnnx& model, const SceneChangeOptions& options)
+    : model_(model), detector_(options) {
+}
+
+void SceneChangePredictor::reset() {
+    detector_.reset();
+    lastResults_.clear();
+    hasResults_ = false;
+}
+
+std::vector<YoloResults> SceneChangePredictor::predict_once(cv::Mat& image, float& conf, float& iou, float& mask_threshold, int conversionCode) {
+    // the stats are always collected, they are cheap and callers may report them (see also format_latency_report)
+    double detector_time = 0.0;
+    Timer detector_timer = Timer(detector_time, LatencyStage::SceneChange);
+    bool changed = detector_.hasChanged(image);
+    detector_timer.Stop();
+    stats_.detector_seconds += detector_time;
+    ++stats_.frames;
+
+    bool sameParams = conf == lastConf_ && iou == lastIou_ && conversionCode == lastConversionCode_;
+    if (!changed && hasResults_ && sameParams) {
+        ++stats_.skipped;
+        record_scene_change_skip();
+        return lastResults_;
+    }
+
+    auto inference_start = std::chrono::steady_clock::now();
+    lastResults_ = model_.predict_once(image, conf, iou, mask_threshold, conversionCode);
+    stats_.inference_seconds += seconds_since(inference_start);
+    detector_.accept();
+    hasResults_ = true;
+    lastConf_ = conf;
+    lastIou_ = iou;
+    lastConversionCode_ = conversionCode;
+    return lastResults_;
+}
@@ -0,0 +1,54 @@
+#include "nn/scheduled_frame_filter.h"
+
+#include "nn_utils.h"
+
+ScheduledFrameFilter::ScheduledFrameFilter(const std::string& model_path, const SessionConfig& session_config,
+    const std::string& provider, const SchedulerOptions& options)
+    : filter_(model_path, session_config, provider), options_(options), scheduler_(options) {
+}
+
+bool ScheduledFrameFilter::filter(FrameView& frame, double frame_seconds) {
+    // the worker reports its inference times back, the scheduler picks the frames (and the input size) the next
+    // inferences run on
+    bool infer;
+    {
+        std::lock_guard<std::mutex> lock(schedulerMutex_);
+        if (!inputSizeKnown_ && filter_.isModelLoaded()) {
+            // no inference was recorded yet, a model with a fixed input size never changes its scale
+            scheduler_.setOptions(fixed_size_if_static(options_, filter_.hasDynamicInputSize()));
+            inputSizeKnown_ = true;
+        }
+        double inference_seconds = 0.0;
+        if (filter_.takeInferenceSeconds(inference_seconds)) {
+            scheduler_.recordInference(inference_seconds);
+        }
+        infer = scheduler_.nextFrame(frame_seconds);
+        filter_.setInputScale(scheduler_.getInputScale());
+    }
+
+    double filter_seconds = 0.0;
+    Timer timer = Timer(filter_seconds, true);
+    filter_.filter(frame, infer);
+    timer.Stop();
+    if (!infer) {
+        std::lock_guard<std::mutex> lock(schedulerMutex_);
+        scheduler_.recordSkipped(filter_seconds);
+    }
+    return infer;
+}
+
+void ScheduledFrameFilter::setSchedulerOptions(const SchedulerOptions& options) {
+    std::lock_guard<std::mutex> lock(schedulerMutex_);
+    options_ = options;
+    scheduler_.setOptions(inputSizeKnown_ ? fixed_size_if_static(options_, filter_.hasDynamicInputSize()) : options_);
+}
+
+SchedulerOptions ScheduledFrameFilter::getSchedulerOptions() {
+    std::lock_guard<std::mutex> lock(schedulerMutex_);
+    return options_;
+}
+
+int ScheduledFrameFilter::getInterval() {
+    std::lock_guard<std::mutex> lock(schedulerMutex_);
+    return scheduler_.getInterval();
+}
@@ -0,0 +1,44 @@
+#include "nn/scheduled_predictor.h"
+
+#include <iomanip>
+#include <iostream>
+
+#include "constants.h"
+#include "nn_utils.h"
+
+ScheduledPredictor::ScheduledPredictor(AutoBackendOnnx& model, const SchedulerOptions& options, const TrackerOptions& tracker_options)
+    : model_(model), previousResolution_(model.getDynamicResolution()), scheduler_(fixed_size_if_static(options, model.hasDynamicInputSize())),
+    tracker_(tracker_options) {
+}
+
+ScheduledPredictor::~ScheduledPredictor() {
+    model_.setDynamicResolution(previousResolution_);
+}
+
+void ScheduledPredictor::reset() {
+    tracker_.reset();
+    scheduler_.reset();
+}
+
+std::vector<YoloResults> ScheduledPredictor::predict_once(cv::Mat& image, float& conf, float& iou, float& mask_threshold, int conversionCode, double frame_seconds) {
+    if (scheduler_.nextFrame(frame_seconds)) {
+        if (model_.hasDynamicInputSize()) {
+            model_.setDynamicResolution({ true, scheduler_.getInputScale() });
+        }
+        std::vector<YoloResults> detections = model_.predict_once(image, conf, iou, mask_threshold, conversionCode);
+        scheduler_.recordInference(model_.getLastStageTimes().total());
+#if DEBUG_INFO
+        std::cout << std::fixed << std::setprecision(1)
+            << "Scheduler: interval " << scheduler_.getInterval() << ", input " << model_.getWidth() << "x" << model_.getHeight()
+            << ", latency " << scheduler_.getLatency() * 1000.0 << "ms, cpu share " << scheduler_.getCpuShare() * 100.0 << "%" << std::endl;
+#endif
+        return tracker_.update(detections, image.size());
+    }
+
+    double tracking_time = 0.0;
+    Timer tracking_timer = Timer(tracking_time, LatencyStage::Tracking);
+    std::vector<YoloResults> results = tracker_.predict(image.size());
+    tracking_timer.Stop();
+    scheduler_.recordSkipped(tracking_time);
+    return results;
+}
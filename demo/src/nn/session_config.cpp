@@ -0,0 +1,199 @@
+#include "nn/session_config.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+namespace {
+
+std::string trim(const std::string& s) {
+    size_t begin = s.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(begin, end - begin + 1);
+}
+
+std::string normalize_key(std::string key) {
+    std::replace(key.begin(), key.end(), '-', '_');
+    return key;
+}
+
+std::string lowercase(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return s;
+}
+
+bool parse_bool(const std::string& value, bool& out) {
+    std::string v = lowercase(value);
+    if (v == "true" || v == "1" || v == "on" || v == "yes") {
+        out = true;
+        return true;
+    }
+    if (v == "false" || v == "0" || v == "off" || v == "no") {
+        out = false;
+        return true;
+    }
+    return false;
+}
+
+bool parse_threads(const std::string& value, int& out) {
+    try {
+        size_t consumed = 0;
+        int threads = std::stoi(value, &consumed);
+        if (consumed != value.size() || threads < 0) {
+            return false;
+        }
+        out = threads;
+        return true;
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+}
+
+const std::unordered_map<std::string, SessionOptimizationLevel> OPTIMIZATION_LEVELS = {
+    { "disable", SessionOptimizationLevel::Disable },
+    { "basic", SessionOptimizationLevel::Basic },
+    { "extended", SessionOptimizationLevel::Extended },
+    { "all", SessionOptimizationLevel::All },
+};
+
+const std::unordered_map<std::string, SessionExecutionMode> EXECUTION_MODES = {
+    { "sequential", SessionExecutionMode::Sequential },
+    { "parallel", SessionExecutionMode::Parallel },
+};
+
+template <typename Enum>
+bool parse_enum(const std::unordered_map<std::string, Enum>& names, const std::string& value, Enum& out) {
+    auto it = names.find(lowercase(value));
+    if (it == names.end()) {
+        return false;
+    }
+    out = it->second;
+    return true;
+}
+
+} // namespace
+
+bool set_session_config_value(SessionConfig& config, const std::string& raw_key, const std::string& raw_value) {
+    const std::string key = normalize_key(trim(raw_key));
+    const std::string value = trim(raw_value);
+    bool ok = false;
+
+    if (key == "graph_optimization_level") {
+        ok = parse_enum(OPTIMIZATION_LEVELS, value, config.optimization_level);
+    }
+    else if (key == "intra_op_threads") {
+        ok = parse_threads(value, config.intra_op_threads);
+    }
+    else if (key == "inter_op_threads") {
+        ok = parse_threads(value, config.inter_op_threads);
+    }
+    else if (key == "execution_mode") {
+        ok = parse_enum(EXECUTION_MODES, value, config.execution_mode);
+    }
+    else if (key == "mem_pattern") {
+        ok = parse_bool(value, config.mem_pattern);
+    }
+    else if (key == "cpu_mem_arena") {
+        ok = parse_bool(value, config.cpu_mem_arena);
+    }
+    else if (key == "memory_map_model") {
+        ok = parse_bool(value, config.memory_map_model);
+    }
+    else if (key == "allow_spinning") {
+        ok = parse_bool(value, config.allow_spinning);
+    }
+    else if (key == "optimized_model_path") {
+        config.optimized_model_path = value;
+        ok = true;
+    }
+    else {
+        std::cerr << "Warning: Unknown session option '" << raw_key << "'" << std::endl;
+        return false;
+    }
+
+    if (!ok) {
+        std::cerr << "Warning: Invalid value '" << raw_value << "' for session option '" << raw_key << "'" << std::endl;
+    }
+    return ok;
+}
+
+bool load_session_config(const std::string& path, SessionConfig& config) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Warning: Cannot open session config file " << path << std::endl;
+        return false;
+    }
+
+    bool ok = true;
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        ++line_number;
+        line = trim(line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        size_t separator = line.find('=');
+        if (separator == std::string::npos) {
+            std::cerr << "Warning: " << path << ":" << line_number << ": expected 'key = value'" << std::endl;
+            ok = false;
+            continue;
+        }
+        ok &= set_session_config_value(config, line.substr(0, separator), line.substr(separator + 1));
+    }
+    return ok;
+}
+
+bool parse_session_config_args(const std::vector<std::string>& args, SessionConfig& config, std::vector<std::string>& remaining) {
+    bool ok = true;
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        if (arg.rfind("--", 0) != 0) {
+            remaining.push_back(arg);
+            continue;
+        }
+
+        std::string key = arg.substr(2);
+        std::string value;
+        size_t separator = key.find('=');
+        if (separator != std::string::npos) {
+            value = key.substr(separator + 1);
+            key = key.substr(0, separator);
+        }
+        else if (i + 1 < args.size()) {
+            value = args[++i];
+        }
+        else {
+            std::cerr << "Warning: Missing value for " << arg << std::endl;
+            ok = false;
+            continue;
+        }
+
+        if (normalize_key(key) == "session_config") {
+            ok &= load_session_config(value, config);
+        }
+        else {
+            ok &= set_session_config_value(config, key, value);
+        }
+    }
+    return ok;
+}
+
+std::string optimization_level_name(SessionOptimizationLevel level) {
+    for (const auto& [name, value] : OPTIMIZATION_LEVELS) {
+        if (value == level) {
+            return name;
+        }
+    }
+    return "all";
+}
+
+std::string execution_mode_name(SessionExecutionMode mode) {
+    return mode == SessionExecutionMode::Parallel ? "parallel" : "sequential";
+}
@@ -0,0 +1,33 @@
+#include "nn/tracking_predictor.h"
+
+#include <algorithm>
+
+#include "nn_utils.h"
+
+TrackingPredictor::TrackingPredictor(AutoBackendOnnx& model, int inference_interval, const TrackerOptions& options)
+    : model_(model), tracker_(options), inferenceInterval_(std::max(inference_interval, 1)) {
+}
+
+void TrackingPredictor::setInferenceInterval(int inference_interval) {
+    inferenceInterval_ = std::max(inference_interval, 1);
+}
+
+void TrackingPredictor::reset() {
+    tracker_.reset();
+    frameIndex_ = 0;
+}
+
+std::vector<YoloResults> TrackingPredictor::predict_once(cv::Mat& image, float& conf, float& iou, float& mask_threshold, int conversionCode) {
+    const bool keyframe = frameIndex_ % inferenceInterval_ == 0;
+    ++frameIndex_;
+    if (keyframe) {
+        std::vector<YoloResults> detections = model_.predict_once(image, conf, iou, mask_threshold, conversionCode);
+        return tracker_.update(detections, image.size());
+    }
+
+    double tracking_time = 0.0;
+    Timer tracking_timer = Timer(tracking_time, LatencyStage::Tracking);
+    std::vector<YoloResults> results = tracker_.predict(image.size());
+    tracking_timer.Stop();
+    return results;
+}
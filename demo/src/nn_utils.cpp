@@ -1,21 +1,25 @@
 #define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
 
-#include <opencv2/opencv.hpp>
 #include <opencv2/core.hpp>
 #include <opencv2/core/mat.hpp>
 #include <opencv2/core/types.hpp>
 #include <opencv2/imgproc.hpp>
 
 #include <stdio.h>
+#include <cctype>
+#include <cmath>
 #include <vector>
 #include <string>
 #include <sstream>
 #include <iostream>
-#include <regex>
+#include <iomanip>
 #include <onnxruntime_c_api.h>
 
 #include "constants.h"
 #include "nn_utils.h"
+#include "nms.h"
+#include "postprocess.h"
+#include "preprocess.h"
 
 /*
    ----------------------------
@@ -33,8 +37,8 @@ void clip_boxes(cv::Rect& box, const cv::Size& shape) {
 void clip_boxes(cv::Rect_<float>& box, const cv::Size& shape) {
     box.x = std::max(0.0f, std::min(box.x, static_cast<float>(shape.width)));
     box.y = std::max(0.0f, std::min(box.y, static_cast<float>(shape.height)));
-    box.width = std::max(0.0f, std::min(box.width, static_cast<float>(shape.width - box.x)));
-    box.height = std::max(0.0f, std::min(box.height, static_cast<float>(shape.height - box.y)));
+    box.width = std::max(0.0f, std::min(box.width, static_cast<float>(shape.width) - box.x));
+    box.height = std::max(0.0f, std::min(box.height, static_cast<float>(shape.height) - box.y));
 }
 
 void clip_boxes(std::vector<cv::Rect>& boxes, const cv::Size& shape) {
@@ -56,8 +60,8 @@ cv::Rect_<float> scale_boxes(const cv::Size& img1_shape, cv::Rect_<float>& box,
     if (ratio_pad.first < 0.0f) {
         gain = std::min(static_cast<float>(img1_shape.height) / static_cast<float>(img0_shape.height),
             static_cast<float>(img1_shape.width) / static_cast<float>(img0_shape.width));
-        pad_x = roundf((img1_shape.width - img0_shape.width * gain) / 2.0f - 0.1f);
-        pad_y = roundf((img1_shape.height - img0_shape.height * gain) / 2.0f - 0.1f);
+        pad_x = roundf((static_cast<float>(img1_shape.width) - static_cast<float>(img0_shape.width) * gain) / 2.0f - 0.1f);
+        pad_y = roundf((static_cast<float>(img1_shape.height) - static_cast<float>(img0_shape.height) * gain) / 2.0f - 0.1f);
     }
     else {
         gain = ratio_pad.first;
@@ -85,7 +89,7 @@ cv::Rect_<float> scale_boxes(const cv::Size& img1_shape, cv::Rect_<float>& box,
 
 // Assuming coords are of shape [1, 17, 3]
 void clip_coords(std::vector<float>& coords, const cv::Size& shape) {
-    for (int i = 0; i < coords.size(); i += 3) {
+    for (size_t i = 0; i < coords.size(); i += 3) {
         coords[i] = std::min(std::max(coords[i], 0.0f), static_cast<float>(shape.width - 1));  // x
         coords[i + 1] = std::min(std::max(coords[i + 1], 0.0f), static_cast<float>(shape.height - 1));  // y
     }
@@ -101,15 +105,15 @@ std::vector<float> scale_coords(const cv::Size& img1_shape, std::vector<float>&
     cv::Point2d pad((img1_shape.width - img0_shape.width * gain) / 2, (img1_shape.height - img0_shape.height * gain) / 2);
 
     // Apply padding. Assuming coords are of shape [1, 17, 3]
-    for (int i = 0; i < scaledCoords.size(); i += 3) {
-        scaledCoords[i] -= pad.x;  // x padding
-        scaledCoords[i + 1] -= pad.y;  // y padding
+    for (size_t i = 0; i < scaledCoords.size(); i += 3) {
+        scaledCoords[i] -= static_cast<float>(pad.x);  // x padding
+        scaledCoords[i + 1] -= static_cast<float>(pad.y);  // y padding
     }
 
     // Scale coordinates. Assuming coords are of shape [1, 17, 3]
-    for (int i = 0; i < scaledCoords.size(); i += 3) {
-        scaledCoords[i] /= gain;
-        scaledCoords[i + 1] /= gain;
+    for (size_t i = 0; i < scaledCoords.size(); i += 3) {
+        scaledCoords[i] /= static_cast<float>(gain);
+        scaledCoords[i + 1] /= static_cast<float>(gain);
     }
 
     clip_coords(scaledCoords, img0_shape);
@@ -143,55 +147,51 @@ std::tuple<std::vector<cv::Rect>, std::vector<float>, std::vector<int>, std::vec
 non_max_suppression(const cv::Mat& output0, int class_names_num, int data_width, double conf_threshold,
     float iou_threshold) {
 
-    std::vector<int> class_ids;
-    std::vector<float> confidences;
-    std::vector<cv::Rect> boxes;
-    std::vector<std::vector<float>> rest;
+    DetectionCandidates candidates;
+    std::vector<int> anchors;
 
     int rest_start_pos = class_names_num + 4;
     int rest_features = data_width - rest_start_pos;
 
     int rows = output0.rows;
-    float* pdata = (float*)output0.data;
+    const float* pdata = output0.ptr<float>();
 
     for (int r = 0; r < rows; ++r) {
-        cv::Mat scores(1, class_names_num, CV_32FC1, pdata + 4);
-        cv::Point class_id;
-        double max_conf;
-        minMaxLoc(scores, nullptr, &max_conf, nullptr, &class_id);
+        const float* scores = pdata + 4;
+        int class_id = static_cast<int>(std::max_element(scores, scores + class_names_num) - scores);
+        float max_conf = scores[class_id];
 
         if (max_conf > conf_threshold) {
-            std::vector<float> mask_data(pdata + 4 + class_names_num, pdata + data_width);
-            class_ids.push_back(class_id.x);
-            confidences.push_back((float)max_conf);
-
             float out_w = pdata[2];
             float out_h = pdata[3];
-            float out_left = MAX((pdata[0] - 0.5 * out_w + 0.5), 0);
-            float out_top = MAX((pdata[1] - 0.5 * out_h + 0.5), 0);
-            cv::Rect_<float> bbox(out_left, out_top, (out_w + 0.5), (out_h + 0.5));
-            boxes.push_back(bbox);
-            if (rest_features > 0) {
-                std::vector<float> rest_data(pdata + rest_start_pos, pdata + data_width);
-                rest.push_back(rest_data);
-            }
+            float out_left = MAX((pdata[0] - 0.5f * out_w + 0.5f), 0.0f);
+            float out_top = MAX((pdata[1] - 0.5f * out_h + 0.5f), 0.0f);
+            candidates.push_back(out_left, out_top, (out_w + 0.5f), (out_h + 0.5f), max_conf, class_id);
+            anchors.push_back(r);
         }
         pdata += data_width; // next prediction
     }
 
+    NmsOptions options;
+    options.iou_threshold = iou_threshold;
+    NmsScratch scratch;
     std::vector<int> nms_result;
-    cv::dnn::NMSBoxes(boxes, confidences, conf_threshold, iou_threshold, nms_result);
+    nms_boxes(candidates, options, nms_result, scratch);
+
     std::vector<int> nms_class_ids;
     std::vector<float> nms_confidences;
-    std::vector<cv::Rect> nms_boxes;
+    std::vector<cv::Rect> nms_rects;
     std::vector<std::vector<float>> nms_rest;
     for (int idx : nms_result) {
-        nms_class_ids.push_back(class_ids[idx]);
-        nms_confidences.push_back(confidences[idx]);
-        nms_boxes.push_back(boxes[idx]);
-        nms_rest.push_back(rest[idx]);
+        nms_class_ids.push_back(candidates.class_id[idx]);
+        nms_confidences.push_back(candidates.score[idx]);
+        nms_rects.emplace_back(cv::Rect_<float>(candidates.x[idx], candidates.y[idx], candidates.w[idx], candidates.h[idx]));
+        if (rest_features > 0) {
+            const float* row = output0.ptr<float>(anchors[idx]);
+            nms_rest.emplace_back(row + rest_start_pos, row + data_width);
+        }
     }
-    return std::make_tuple(nms_boxes, nms_confidences, nms_class_ids, nms_rest);
+    return std::make_tuple(nms_rects, nms_confidences, nms_class_ids, nms_rest);
 }
 
 void letterbox(
@@ -204,49 +204,16 @@ void letterbox(
     int stride
 ) {
     cv::Size shape = image.size();
-    float r = std::min(
-        static_cast<float>(newShape.height) / static_cast<float>(shape.height),
-        static_cast<float>(newShape.width) / static_cast<float>(shape.width)
-    );
-    if (!scaleUp) {
-        r = std::min(r, 1.0f);
-    }
-
-    float ratio[2]{ r, r };
-    int newUnpad[2]{ static_cast<int>(std::round(static_cast<float>(shape.width) * r)),
-                     static_cast<int>(std::round(static_cast<float>(shape.height) * r)) };
+    LetterboxGeometry geometry = letterbox_geometry(shape, newShape, auto_, scaleFill, scaleUp, stride);
 
-    auto dw = static_cast<float>(newShape.width - newUnpad[0]);
-    auto dh = static_cast<float>(newShape.height - newUnpad[1]);
-    if (auto_) {
-        dw = static_cast<float>((static_cast<int>(dw) % stride));
-        dh = static_cast<float>((static_cast<int>(dh) % stride));
-    }
-    else if (scaleFill) {
-        dw = 0.0f;
-        dh = 0.0f;
-        newUnpad[0] = newShape.width;
-        newUnpad[1] = newShape.height;
-        ratio[0] = static_cast<float>(newShape.width) / static_cast<float>(shape.width);
-        ratio[1] = static_cast<float>(newShape.height) / static_cast<float>(shape.height);
-    }
-
-    dw /= 2.0f;
-    dh /= 2.0f;
-
-    if (shape.width != newUnpad[0] || shape.height != newUnpad[1]) {
-        cv::resize(image, outImage, cv::Size(newUnpad[0], newUnpad[1]));
+    if (shape != geometry.newUnpad) {
+        cv::resize(image, outImage, geometry.newUnpad);
     }
     else {
         outImage = image.clone();
     }
 
-    int top = static_cast<int>(std::round(dh - 0.1f));
-    int bottom = static_cast<int>(std::round(dh + 0.1f));
-    int left = static_cast<int>(std::round(dw - 0.1f));
-    int right = static_cast<int>(std::round(dw + 0.1f));
-
-    cv::copyMakeBorder(outImage, outImage, top, bottom, left, right, cv::BORDER_CONSTANT, Utils::LETTERBOX_COLOR);
+    cv::copyMakeBorder(outImage, outImage, geometry.top, geometry.bottom, geometry.left, geometry.right, cv::BORDER_CONSTANT, Utils::LETTERBOX_COLOR);
 }
 
 void plot_results_with_classifications(cv::Mat img, std::vector<YoloResults>& results, std::unordered_map<int, std::string>& names, bool censor) {
@@ -279,10 +246,10 @@ void plot_results_with_classifications(cv::Mat img, std::vector<YoloResults>& re
         std::string label = labelStream.str();
 
         cv::Size text_size = cv::getTextSize(label, cv::FONT_HERSHEY_SIMPLEX, 0.6, 2, nullptr);
-        cv::Rect rect_to_fill(left - 1, top - text_size.height - 5, text_size.width + 2, text_size.height + 5);
+        cv::Rect rect_to_fill(static_cast<int>(left - 1), static_cast<int>(top - static_cast<float>(text_size.height) - 5), text_size.width + 2, text_size.height + 5);
         cv::Scalar text_color = cv::Scalar(255.0, 255.0, 255.0);
         rectangle(img, rect_to_fill, Utils::COLOR_RED, -1);
-        putText(img, label, cv::Point(left - 1.5, top - 2.5), cv::FONT_HERSHEY_SIMPLEX, 0.6, text_color, 2);
+        putText(img, label, cv::Point(static_cast<int>(left - 1.5), static_cast<int>(top - 2.5)), cv::FONT_HERSHEY_SIMPLEX, 0.6, text_color, 2);
     }
 }
 
@@ -292,13 +259,33 @@ void plot_results_fast(cv::Mat img, std::vector<YoloResults>& results) {
     }
 }
 
+void plot_results_censored(cv::Mat img, std::vector<YoloResults>& results, const CensorOptions& options, CensorScratch& scratch) {
+    for (const auto& result : results) {
+        // round outwards, a partially covered pixel is censored too
+        int left = static_cast<int>(std::floor(result.bbox.x));
+        int top = static_cast<int>(std::floor(result.bbox.y));
+        int right = static_cast<int>(std::ceil(result.bbox.x + result.bbox.width));
+        int bottom = static_cast<int>(std::ceil(result.bbox.y + result.bbox.height));
+        censor_region(img, cv::Rect(left, top, right - left, bottom - top), options, scratch);
+    }
+}
+
+void plot_results_censored(YuvPlanes& frame, std::vector<YoloResults>& results, const CensorOptions& options, CensorScratch& scratch) {
+    for (const auto& result : results) {
+        int left = static_cast<int>(std::floor(result.bbox.x));
+        int top = static_cast<int>(std::floor(result.bbox.y));
+        int right = static_cast<int>(std::ceil(result.bbox.x + result.bbox.width));
+        int bottom = static_cast<int>(std::ceil(result.bbox.y + result.bbox.height));
+        censor_yuv_region(frame, cv::Rect(left, top, right - left, bottom - top), options, scratch);
+    }
+}
+
 /*
    ----------------------------
    ----- HELPER FUNCTIONS -----
    ----------------------------
 */
 
-#if TIMING_INFO
 Timer::Timer(double& accumulator, bool isEnabled)
     : accumulator(accumulator), isEnabled(isEnabled) {
     if (isEnabled) {
@@ -306,51 +293,93 @@ Timer::Timer(double& accumulator, bool isEnabled)
     }
 }
 
+Timer::Timer(double& accumulator, LatencyStage stage)
+    : accumulator(accumulator), isEnabled(true), stage(stage) {
+    start = std::chrono::high_resolution_clock::now();
+}
+
 void Timer::Stop() {
     if (isEnabled) {
         auto end = std::chrono::high_resolution_clock::now();
         double duration = std::chrono::duration<double>(end - start).count();
         accumulator += duration;
+        if (stage != LatencyStage::Count && latency_metrics_enabled()) {
+            latency_histogram(stage).record(duration);
+        }
     }
 }
-#endif
 
 std::vector<int> parse_imgsz_from_metadata(const std::string& input) {
-    std::regex number_pattern(R"(\d+)");
-    std::vector<std::string> strings;
-    std::sregex_iterator it(input.begin(), input.end(), number_pattern);
-    std::sregex_iterator end;
-
-    while (it != end) {
-        strings.push_back(it->str());
-        ++it;
-    }
-
     std::vector<int> result;
-    for (const std::string& str : strings) {
-        int value = std::stoi(str);
+    int value = 0;
+    bool in_number = false;
+    for (char c : input) {
+        if (c >= '0' && c <= '9') {
+            value = value * 10 + (c - '0');
+            in_number = true;
+        }
+        else if (in_number) {
+            result.push_back(value);
+            value = 0;
+            in_number = false;
+        }
+    }
+    if (in_number) {
         result.push_back(value);
     }
-
     return result;
 }
 
 std::unordered_map<int, std::string> parse_names_from_metadata(const std::string& input) {
     std::unordered_map<int, std::string> result;
+    const size_t n = input.size();
+    size_t i = 0;
+    auto skip_spaces = [&]() {
+        while (i < n && std::isspace(static_cast<unsigned char>(input[i]))) {
+            ++i;
+        }
+    };
 
-    std::string cleanedInput = input;
-    cleanedInput.erase(std::remove(cleanedInput.begin(), cleanedInput.end(), '{'), cleanedInput.end());
-    cleanedInput.erase(std::remove(cleanedInput.begin(), cleanedInput.end(), '}'), cleanedInput.end());
-
-    std::istringstream elementStream(cleanedInput);
-    std::string element;
-    while (std::getline(elementStream, element, ',')) {
-        std::istringstream keyValueStream(element);
-        std::string keyStr, value;
-        if (std::getline(keyValueStream, keyStr, ':') && std::getline(keyValueStream, value)) {
-            int key = std::stoi(keyStr);
-            result[key] = value;
+    while (i < n) {
+        // key
+        while (i < n && !(input[i] >= '0' && input[i] <= '9')) {
+            ++i;
+        }
+        if (i == n) {
+            break;
+        }
+        int key = 0;
+        while (i < n && input[i] >= '0' && input[i] <= '9') {
+            key = key * 10 + (input[i] - '0');
+            ++i;
+        }
+        skip_spaces();
+        if (i == n || input[i] != ':') {
+            continue;
+        }
+        ++i;
+        skip_spaces();
+
+        // value, either quoted ('...' or "...", may contain commas) or bare up to the next ',' / '}'
+        std::string value;
+        if (i < n && (input[i] == '\'' || input[i] == '"')) {
+            const char quote = input[i++];
+            size_t close = input.find(quote, i);
+            if (close == std::string::npos) {
+                close = n;
+            }
+            value = input.substr(i, close - i);
+            i = close + 1;
+        }
+        else {
+            size_t begin = i;
+            while (i < n && input[i] != ',' && input[i] != '}') {
+                ++i;
+            }
+            size_t last = input.find_last_not_of(" \t", i - 1);
+            value = (last == std::string::npos || last < begin) ? std::string() : input.substr(begin, last - begin + 1);
         }
+        result[key] = value;
     }
 
     return result;
@@ -362,4 +391,28 @@ int64_t vector_product(const std::vector<int64_t>& vec) {
         result *= value;
     }
     return result;
-}
\ No newline at end of file
+}
+
+std::string json_escape(const std::string& value) {
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (char c : value) {
+        switch (c) {
+        case '"': escaped += "\\\""; break;
+        case '\\': escaped += "\\\\"; break;
+        case '\n': escaped += "\\n"; break;
+        case '\r': escaped += "\\r"; break;
+        case '\t': escaped += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char code[7];
+                snprintf(code, sizeof(code), "\\u%04x", c);
+                escaped += code;
+            }
+            else {
+                escaped += c;
+            }
+        }
+    }
+    return escaped;
+}
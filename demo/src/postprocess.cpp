@@ -0,0 +1,115 @@
+#include "postprocess.h"
+
+#include <algorithm>
+
+#include "simd.h"
+
+void DetectionCandidates::push_back(float left, float top, float width, float height, float conf, int cls) {
+    if (count == x.size()) {
+        size_t capacity = std::max<size_t>(64, count * 2);
+        x.resize(capacity);
+        y.resize(capacity);
+        w.resize(capacity);
+        h.resize(capacity);
+        score.resize(capacity);
+        class_id.resize(capacity);
+    }
+    x[count] = left;
+    y[count] = top;
+    w[count] = width;
+    h[count] = height;
+    score[count] = conf;
+    class_id[count] = cls;
+    ++count;
+}
+
+namespace {
+
+inline void emit_candidate(const float* output0, int num_anchors, int anchor, float conf, int cls, DetectionCandidates& candidates) {
+    float out_w = output0[2 * num_anchors + anchor];
+    float out_h = output0[3 * num_anchors + anchor];
+    float out_left = std::max(output0[anchor] - 0.5f * out_w + 0.5f, 0.0f);
+    float out_top = std::max(output0[num_anchors + anchor] - 0.5f * out_h + 0.5f, 0.0f);
+    candidates.push_back(out_left, out_top, out_w + 0.5f, out_h + 0.5f, conf, cls);
+}
+
+} // namespace
+
+size_t decode_detections(const float* output0, int num_anchors, int num_classes, float conf_threshold,
+    DetectionCandidates& candidates) {
+    candidates.clear();
+    if (num_classes <= 0) {
+        return 0;
+    }
+    const float* scores = output0 + 4 * static_cast<size_t>(num_anchors);
+    int a = 0;
+
+#if NUDENET_AVX2
+    const __m256 threshold8 = _mm256_set1_ps(conf_threshold);
+    for (; a + 8 <= num_anchors; a += 8) {
+        __m256 best = _mm256_loadu_ps(scores + a);
+        __m256 best_cls = _mm256_setzero_ps();
+        for (int c = 1; c < num_classes; ++c) {
+            __m256 v = _mm256_loadu_ps(scores + static_cast<size_t>(c) * num_anchors + a);
+            __m256 greater = _mm256_cmp_ps(v, best, _CMP_GT_OQ);  // strict, so the first max wins like minMaxLoc
+            best = _mm256_blendv_ps(best, v, greater);
+            best_cls = _mm256_blendv_ps(best_cls, _mm256_set1_ps(static_cast<float>(c)), greater);
+        }
+        int keep = _mm256_movemask_ps(_mm256_cmp_ps(best, threshold8, _CMP_GT_OQ));
+        if (keep == 0) {
+            continue;
+        }
+        alignas(32) float best_arr[8];
+        alignas(32) float cls_arr[8];
+        _mm256_store_ps(best_arr, best);
+        _mm256_store_ps(cls_arr, best_cls);
+        for (int k = 0; k < 8; ++k) {
+            if (keep & (1 << k)) {
+                emit_candidate(output0, num_anchors, a + k, best_arr[k], static_cast<int>(cls_arr[k]), candidates);
+            }
+        }
+    }
+#endif
+#if NUDENET_SSE2
+    const __m128 threshold4 = _mm_set1_ps(conf_threshold);
+    for (; a + 4 <= num_anchors; a += 4) {
+        __m128 best = _mm_loadu_ps(scores + a);
+        __m128 best_cls = _mm_setzero_ps();
+        for (int c = 1; c < num_classes; ++c) {
+            __m128 v = _mm_loadu_ps(scores + static_cast<size_t>(c) * num_anchors + a);
+            __m128 greater = _mm_cmpgt_ps(v, best);
+            best = _mm_or_ps(_mm_and_ps(greater, v), _mm_andnot_ps(greater, best));
+            best_cls = _mm_or_ps(_mm_and_ps(greater, _mm_set1_ps(static_cast<float>(c))), _mm_andnot_ps(greater, best_cls));
+        }
+        int keep = _mm_movemask_ps(_mm_cmpgt_ps(best, threshold4));
+        if (keep == 0) {
+            continue;
+        }
+        alignas(16) float best_arr[4];
+        alignas(16) float cls_arr[4];
+        _mm_store_ps(best_arr, best);
+        _mm_store_ps(cls_arr, best_cls);
+        for (int k = 0; k < 4; ++k) {
+            if (keep & (1 << k)) {
+                emit_candidate(output0, num_anchors, a + k, best_arr[k], static_cast<int>(cls_arr[k]), candidates);
+            }
+        }
+    }
+#endif
+
+    for (; a < num_anchors; ++a) {
+        float best = scores[a];
+        int best_cls = 0;
+        for (int c = 1; c < num_classes; ++c) {
+            float v = scores[static_cast<size_t>(c) * num_anchors + a];
+            if (v > best) {
+                best = v;
+                best_cls = c;
+            }
+        }
+        if (best > conf_threshold) {
+            emit_candidate(output0, num_anchors, a, best, best_cls, candidates);
+        }
+    }
+    return candidates.size();
+}
@@ -0,0 +1,466 @@
+#include "preprocess.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <opencv2/core.hpp>
+
+#include "constants.h"
+#include "simd.h"
+
+namespace {
+
+void fill_floats(float* dst, int n, float value) {
+    int x = 0;
+#if NUDENET_AVX2
+    __m256 v8 = _mm256_set1_ps(value);
+    for (; x + 8 <= n; x += 8) {
+        _mm256_storeu_ps(dst + x, v8);
+    }
+#endif
+#if NUDENET_SSE2
+    __m128 v4 = _mm_set1_ps(value);
+    for (; x + 4 <= n; x += 4) {
+        _mm_storeu_ps(dst + x, v4);
+    }
+#endif
+    for (; x < n; ++x) {
+        dst[x] = value;
+    }
+}
+
+// dst = h0 * w0 + h1 * w1, the normalization scale is already folded into the weights
+void blend_rows(const float* h0, const float* h1, float w0, float w1, float* dst, int n) {
+    int x = 0;
+#if NUDENET_AVX2
+    __m256 vw0 = _mm256_set1_ps(w0);
+    __m256 vw1 = _mm256_set1_ps(w1);
+    for (; x + 8 <= n; x += 8) {
+        __m256 a = _mm256_mul_ps(_mm256_loadu_ps(h0 + x), vw0);
+        __m256 b = _mm256_mul_ps(_mm256_loadu_ps(h1 + x), vw1);
+        _mm256_storeu_ps(dst + x, _mm256_add_ps(a, b));
+    }
+#endif
+#if NUDENET_SSE2
+    __m128 vw0s = _mm_set1_ps(w0);
+    __m128 vw1s = _mm_set1_ps(w1);
+    for (; x + 4 <= n; x += 4) {
+        __m128 a = _mm_mul_ps(_mm_loadu_ps(h0 + x), vw0s);
+        __m128 b = _mm_mul_ps(_mm_loadu_ps(h1 + x), vw1s);
+        _mm_storeu_ps(dst + x, _mm_add_ps(a, b));
+    }
+#endif
+    for (; x < n; ++x) {
+        dst[x] = h0[x] * w0 + h1[x] * w1;
+    }
+}
+
+// Horizontally resamples one source row into (up to) 3 planar float rows
+void resample_row(const uint8_t* src, int cn, const PreprocessScratch& scratch, int width, float* out) {
+    const int* xofs0 = scratch.xofs0.data();
+    const int* xofs1 = scratch.xofs1.data();
+    const float* xweight = scratch.xweight.data();
+    float* out0 = out;
+    float* out1 = out + width;
+    float* out2 = out + 2 * width;
+
+    if (cn == 1) {
+        for (int x = 0; x < width; ++x) {
+            float a = src[xofs0[x]];
+            float b = src[xofs1[x]];
+            out0[x] = a + (b - a) * xweight[x];
+        }
+        std::copy(out0, out0 + width, out1);
+        std::copy(out0, out0 + width, out2);
+        return;
+    }
+
+    for (int x = 0; x < width; ++x) {
+        const uint8_t* p0 = src + xofs0[x];
+        const uint8_t* p1 = src + xofs1[x];
+        float w = xweight[x];
+        out0[x] = p0[0] + (static_cast<float>(p1[0]) - p0[0]) * w;
+        out1[x] = p0[1] + (static_cast<float>(p1[1]) - p0[1]) * w;
+        out2[x] = p0[2] + (static_cast<float>(p1[2]) - p0[2]) * w;
+    }
+}
+
+// Same source coordinate mapping as cv::resize with cv::INTER_LINEAR
+inline void source_coord(int d, double inv_scale, int src_len, int& i0, int& i1, float& frac) {
+    double s = (d + 0.5) * inv_scale - 0.5;
+    int i = static_cast<int>(std::floor(s));
+    float f = static_cast<float>(s - i);
+    if (i < 0) {
+        i = 0;
+        f = 0.0f;
+    }
+    if (i >= src_len - 1) {
+        i = src_len - 1;
+        f = 0.0f;
+    }
+    i0 = i;
+    i1 = std::min(i + 1, src_len - 1);
+    frac = f;
+}
+
+// Points rows[0]/rows[1] at the resampled source rows y0/y1. Neighbouring output rows mostly share source rows,
+// so each source row is only resampled once
+template <typename Resample>
+void update_row_cache(int y0, int y1, int cached[2], float* rows[2], Resample&& resample) {
+    if (cached[0] != y0) {
+        if (cached[1] == y0) {
+            std::swap(rows[0], rows[1]);
+            std::swap(cached[0], cached[1]);
+        }
+        else {
+            resample(y0, rows[0]);
+            cached[0] = y0;
+        }
+    }
+    if (cached[1] != y1) {
+        resample(y1, rows[1]);
+        cached[1] = y1;
+    }
+}
+
+// Where the samples of one YUV channel are: row y starts at data + y * stride, sample x is `step` bytes after x - 1
+struct YuvChannel {
+    const uint8_t* data = nullptr;
+    int stride = 0;
+    int step = 1;
+    int width = 0;
+    int height = 0;
+};
+
+void yuv_channels(const YuvImage& image, YuvChannel& y, YuvChannel& u, YuvChannel& v) {
+    const int chroma_width = image.width / 2;
+    switch (image.layout) {
+    case YuvLayout::NV12:
+        y = { image.data[0], image.stride[0], 1, image.width, image.height };
+        u = { image.data[1], image.stride[1], 2, chroma_width, image.height / 2 };
+        v = { image.data[1] + 1, image.stride[1], 2, chroma_width, image.height / 2 };
+        break;
+    case YuvLayout::I420:
+        y = { image.data[0], image.stride[0], 1, image.width, image.height };
+        u = { image.data[1], image.stride[1], 1, chroma_width, image.height / 2 };
+        v = { image.data[2], image.stride[2], 1, chroma_width, image.height / 2 };
+        break;
+    case YuvLayout::YUY2:
+        y = { image.data[0], image.stride[0], 2, image.width, image.height };
+        u = { image.data[0] + 1, image.stride[0], 4, chroma_width, image.height };
+        v = { image.data[0] + 3, image.stride[0], 4, chroma_width, image.height };
+        break;
+    }
+}
+
+// Bilinear column lookup tables (byte offsets) of a channel resampled to `width` output columns
+void channel_tables(const YuvChannel& channel, int width, std::vector<int>& ofs0, std::vector<int>& ofs1, std::vector<float>& weight) {
+    ofs0.resize(width);
+    ofs1.resize(width);
+    weight.resize(width);
+    const double inv_scale = static_cast<double>(channel.width) / width;
+    for (int dx = 0; dx < width; ++dx) {
+        int x0, x1;
+        source_coord(dx, inv_scale, channel.width, x0, x1, weight[dx]);
+        ofs0[dx] = x0 * channel.step;
+        ofs1[dx] = x1 * channel.step;
+    }
+}
+
+void resample_channel_row(const uint8_t* src, const int* ofs0, const int* ofs1, const float* weight, int width, float* out) {
+    for (int x = 0; x < width; ++x) {
+        float a = src[ofs0[x]];
+        float b = src[ofs1[x]];
+        out[x] = a + (b - a) * weight[x];
+    }
+}
+
+// YUV -> RGB factors with the range expansion and the normalization scale folded in
+struct YuvToRgb {
+    float y = 1.0f;
+    float y_offset = 0.0f;
+    float rv = 0.0f;
+    float gu = 0.0f;
+    float gv = 0.0f;
+    float bu = 0.0f;
+    float max_value = 1.0f;
+};
+
+YuvToRgb yuv_to_rgb_factors(YuvMatrix matrix, bool full_range, float scale) {
+    const float kr = matrix == YuvMatrix::BT709 ? 0.2126f : 0.299f;
+    const float kb = matrix == YuvMatrix::BT709 ? 0.0722f : 0.114f;
+    const float kg = 1.0f - kr - kb;
+    const float luma_range = full_range ? 1.0f : 255.0f / 219.0f;
+    const float chroma_range = full_range ? 1.0f : 255.0f / 224.0f;
+    YuvToRgb factors;
+    factors.y = luma_range * scale;
+    factors.y_offset = full_range ? 0.0f : 16.0f;
+    factors.rv = 2.0f * (1.0f - kr) * chroma_range * scale;
+    factors.gu = 2.0f * kb * (1.0f - kb) / kg * chroma_range * scale;
+    factors.gv = 2.0f * kr * (1.0f - kr) / kg * chroma_range * scale;
+    factors.bu = 2.0f * (1.0f - kb) * chroma_range * scale;
+    factors.max_value = 255.0f * scale;
+    return factors;
+}
+
+// Converts one row of resampled Y, U and V into the R, G and B planes, clamped like an 8-bit conversion would
+void yuv_row_to_rgb(const float* y, const float* u, const float* v, const YuvToRgb& f, float* r, float* g, float* b, int n) {
+    int x = 0;
+#if NUDENET_AVX2
+    const __m256 y8 = _mm256_set1_ps(f.y), yoff8 = _mm256_set1_ps(f.y_offset), half8 = _mm256_set1_ps(128.0f);
+    const __m256 rv8 = _mm256_set1_ps(f.rv), gu8 = _mm256_set1_ps(f.gu), gv8 = _mm256_set1_ps(f.gv), bu8 = _mm256_set1_ps(f.bu);
+    const __m256 zero8 = _mm256_setzero_ps(), max8 = _mm256_set1_ps(f.max_value);
+    for (; x + 8 <= n; x += 8) {
+        __m256 luma = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(y + x), yoff8), y8);
+        __m256 du = _mm256_sub_ps(_mm256_loadu_ps(u + x), half8);
+        __m256 dv = _mm256_sub_ps(_mm256_loadu_ps(v + x), half8);
+        __m256 red = _mm256_add_ps(luma, _mm256_mul_ps(dv, rv8));
+        __m256 green = _mm256_sub_ps(luma, _mm256_add_ps(_mm256_mul_ps(du, gu8), _mm256_mul_ps(dv, gv8)));
+        __m256 blue = _mm256_add_ps(luma, _mm256_mul_ps(du, bu8));
+        _mm256_storeu_ps(r + x, _mm256_min_ps(_mm256_max_ps(red, zero8), max8));
+        _mm256_storeu_ps(g + x, _mm256_min_ps(_mm256_max_ps(green, zero8), max8));
+        _mm256_storeu_ps(b + x, _mm256_min_ps(_mm256_max_ps(blue, zero8), max8));
+    }
+#endif
+#if NUDENET_SSE2
+    const __m128 y4 = _mm_set1_ps(f.y), yoff4 = _mm_set1_ps(f.y_offset), half4 = _mm_set1_ps(128.0f);
+    const __m128 rv4 = _mm_set1_ps(f.rv), gu4 = _mm_set1_ps(f.gu), gv4 = _mm_set1_ps(f.gv), bu4 = _mm_set1_ps(f.bu);
+    const __m128 zero4 = _mm_setzero_ps(), max4 = _mm_set1_ps(f.max_value);
+    for (; x + 4 <= n; x += 4) {
+        __m128 luma = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(y + x), yoff4), y4);
+        __m128 du = _mm_sub_ps(_mm_loadu_ps(u + x), half4);
+        __m128 dv = _mm_sub_ps(_mm_loadu_ps(v + x), half4);
+        __m128 red = _mm_add_ps(luma, _mm_mul_ps(dv, rv4));
+        __m128 green = _mm_sub_ps(luma, _mm_add_ps(_mm_mul_ps(du, gu4), _mm_mul_ps(dv, gv4)));
+        __m128 blue = _mm_add_ps(luma, _mm_mul_ps(du, bu4));
+        _mm_storeu_ps(r + x, _mm_min_ps(_mm_max_ps(red, zero4), max4));
+        _mm_storeu_ps(g + x, _mm_min_ps(_mm_max_ps(green, zero4), max4));
+        _mm_storeu_ps(b + x, _mm_min_ps(_mm_max_ps(blue, zero4), max4));
+    }
+#endif
+    for (; x < n; ++x) {
+        const float luma = (y[x] - f.y_offset) * f.y;
+        const float du = u[x] - 128.0f;
+        const float dv = v[x] - 128.0f;
+        r[x] = std::min(std::max(luma + dv * f.rv, 0.0f), f.max_value);
+        g[x] = std::min(std::max(luma - du * f.gu - dv * f.gv, 0.0f), f.max_value);
+        b[x] = std::min(std::max(luma + du * f.bu, 0.0f), f.max_value);
+    }
+}
+
+} // namespace
+
+LetterboxGeometry letterbox_geometry(
+    const cv::Size& shape,
+    const cv::Size& newShape,
+    bool auto_,
+    bool scaleFill,
+    bool scaleUp,
+    int stride
+) {
+    LetterboxGeometry geometry;
+    float r = std::min(
+        static_cast<float>(newShape.height) / static_cast<float>(shape.height),
+        static_cast<float>(newShape.width) / static_cast<float>(shape.width)
+    );
+    if (!scaleUp) {
+        r = std::min(r, 1.0f);
+    }
+
+    geometry.ratio[0] = r;
+    geometry.ratio[1] = r;
+    int newUnpad[2]{ static_cast<int>(std::round(static_cast<float>(shape.width) * r)),
+                     static_cast<int>(std::round(static_cast<float>(shape.height) * r)) };
+
+    auto dw = static_cast<float>(newShape.width - newUnpad[0]);
+    auto dh = static_cast<float>(newShape.height - newUnpad[1]);
+    if (auto_) {
+        dw = static_cast<float>((static_cast<int>(dw) % stride));
+        dh = static_cast<float>((static_cast<int>(dh) % stride));
+    }
+    else if (scaleFill) {
+        dw = 0.0f;
+        dh = 0.0f;
+        newUnpad[0] = newShape.width;
+        newUnpad[1] = newShape.height;
+        geometry.ratio[0] = static_cast<float>(newShape.width) / static_cast<float>(shape.width);
+        geometry.ratio[1] = static_cast<float>(newShape.height) / static_cast<float>(shape.height);
+    }
+
+    dw /= 2.0f;
+    dh /= 2.0f;
+
+    geometry.newUnpad = cv::Size(newUnpad[0], newUnpad[1]);
+    geometry.top = static_cast<int>(std::round(dh - 0.1f));
+    geometry.bottom = static_cast<int>(std::round(dh + 0.1f));
+    geometry.left = static_cast<int>(std::round(dw - 0.1f));
+    geometry.right = static_cast<int>(std::round(dw + 0.1f));
+    geometry.outShape = cv::Size(geometry.left + newUnpad[0] + geometry.right, geometry.top + newUnpad[1] + geometry.bottom);
+    return geometry;
+}
+
+cv::Size letterbox_auto_shape(const cv::Size& shape, const cv::Size& maxShape, int stride) {
+    return letterbox_geometry(shape, maxShape, true, false, true, stride).outShape;
+}
+
+void letterbox_to_blob(const cv::Mat& image, float* blob, const LetterboxGeometry& geometry, bool swapRB,
+    PreprocessScratch& scratch, float scale) {
+    CV_Assert(image.depth() == CV_8U && (image.channels() == 1 || image.channels() == 3 || image.channels() == 4));
+
+    const int cn = image.channels();
+    const int outW = geometry.outShape.width;
+    const int outH = geometry.outShape.height;
+    const int unpadW = geometry.newUnpad.width;
+    const int unpadH = geometry.newUnpad.height;
+    const size_t plane = static_cast<size_t>(outW) * outH;
+    const float padValue = Utils::DEFAULT_LETTERBOX_PAD_VALUE * scale;
+
+    // output plane for every source channel, channel swap costs nothing this way
+    float* planes[3] = { blob, blob + plane, blob + 2 * plane };
+    if (swapRB) {
+        std::swap(planes[0], planes[2]);
+    }
+
+    // column lookup tables
+    scratch.xofs0.resize(unpadW);
+    scratch.xofs1.resize(unpadW);
+    scratch.xweight.resize(unpadW);
+    double inv_scale_x = static_cast<double>(image.cols) / unpadW;
+    for (int dx = 0; dx < unpadW; ++dx) {
+        int x0, x1;
+        source_coord(dx, inv_scale_x, image.cols, x0, x1, scratch.xweight[dx]);
+        scratch.xofs0[dx] = x0 * cn;
+        scratch.xofs1[dx] = x1 * cn;
+    }
+    scratch.rows.resize(static_cast<size_t>(6) * unpadW);
+    float* hrows[2] = { scratch.rows.data(), scratch.rows.data() + 3 * unpadW };
+    int cached[2] = { -1, -1 };
+
+    // top and bottom padding
+    for (int c = 0; c < 3; ++c) {
+        fill_floats(planes[c], geometry.top * outW, padValue);
+        fill_floats(planes[c] + static_cast<size_t>(geometry.top + unpadH) * outW, geometry.bottom * outW, padValue);
+    }
+
+    double inv_scale_y = static_cast<double>(image.rows) / unpadH;
+    for (int dy = 0; dy < unpadH; ++dy) {
+        int y0, y1;
+        float fy;
+        source_coord(dy, inv_scale_y, image.rows, y0, y1, fy);
+
+        update_row_cache(y0, y1, cached, hrows, [&](int sy, float* out) {
+            resample_row(image.ptr<uint8_t>(sy), cn, scratch, unpadW, out);
+        });
+
+        const float w0 = (1.0f - fy) * scale;
+        const float w1 = fy * scale;
+        const size_t rowOffset = static_cast<size_t>(geometry.top + dy) * outW;
+        for (int c = 0; c < 3; ++c) {
+            float* dst = planes[c] + rowOffset;
+            fill_floats(dst, geometry.left, padValue);
+            blend_rows(hrows[0] + c * unpadW, hrows[1] + c * unpadW, w0, w1, dst + geometry.left, unpadW);
+            fill_floats(dst + geometry.left + unpadW, geometry.right, padValue);
+        }
+    }
+}
+
+void yuv_letterbox_to_blob(const YuvImage& image, float* blob, const LetterboxGeometry& geometry,
+    PreprocessScratch& scratch, float scale) {
+    CV_Assert(image.width >= 2 && image.height >= 2 && image.width % 2 == 0
+        && (image.layout == YuvLayout::YUY2 || image.height % 2 == 0));
+
+    const int outW = geometry.outShape.width;
+    const int outH = geometry.outShape.height;
+    const int unpadW = geometry.newUnpad.width;
+    const int unpadH = geometry.newUnpad.height;
+    const size_t plane = static_cast<size_t>(outW) * outH;
+    const float padValue = Utils::DEFAULT_LETTERBOX_PAD_VALUE * scale;
+    float* planes[3] = { blob, blob + plane, blob + 2 * plane };  // R, G, B
+    const YuvToRgb factors = yuv_to_rgb_factors(image.matrix, image.fullRange, scale);
+
+    YuvChannel luma, u, v;
+    yuv_channels(image, luma, u, v);
+    // U and V share their sample positions, only the base pointer differs
+    channel_tables(luma, unpadW, scratch.xofs0, scratch.xofs1, scratch.xweight);
+    channel_tables(u, unpadW, scratch.cxofs0, scratch.cxofs1, scratch.cxweight);
+
+    // 2 luma rows, 2 x (U, V) chroma rows and the blended Y, U, V of the current output row
+    scratch.rows.resize(static_cast<size_t>(9) * unpadW);
+    float* lumaRows[2] = { scratch.rows.data(), scratch.rows.data() + unpadW };
+    float* chromaRows[2] = { scratch.rows.data() + 2 * unpadW, scratch.rows.data() + 4 * unpadW };
+    float* yLine = scratch.rows.data() + 6 * unpadW;
+    float* uLine = yLine + unpadW;
+    float* vLine = uLine + unpadW;
+    int lumaCached[2] = { -1, -1 };
+    int chromaCached[2] = { -1, -1 };
+    auto resample_luma = [&](int sy, float* out) {
+        resample_channel_row(luma.data + static_cast<size_t>(sy) * luma.stride, scratch.xofs0.data(), scratch.xofs1.data(),
+            scratch.xweight.data(), unpadW, out);
+    };
+    auto resample_chroma = [&](int sy, float* out) {
+        resample_channel_row(u.data + static_cast<size_t>(sy) * u.stride, scratch.cxofs0.data(), scratch.cxofs1.data(),
+            scratch.cxweight.data(), unpadW, out);
+        resample_channel_row(v.data + static_cast<size_t>(sy) * v.stride, scratch.cxofs0.data(), scratch.cxofs1.data(),
+            scratch.cxweight.data(), unpadW, out + unpadW);
+    };
+
+    for (int c = 0; c < 3; ++c) {
+        fill_floats(planes[c], geometry.top * outW, padValue);
+        fill_floats(planes[c] + static_cast<size_t>(geometry.top + unpadH) * outW, geometry.bottom * outW, padValue);
+    }
+
+    const double inv_scale_y = static_cast<double>(luma.height) / unpadH;
+    const double inv_scale_cy = static_cast<double>(u.height) / unpadH;
+    for (int dy = 0; dy < unpadH; ++dy) {
+        int y0, y1, cy0, cy1;
+        float fy, fcy;
+        source_coord(dy, inv_scale_y, luma.height, y0, y1, fy);
+        source_coord(dy, inv_scale_cy, u.height, cy0, cy1, fcy);
+        update_row_cache(y0, y1, lumaCached, lumaRows, resample_luma);
+        update_row_cache(cy0, cy1, chromaCached, chromaRows, resample_chroma);
+
+        // the conversion is affine, interpolating before it gives the same values (up to the clamping)
+        blend_rows(lumaRows[0], lumaRows[1], 1.0f - fy, fy, yLine, unpadW);
+        blend_rows(chromaRows[0], chromaRows[1], 1.0f - fcy, fcy, uLine, unpadW);
+        blend_rows(chromaRows[0] + unpadW, chromaRows[1] + unpadW, 1.0f - fcy, fcy, vLine, unpadW);
+
+        const size_t rowOffset = static_cast<size_t>(geometry.top + dy) * outW;
+        for (int c = 0; c < 3; ++c) {
+            fill_floats(planes[c] + rowOffset, geometry.left, padValue);
+            fill_floats(planes[c] + rowOffset + geometry.left + unpadW, geometry.right, padValue);
+        }
+        yuv_row_to_rgb(yLine, uLine, vLine, factors, planes[0] + rowOffset + geometry.left,
+            planes[1] + rowOffset + geometry.left, planes[2] + rowOffset + geometry.left, unpadW);
+    }
+}
+
+void fill_blob(const cv::Mat& image, float* blob) {
+    cv::Size imageSize{ image.cols, image.rows };
+    const size_t plane = static_cast<size_t>(imageSize.width) * imageSize.height;
+    if (image.depth() == CV_8U) {
+        // hwc -> chw in one pass over the pixels, no intermediate float image
+        const int cn = image.channels();
+        const float scale = 1.0f / 255.0f;
+        for (int y = 0; y < imageSize.height; ++y) {
+            const uint8_t* src = image.ptr<uint8_t>(y);
+            for (int c = 0; c < cn; ++c) {
+                float* dst = blob + c * plane + static_cast<size_t>(y) * imageSize.width;
+                for (int x = 0; x < imageSize.width; ++x) {
+                    dst[x] = src[x * cn + c] * scale;
+                }
+            }
+        }
+        return;
+    }
+
+    cv::Mat floatImage;
+    image.convertTo(floatImage, CV_32FC(image.channels()), 1.0f / 255.0);
+
+    // hwc -> chw, the planes are views into the blob so cv::split writes the tensor data directly
+    std::vector<cv::Mat> chw(floatImage.channels());
+    for (int i = 0; i < floatImage.channels(); ++i) {
+        chw[i] = cv::Mat(imageSize, CV_32FC1, blob + i * plane);
+    }
+    cv::split(floatImage, chw);
+}
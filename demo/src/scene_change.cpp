@@ -0,0 +1,107 @@
+#include "scene_change.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+
+// Samples per thumbnail cell along each axis, enough to average out sensor noise
+constexpr int SAMPLES_PER_CELL = 8;
+
+// BT.601 luma in 8-bit fixed point, the channel order of the input does not matter for change detection
+inline int luma(const uint8_t* px, int channels) {
+    if (channels == 1) {
+        return px[0];
+    }
+    return (29 * px[0] + 150 * px[1] + 77 * px[2]) >> 8;
+}
+
+} // namespace
+
+SceneChangeDetector::SceneChangeDetector(const SceneChangeOptions& options)
+    : options_(options) {
+}
+
+void SceneChangeDetector::setOptions(const SceneChangeOptions& options) {
+    options_ = options;
+    reset();
+}
+
+bool SceneChangeDetector::_thumbnail(const cv::Mat& image, std::vector<uint8_t>& thumbnail) {
+    const int channels = image.channels();
+    if (image.depth() != CV_8U || (channels != 1 && channels != 3 && channels != 4) || image.empty()) {
+        return false;
+    }
+
+    const int tw = std::min(options_.thumbnail_size.width, image.cols);
+    const int th = std::min(options_.thumbnail_size.height, image.rows);
+    thumbnail.resize(static_cast<size_t>(tw) * th);
+
+    for (int cy = 0; cy < th; ++cy) {
+        const int y0 = cy * image.rows / th;
+        const int y1 = (cy + 1) * image.rows / th;
+        const int ystep = std::max(1, (y1 - y0) / SAMPLES_PER_CELL);
+        for (int cx = 0; cx < tw; ++cx) {
+            const int x0 = cx * image.cols / tw;
+            const int x1 = (cx + 1) * image.cols / tw;
+            const int xstep = std::max(1, (x1 - x0) / SAMPLES_PER_CELL);
+            int sum = 0;
+            int count = 0;
+            for (int y = y0; y < y1; y += ystep) {
+                const uint8_t* row = image.ptr<uint8_t>(y);
+                for (int x = x0; x < x1; x += xstep) {
+                    sum += luma(row + x * channels, channels);
+                    ++count;
+                }
+            }
+            thumbnail[static_cast<size_t>(cy) * tw + cx] = static_cast<uint8_t>(sum / std::max(count, 1));
+        }
+    }
+    return true;
+}
+
+bool SceneChangeDetector::hasChanged(const cv::Mat& image) {
+    currentValid_ = _thumbnail(image, current_);
+    currentSize_ = image.size();
+    lastDifference_ = 1.0f;
+    if (!currentValid_ || !hasReference_ || currentSize_ != referenceSize_ || current_.size() != reference_.size()) {
+        return true;
+    }
+
+    int total = 0;
+    int maxCell = 0;
+    for (size_t i = 0; i < current_.size(); ++i) {
+        int diff = std::abs(static_cast<int>(current_[i]) - static_cast<int>(reference_[i]));
+        total += diff;
+        maxCell = std::max(maxCell, diff);
+    }
+    lastDifference_ = static_cast<float>(total) / (255.0f * current_.size());
+
+    bool changed = lastDifference_ > options_.threshold || maxCell > options_.cell_threshold * 255.0f;
+    if (!changed && options_.refresh_interval > 0 && unchangedFrames_ >= options_.refresh_interval) {
+        changed = true;
+    }
+    if (!changed) {
+        ++unchangedFrames_;
+    }
+    return changed;
+}
+
+void SceneChangeDetector::accept() {
+    if (!currentValid_) {
+        hasReference_ = false;
+        return;
+    }
+    std::swap(reference_, current_);
+    referenceSize_ = currentSize_;
+    hasReference_ = true;
+    currentValid_ = false;
+    unchangedFrames_ = 0;
+}
+
+void SceneChangeDetector::reset() {
+    hasReference_ = false;
+    currentValid_ = false;
+    unchangedFrames_ = 0;
+    lastDifference_ = 0.0f;
+}
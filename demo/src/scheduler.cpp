@@ -0,0 +1,135 @@
+#include "scheduler.h"
+
+#include <algorithm>
+
+namespace {
+
+double smooth(double average, double sample, double weight) {
+    return average > 0.0 ? average + weight * (sample - average) : sample;
+}
+
+} // namespace
+
+SchedulerOptions fixed_size_if_static(SchedulerOptions options, bool dynamic_input_size) {
+    if (!dynamic_input_size) {
+        options.input_scales = { 1.0f };
+    }
+    return options;
+}
+
+InferenceScheduler::InferenceScheduler(const SchedulerOptions& options) {
+    setOptions(options);
+}
+
+void InferenceScheduler::setOptions(const SchedulerOptions& options) {
+    options_ = options;
+    options_.min_interval = std::max(options_.min_interval, 1);
+    options_.max_interval = std::max(options_.max_interval, options_.min_interval);
+    if (options_.input_scales.empty()) {
+        options_.input_scales = { 1.0f };
+    }
+    std::sort(options_.input_scales.begin(), options_.input_scales.end(), [](float a, float b) { return a > b; });
+    options_.smoothing = std::clamp(options_.smoothing, 0.01, 1.0);
+    reset();
+}
+
+void InferenceScheduler::reset() {
+    interval_ = options_.min_interval;
+    scaleIndex_ = 0;
+    latency_ = 0.0;
+    skippedCost_ = 0.0;
+    framePeriod_ = 0.0;
+    framesSinceInference_ = 0;
+    inferencesSinceChange_ = 0;
+    hasInferred_ = false;
+    hasLastFrame_ = false;
+}
+
+bool InferenceScheduler::nextFrame(double frame_seconds) {
+    auto now = std::chrono::steady_clock::now();
+    if (frame_seconds <= 0.0 && hasLastFrame_) {
+        frame_seconds = std::chrono::duration<double>(now - lastFrame_).count();
+    }
+    lastFrame_ = now;
+    hasLastFrame_ = true;
+    if (frame_seconds > 0.0) {
+        framePeriod_ = smooth(framePeriod_, frame_seconds, options_.smoothing);
+    }
+
+    bool infer = !hasInferred_ || framesSinceInference_ + 1 >= interval_;
+    framesSinceInference_ = infer ? 0 : framesSinceInference_ + 1;
+    hasInferred_ = true;
+    return infer;
+}
+
+void InferenceScheduler::recordInference(double seconds) {
+    latency_ = smooth(latency_, seconds, options_.smoothing);
+    ++inferencesSinceChange_;
+    _adapt();
+}
+
+void InferenceScheduler::recordSkipped(double seconds) {
+    skippedCost_ = smooth(skippedCost_, seconds, options_.smoothing);
+}
+
+double InferenceScheduler::getCpuShare() const {
+    return _estimate_share(interval_, scaleIndex_);
+}
+
+double InferenceScheduler::_estimate_latency(int scale_index) const {
+    // the cost of the network grows with the input area
+    double ratio = options_.input_scales[scale_index] / options_.input_scales[scaleIndex_];
+    return latency_ * ratio * ratio;
+}
+
+double InferenceScheduler::_estimate_share(int interval, int scale_index) const {
+    if (framePeriod_ <= 0.0) {
+        return 0.0;
+    }
+    double busy = _estimate_latency(scale_index) + (interval - 1) * skippedCost_;
+    return busy / (interval * framePeriod_);
+}
+
+void InferenceScheduler::_adapt() {
+    if (inferencesSinceChange_ < options_.cooldown || framePeriod_ <= 0.0) {
+        return;
+    }
+    const int last_scale = static_cast<int>(options_.input_scales.size()) - 1;
+    const int previous_interval = interval_;
+    const int previous_scale = scaleIndex_;
+
+    if (latency_ > options_.target_latency && scaleIndex_ < last_scale) {
+        ++scaleIndex_;
+    }
+    else if (getCpuShare() > options_.max_cpu_share) {
+        if (interval_ < options_.max_interval) {
+            // jump straight to the smallest interval that fits instead of creeping up one frame per cooldown
+            do {
+                ++interval_;
+            } while (interval_ < options_.max_interval && _estimate_share(interval_, scaleIndex_) > options_.max_cpu_share);
+        }
+        else if (scaleIndex_ < last_scale) {
+            ++scaleIndex_;
+        }
+    }
+    else {
+        const double latency_limit = options_.target_latency * options_.headroom;
+        const double share_limit = options_.max_cpu_share * options_.headroom;
+        if (scaleIndex_ > 0 && _estimate_latency(scaleIndex_ - 1) <= latency_limit && _estimate_share(interval_, scaleIndex_ - 1) <= share_limit) {
+            --scaleIndex_;
+        }
+        else if (interval_ > options_.min_interval && _estimate_share(interval_ - 1, scaleIndex_) <= share_limit) {
+            --interval_;
+        }
+    }
+
+    if (scaleIndex_ != previous_scale) {
+        // keep the average consistent with the new input size until real measurements replace it
+        double ratio = options_.input_scales[scaleIndex_] / options_.input_scales[previous_scale];
+        latency_ *= ratio * ratio;
+    }
+    if (interval_ != previous_interval || scaleIndex_ != previous_scale) {
+        inferencesSinceChange_ = 0;
+        ++adjustments_;
+    }
+}
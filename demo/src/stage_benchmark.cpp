@@ -0,0 +1,311 @@
+#include "stage_benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+
+#include <opencv2/imgproc.hpp>
+
+#include "allocation_counter.h"
+#include "nms.h"
+#include "nn_utils.h"
+#include "postprocess.h"
+#include "preprocess.h"
+
+namespace {
+
+// Nearest-rank percentile of sorted samples
+double percentile(const std::vector<double>& sorted, double p) {
+    size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+std::string size_name(const cv::Size& size) {
+    return std::to_string(size.width) + "x" + std::to_string(size.height);
+}
+
+// Interleaves the U and V planes of a (h * 3 / 2) x w I420 image, the layout cameras and capture cards deliver
+cv::Mat i420_to_nv12(const cv::Mat& i420, const cv::Size& size) {
+    cv::Mat nv12 = i420.clone();
+    const size_t luma = static_cast<size_t>(size.width) * size.height;
+    const size_t chroma = luma / 4;
+    for (size_t i = 0; i < chroma; ++i) {
+        nv12.data[luma + 2 * i] = i420.data[luma + i];
+        nv12.data[luma + 2 * i + 1] = i420.data[luma + chroma + i];
+    }
+    return nv12;
+}
+
+// Input and output tensors of our own, so forward runs without predict_once around it
+struct ForwardTensors {
+    std::vector<int64_t> input_shape;
+    std::vector<float> blob;
+    std::vector<Ort::Value> inputs;
+    bool static_output = false;
+    std::vector<int64_t> output_shape;
+    std::vector<float> output_data;
+    std::vector<Ort::Value> outputs;  // empty for a dynamic output0, Run allocates it then
+};
+
+ForwardTensors make_forward_tensors(AutoBackendOnnx& model) {
+    ForwardTensors tensors;
+    tensors.input_shape = { 1, model.getCh(), model.getCvSize().height, model.getCvSize().width };
+    tensors.blob.resize(static_cast<size_t>(vector_product(tensors.input_shape)));
+    Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+    tensors.inputs.push_back(Ort::Value::CreateTensor<float>(memory_info, tensors.blob.data(), tensors.blob.size(), tensors.input_shape.data(), tensors.input_shape.size()));
+
+    tensors.static_output = model.getOutputFeatures() > 0 && model.getOutputAnchors() > 0;
+    if (tensors.static_output) {
+        tensors.output_shape = { 1, model.getOutputFeatures(), model.getOutputAnchors() };
+        tensors.output_data.resize(static_cast<size_t>(vector_product(tensors.output_shape)));
+        tensors.outputs.push_back(Ort::Value::CreateTensor<float>(memory_info, tensors.output_data.data(), tensors.output_data.size(), tensors.output_shape.data(), tensors.output_shape.size()));
+    }
+    return tensors;
+}
+
+void run_forward(AutoBackendOnnx& model, ForwardTensors& tensors) {
+    if (tensors.static_output) {
+        model.forward(tensors.inputs, tensors.outputs);
+    }
+    else {
+        model.forward(tensors.inputs);
+    }
+}
+
+} // namespace
+
+StageStats measure_stage(const std::string& stage, const cv::Size& resolution, size_t iterations, size_t warmup, const std::function<void()>& body) {
+    for (size_t i = 0; i < warmup; i++) {
+        body();
+    }
+
+    std::vector<double> samples(iterations);
+    for (size_t i = 0; i < iterations; i++) {
+        double seconds = 0.0;
+        Timer timer = Timer(seconds, true);
+        body();
+        timer.Stop();
+        samples[i] = seconds * 1000.0;
+    }
+
+    StageStats stats;
+    stats.stage = stage;
+    stats.resolution = resolution;
+    stats.iterations = iterations;
+    if (samples.empty()) {
+        return stats;
+    }
+    std::sort(samples.begin(), samples.end());
+    stats.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+    double variance = 0.0;
+    for (double sample : samples) {
+        variance += (sample - stats.mean) * (sample - stats.mean);
+    }
+    stats.stddev = samples.size() > 1 ? std::sqrt(variance / (samples.size() - 1)) : 0.0;
+    stats.min = samples.front();
+    stats.p50 = percentile(samples, 0.50);
+    stats.p95 = percentile(samples, 0.95);
+    stats.p99 = percentile(samples, 0.99);
+    stats.max = samples.back();
+    return stats;
+}
+
+std::vector<StageStats> run_stage_benchmarks(AutoBackendOnnx& model, const cv::Mat& image, const StageBenchmarkOptions& options) {
+    std::vector<StageStats> results;
+    const cv::Size model_size = model.getCvSize();
+    const int stride = model.getStride();
+    const int num_classes = static_cast<int>(model.getNames().size());
+    std::unordered_map<int, std::string> names = model.getNames();
+
+    // forward does not depend on the source resolution
+    ForwardTensors forward = make_forward_tensors(model);
+    results.push_back(measure_stage("forward", model_size, options.forward_iterations, 3, [&]() {
+        run_forward(model, forward);
+    }));
+    std::vector<float>& blob = forward.blob;
+
+    bool swapRB = options.conversion_code == cv::COLOR_BGR2RGB;
+    PreprocessScratch scratch;
+    DetectionCandidates candidates;
+    NmsOptions nms_options = model.getNmsOptions();
+    nms_options.iou_threshold = options.iou;
+    NmsScratch nms_scratch;
+    std::vector<int> keep;
+    CensorScratch censor_scratch;
+
+    for (const cv::Size& resolution : options.resolutions) {
+        cv::Mat frame;
+        cv::resize(image, frame, resolution);
+
+        results.push_back(measure_stage("letterbox", resolution, options.iterations, options.warmup, [&]() {
+            cv::Mat letterboxed;
+            letterbox(frame, letterboxed, model_size, false, false, true, stride);
+        }));
+
+        cv::Mat letterboxed;
+        letterbox(frame, letterboxed, model_size, false, false, true, stride);
+        if (options.conversion_code >= 0) {
+            cv::cvtColor(letterboxed, letterboxed, options.conversion_code);
+        }
+        results.push_back(measure_stage("fill_blob", resolution, options.iterations, options.warmup, [&]() {
+            fill_blob(letterboxed, blob.data());
+        }));
+
+        results.push_back(measure_stage("letterbox_to_blob", resolution, options.iterations, options.warmup, [&]() {
+            LetterboxGeometry geometry = letterbox_geometry(frame.size(), model_size, false, false, true, stride);
+            letterbox_to_blob(frame, blob.data(), geometry, swapRB, scratch);
+        }));
+
+        // capture card input: converting the whole NV12 frame first vs sampling it at model resolution
+        cv::Mat nv12;
+        cv::cvtColor(frame, nv12, cv::COLOR_BGR2YUV_I420);
+        nv12 = i420_to_nv12(nv12, resolution);
+        YuvImage yuv;
+        yuv.layout = YuvLayout::NV12;
+        yuv.data[0] = nv12.data;
+        yuv.data[1] = nv12.data + static_cast<size_t>(resolution.width) * resolution.height;
+        yuv.stride[0] = yuv.stride[1] = resolution.width;
+        yuv.width = resolution.width;
+        yuv.height = resolution.height;
+        results.push_back(measure_stage("nv12_cvtcolor_to_blob", resolution, options.iterations, options.warmup, [&]() {
+            cv::Mat bgr;
+            cv::cvtColor(nv12, bgr, cv::COLOR_YUV2BGR_NV12);
+            LetterboxGeometry geometry = letterbox_geometry(frame.size(), model_size, false, false, true, stride);
+            letterbox_to_blob(bgr, blob.data(), geometry, true, scratch);
+        }));
+        results.push_back(measure_stage("yuv_letterbox_to_blob", resolution, options.iterations, options.warmup, [&]() {
+            LetterboxGeometry geometry = letterbox_geometry(frame.size(), model_size, false, false, true, stride);
+            yuv_letterbox_to_blob(yuv, blob.data(), geometry, scratch);
+        }));
+
+        // the later stages work on the real output of this frame
+        model.preprocess(frame, blob.data(), options.conversion_code);
+        std::vector<Ort::Value> dynamic_outputs;
+        cv::Mat output0;
+        if (forward.static_output) {
+            model.forward(forward.inputs, forward.outputs);
+            output0 = cv::Mat(static_cast<int>(forward.output_shape[1]), static_cast<int>(forward.output_shape[2]), CV_32F, forward.output_data.data());
+        }
+        else {
+            dynamic_outputs = model.forward(forward.inputs);
+            std::vector<int64_t> shape = dynamic_outputs[0].GetTensorTypeAndShapeInfo().GetShape();
+            output0 = cv::Mat(static_cast<int>(shape[1]), static_cast<int>(shape[2]), CV_32F, dynamic_outputs[0].GetTensorMutableData<float>());
+        }
+
+        std::vector<YoloResults> detections;
+        results.push_back(measure_stage("postprocess", resolution, options.iterations, options.warmup, [&]() {
+            model.postprocess(output0, frame.size(), detections, options.conf, options.iou);
+        }));
+        results.push_back(measure_stage("decode", resolution, options.iterations, options.warmup, [&]() {
+            decode_detections(output0.ptr<float>(), output0.cols, std::min(num_classes, output0.rows - 4), options.conf, candidates);
+        }));
+        results.push_back(measure_stage("nms", resolution, options.iterations, options.warmup, [&]() {
+            nms_boxes(candidates, nms_options, keep, nms_scratch);
+        }));
+
+        cv::Mat canvas = frame.clone();
+        results.push_back(measure_stage("plot_fast", resolution, options.iterations, options.warmup, [&]() {
+            plot_results_fast(canvas, detections);
+        }));
+        results.push_back(measure_stage("plot_classified", resolution, options.iterations, options.warmup, [&]() {
+            plot_results_with_classifications(canvas, detections, names, true);
+        }));
+        for (CensorMode mode : { CensorMode::Pixelate, CensorMode::Blur }) {
+            CensorOptions censor_options;
+            censor_options.mode = mode;
+            results.push_back(measure_stage("censor_" + censor_mode_name(mode), resolution, options.iterations, options.warmup, [&]() {
+                plot_results_censored(canvas, detections, censor_options, censor_scratch);
+            }));
+        }
+        // the same boxes censored in the NV12 frame, without leaving YUV
+        YuvPlanes nv12_planes;
+        nv12_planes.layout = YuvLayout::NV12;
+        nv12_planes.data[0] = nv12.data;
+        nv12_planes.data[1] = nv12.data + static_cast<size_t>(resolution.width) * resolution.height;
+        nv12_planes.stride[0] = nv12_planes.stride[1] = resolution.width;
+        nv12_planes.width = resolution.width;
+        nv12_planes.height = resolution.height;
+        for (CensorMode mode : { CensorMode::Fill, CensorMode::Pixelate }) {
+            CensorOptions censor_options;
+            censor_options.mode = mode;
+            results.push_back(measure_stage("censor_nv12_" + censor_mode_name(mode), resolution, options.iterations, options.warmup, [&]() {
+                plot_results_censored(nv12_planes, detections, censor_options, censor_scratch);
+            }));
+        }
+    }
+    return results;
+}
+
+AllocationStats measure_allocations(AutoBackendOnnx& model, const cv::Mat& image, const StageBenchmarkOptions& options) {
+    const size_t iterations = std::max<size_t>(options.forward_iterations, 1);
+    auto allocations_per_call = [&](const std::function<void()>& body) {
+        for (size_t i = 0; i < options.warmup; i++) {
+            body();
+        }
+        start_counting_allocations();
+        for (size_t i = 0; i < iterations; i++) {
+            body();
+        }
+        return static_cast<double>(stop_counting_allocations()) / iterations;
+    };
+
+    AllocationStats stats;
+    cv::Mat frame = image;
+    std::vector<YoloResults> detections;
+    float conf = options.conf;
+    float iou = options.iou;
+    float mask_threshold = 0.5f;
+    // the warmup binds the tensors and sizes the scratch buffers
+    stats.predict_once = allocations_per_call([&]() {
+        model.predict_once(frame, detections, conf, iou, mask_threshold, options.conversion_code);
+    });
+
+    ForwardTensors forward = make_forward_tensors(model);
+    stats.forward = allocations_per_call([&]() {
+        run_forward(model, forward);
+    });
+    return stats;
+}
+
+void print_stage_stats(const std::vector<StageStats>& stats) {
+    std::cout << std::left << std::setw(20) << "stage" << std::setw(12) << "resolution" << std::right
+        << std::setw(8) << "iters" << std::setw(10) << "mean" << std::setw(10) << "stddev" << std::setw(10) << "min"
+        << std::setw(10) << "p50" << std::setw(10) << "p95" << std::setw(10) << "p99" << std::setw(10) << "max" << "  (ms)" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    for (const StageStats& s : stats) {
+        std::cout << std::left << std::setw(20) << s.stage << std::setw(12) << size_name(s.resolution) << std::right
+            << std::setw(8) << s.iterations << std::setw(10) << s.mean << std::setw(10) << s.stddev << std::setw(10) << s.min
+            << std::setw(10) << s.p50 << std::setw(10) << s.p95 << std::setw(10) << s.p99 << std::setw(10) << s.max << std::endl;
+    }
+}
+
+bool write_stage_stats_json(const std::string& path, const std::vector<StageStats>& stats, AutoBackendOnnx& model) {
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        std::cerr << "Error: Cannot write " << path << std::endl;
+        return false;
+    }
+
+    const SessionConfig& config = model.getSessionConfig();
+    out << std::fixed << std::setprecision(4);
+    out << "{\n  \"context\": {"
+        << "\"model\": \"" << json_escape(model.getModelPath()) << "\", "
+        << "\"provider\": \"" << json_escape(model.getProvider()) << "\", "
+        << "\"input\": \"" << size_name(model.getCvSize()) << "\", "
+        << "\"intra_op_threads\": " << config.intra_op_threads << ", "
+        << "\"optimization_level\": \"" << optimization_level_name(config.optimization_level) << "\"},\n"
+        << "  \"benchmarks\": [";
+    for (size_t i = 0; i < stats.size(); ++i) {
+        const StageStats& s = stats[i];
+        out << (i == 0 ? "\n" : ",\n")
+            << "    {\"stage\": \"" << json_escape(s.stage) << "\", \"resolution\": \"" << size_name(s.resolution) << "\", "
+            << "\"iterations\": " << s.iterations << ", \"mean_ms\": " << s.mean << ", \"stddev_ms\": " << s.stddev << ", "
+            << "\"min_ms\": " << s.min << ", \"p50_ms\": " << s.p50 << ", \"p95_ms\": " << s.p95 << ", "
+            << "\"p99_ms\": " << s.p99 << ", \"max_ms\": " << s.max << "}";
+    }
+    out << "\n  ]\n}\n";
+    return out.good();
+}
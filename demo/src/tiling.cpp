@@ -0,0 +1,41 @@
+#include "tiling.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Start offsets of the tiles along one axis of `length` pixels
+std::vector<int> tile_offsets(int length, int tile, float overlap) {
+    if (length <= tile) {
+        return { 0 };
+    }
+    const float step = static_cast<float>(tile) * (1.0f - overlap);
+    const int count = static_cast<int>(std::ceil(static_cast<float>(length - tile) / step)) + 1;
+    std::vector<int> offsets(count);
+    for (int i = 0; i < count; ++i) {
+        offsets[i] = static_cast<int>(std::lround(static_cast<double>(i) * (length - tile) / (count - 1)));
+    }
+    return offsets;
+}
+
+} // namespace
+
+std::vector<cv::Rect> tile_grid(const cv::Size& frame_size, const cv::Size& tile_size, float overlap) {
+    std::vector<cv::Rect> tiles;
+    if (frame_size.empty() || tile_size.empty()) {
+        return tiles;
+    }
+    overlap = std::clamp(overlap, 0.0f, 0.9f);
+    const int tile_w = std::min(tile_size.width, frame_size.width);
+    const int tile_h = std::min(tile_size.height, frame_size.height);
+    const std::vector<int> xs = tile_offsets(frame_size.width, tile_w, overlap);
+    const std::vector<int> ys = tile_offsets(frame_size.height, tile_h, overlap);
+    tiles.reserve(xs.size() * ys.size());
+    for (int y : ys) {
+        for (int x : xs) {
+            tiles.emplace_back(x, y, tile_w, tile_h);
+        }
+    }
+    return tiles;
+}
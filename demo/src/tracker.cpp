@@ -0,0 +1,161 @@
+#include "tracker.h"
+
+#include <algorithm>
+
+#include "nn_utils.h"
+
+namespace {
+
+float iou(const cv::Rect_<float>& a, const cv::Rect_<float>& b) {
+    float inter = (a & b).area();
+    float uni = a.area() + b.area() - inter;
+    return uni > 0.0f ? inter / uni : 0.0f;
+}
+
+} // namespace
+
+void KalmanAxis::init(float z, float position_var, float velocity_var) {
+    position = z;
+    velocity = 0.0f;
+    p00 = position_var;
+    p01 = 0.0f;
+    p11 = velocity_var;
+}
+
+void KalmanAxis::predict(float accel_var) {
+    // x = F x, P = F P F^T + Q with F = [1 1; 0 1] and Q = accel_var * [1/4 1/2; 1/2 1] (dt = 1 frame)
+    position += velocity;
+    p00 += 2.0f * p01 + p11 + 0.25f * accel_var;
+    p01 += p11 + 0.5f * accel_var;
+    p11 += accel_var;
+}
+
+void KalmanAxis::correct(float z, float measurement_var) {
+    const float s = p00 + measurement_var;
+    const float k0 = p00 / s;
+    const float k1 = p01 / s;
+    const float residual = z - position;
+    position += k0 * residual;
+    velocity += k1 * residual;
+    // P = (I - K H) P
+    p11 -= k1 * p01;
+    p01 -= k0 * p01;
+    p00 -= k0 * p00;
+}
+
+cv::Rect_<float> Track::box() const {
+    float width = std::max(w.position, 1.0f);
+    float height = std::max(h.position, 1.0f);
+    return cv::Rect_<float>(cx.position - 0.5f * width, cy.position - 0.5f * height, width, height);
+}
+
+BoxTracker::BoxTracker(const TrackerOptions& options)
+    : options_(options) {
+}
+
+void BoxTracker::reset() {
+    tracks_.clear();
+    output_.clear();
+}
+
+void BoxTracker::_advance() {
+    for (Track& track : tracks_) {
+        float scale = std::max(track.h.position, 1.0f);
+        float accel_var = options_.process_noise * scale;
+        accel_var *= accel_var;
+        track.cx.predict(accel_var);
+        track.cy.predict(accel_var);
+        track.w.predict(accel_var);
+        track.h.predict(accel_var);
+        ++track.frames_since_update;
+    }
+}
+
+const std::vector<YoloResults>& BoxTracker::update(const std::vector<YoloResults>& detections, const cv::Size& frame_size) {
+    _advance();
+
+    // greedy association, highest IoU first
+    candidates_.clear();
+    for (int t = 0; t < static_cast<int>(tracks_.size()); ++t) {
+        cv::Rect_<float> predicted = tracks_[t].box();
+        for (int d = 0; d < static_cast<int>(detections.size()); ++d) {
+            if (detections[d].class_idx != tracks_[t].class_idx) {
+                continue;
+            }
+            float overlap = iou(predicted, detections[d].bbox);
+            if (overlap >= options_.iou_threshold) {
+                candidates_.push_back({ overlap, t, d });
+            }
+        }
+    }
+    std::sort(candidates_.begin(), candidates_.end(), [](const Candidate& a, const Candidate& b) { return a.iou > b.iou; });
+
+    trackMatched_.assign(tracks_.size(), false);
+    detectionMatched_.assign(detections.size(), false);
+    for (const Candidate& candidate : candidates_) {
+        if (trackMatched_[candidate.track] || detectionMatched_[candidate.detection]) {
+            continue;
+        }
+        trackMatched_[candidate.track] = true;
+        detectionMatched_[candidate.detection] = true;
+
+        Track& track = tracks_[candidate.track];
+        const YoloResults& detection = detections[candidate.detection];
+        float measurement_var = options_.measurement_noise * std::max(detection.bbox.height, 1.0f);
+        measurement_var *= measurement_var;
+        track.cx.correct(detection.bbox.x + 0.5f * detection.bbox.width, measurement_var);
+        track.cy.correct(detection.bbox.y + 0.5f * detection.bbox.height, measurement_var);
+        track.w.correct(detection.bbox.width, measurement_var);
+        track.h.correct(detection.bbox.height, measurement_var);
+        track.conf = detection.conf;
+        track.frames_since_update = 0;
+    }
+
+    // drop tracks that coasted for too long, then start tracks for the unmatched detections
+    tracks_.erase(std::remove_if(tracks_.begin(), tracks_.end(),
+        [this](const Track& track) { return track.frames_since_update > options_.max_age; }), tracks_.end());
+    for (size_t d = 0; d < detections.size(); ++d) {
+        if (detectionMatched_[d]) {
+            continue;
+        }
+        const YoloResults& detection = detections[d];
+        float position_std = options_.measurement_noise * std::max(detection.bbox.height, 1.0f);
+        float position_var = position_std * position_std;
+        // the velocity of a new track is unknown, let the first matches set it
+        float velocity_var = 100.0f * position_var;
+        Track track;
+        track.cx.init(detection.bbox.x + 0.5f * detection.bbox.width, position_var, velocity_var);
+        track.cy.init(detection.bbox.y + 0.5f * detection.bbox.height, position_var, velocity_var);
+        track.w.init(detection.bbox.width, position_var, velocity_var);
+        track.h.init(detection.bbox.height, position_var, velocity_var);
+        track.class_idx = detection.class_idx;
+        track.conf = detection.conf;
+        tracks_.push_back(track);
+    }
+
+    return _emit(frame_size);
+}
+
+const std::vector<YoloResults>& BoxTracker::predict(const cv::Size& frame_size) {
+    _advance();
+    tracks_.erase(std::remove_if(tracks_.begin(), tracks_.end(),
+        [this](const Track& track) { return track.frames_since_update > options_.max_age; }), tracks_.end());
+    return _emit(frame_size);
+}
+
+const std::vector<YoloResults>& BoxTracker::_emit(const cv::Size& frame_size) {
+    output_.clear();
+    for (const Track& track : tracks_) {
+        cv::Rect_<float> box = track.box();
+        float margin = std::min(options_.max_margin, options_.base_margin + options_.margin_per_frame * track.frames_since_update);
+        float dx = margin * box.width;
+        float dy = margin * box.height;
+        box = cv::Rect_<float>(box.x - dx, box.y - dy, box.width + 2.0f * dx, box.height + 2.0f * dy);
+        clip_boxes(box, frame_size);
+        if (box.width <= 0.0f || box.height <= 0.0f) {
+            continue;
+        }
+        output_.push_back({ track.class_idx, track.conf, box });
+    }
+    return output_;
+}
@@ -0,0 +1,170 @@
+#include "video_pipeline.h"
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <opencv2/videoio.hpp>
+
+#include "nn/tracking_predictor.h"
+#include "nn_utils.h"
+#include "spsc_queue.h"
+
+namespace {
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Waits for a free slot, false when `cancelled` is set first. `frame` is only a header, pushing a copy is cheap.
+bool push_frame(SpscQueue<cv::Mat>& queue, const cv::Mat& frame, const std::atomic<bool>& cancelled, double& wait_seconds) {
+    auto start = std::chrono::steady_clock::now();
+    Backoff backoff;
+    while (!queue.try_push(frame)) {
+        if (cancelled.load(std::memory_order_acquire)) {
+            return false;
+        }
+        backoff.pause();
+    }
+    wait_seconds += seconds_since(start);
+    return true;
+}
+
+// Waits for the next frame, false once the producer is `done` and the queue is drained
+bool pop_frame(SpscQueue<cv::Mat>& queue, cv::Mat& frame, const std::atomic<bool>& done, double& wait_seconds) {
+    auto start = std::chrono::steady_clock::now();
+    Backoff backoff;
+    while (!queue.try_pop(frame)) {
+        if (done.load(std::memory_order_acquire)) {
+            // the producer may have pushed its last frame right before setting done
+            if (queue.try_pop(frame)) {
+                break;
+            }
+            return false;
+        }
+        backoff.pause();
+    }
+    wait_seconds += seconds_since(start);
+    return true;
+}
+
+} // namespace
+
+bool process_video(AutoBackendOnnx& model, const std::string& input_path, const std::string& output_path,
+    const VideoProcessingOptions& options, VideoProcessingStats& stats) {
+    cv::VideoCapture capture(input_path);
+    if (!capture.isOpened()) {
+        std::cerr << "Error: Cannot open video " << input_path << std::endl;
+        return false;
+    }
+    double fps = capture.get(cv::CAP_PROP_FPS);
+    if (fps <= 0.0) {
+        std::cerr << "Warning: " << input_path << " does not report its frame rate, writing 30 fps" << std::endl;
+        fps = 30.0;
+    }
+    cv::Size frame_size(static_cast<int>(capture.get(cv::CAP_PROP_FRAME_WIDTH)), static_cast<int>(capture.get(cv::CAP_PROP_FRAME_HEIGHT)));
+    const std::string code = options.fourcc.size() == 4 ? options.fourcc : "mp4v";
+    cv::VideoWriter writer(output_path, cv::VideoWriter::fourcc(code[0], code[1], code[2], code[3]), fps, frame_size);
+    if (!writer.isOpened()) {
+        std::cerr << "Error: Cannot create " << output_path << " (fourcc " << code << ")" << std::endl;
+        return false;
+    }
+
+    stats = VideoProcessingStats();
+    SpscQueue<cv::Mat> decoded(options.queue_capacity);
+    SpscQueue<cv::Mat> censored(options.queue_capacity);
+    // encoder -> decoder, every buffer in flight fits, so cv::VideoCapture::read never allocates in steady state
+    SpscQueue<cv::Mat> recycled(2 * options.queue_capacity + 2);
+    std::atomic<bool> decodeDone{ false };
+    std::atomic<bool> detectDone{ false };
+    std::atomic<bool> cancelled{ false };
+    auto wall_start = std::chrono::steady_clock::now();
+
+    std::thread decodeThread([&]() {
+        double push_wait = 0.0;
+        while (!cancelled.load(std::memory_order_acquire)) {
+            cv::Mat frame;
+            recycled.try_pop(frame);
+            Timer decode_timer = Timer(stats.decode_seconds, true);
+            bool ok = capture.read(frame);
+            decode_timer.Stop();
+            if (!ok || frame.empty() || !push_frame(decoded, frame, cancelled, push_wait)) {
+                break;
+            }
+        }
+        decodeDone.store(true, std::memory_order_release);
+    });
+
+    std::thread encodeThread([&]() {
+        double pop_wait = 0.0;
+        cv::Mat frame;
+        while (pop_frame(censored, frame, detectDone, pop_wait)) {
+            Timer encode_timer = Timer(stats.encode_seconds, true);
+            writer.write(frame);
+            encode_timer.Stop();
+            recycled.try_push(frame);  // a full queue just frees the buffer
+            frame.release();
+        }
+    });
+
+    std::exception_ptr error;
+    try {
+        TrackingPredictor tracking(model, options.inference_interval);
+        float conf = options.conf;
+        float iou = options.iou;
+        float mask_threshold = options.mask_threshold;
+        CensorScratch censor_scratch;
+        cv::Mat frame;
+        std::vector<YoloResults> results;  // reused, predict_once fills it without allocating in steady state
+        while (pop_frame(decoded, frame, decodeDone, stats.starved_seconds)) {
+            Timer detect_timer = Timer(stats.detect_seconds, true);
+            if (options.inference_interval > 1) {
+                results = tracking.predict_once(frame, conf, iou, mask_threshold, options.conversion_code);
+            }
+            else {
+                model.predict_once(frame, results, conf, iou, mask_threshold, options.conversion_code);
+            }
+            detect_timer.Stop();
+            if (options.inference_interval <= 1 || stats.frames % options.inference_interval == 0) {
+                ++stats.inferred_frames;
+            }
+
+            Timer censor_timer = Timer(stats.censor_seconds, true);
+            plot_results_censored(frame, results, options.censor, censor_scratch);
+            censor_timer.Stop();
+
+            ++stats.frames;
+            push_frame(censored, frame, cancelled, stats.blocked_seconds);
+            frame.release();
+        }
+    }
+    catch (...) {
+        error = std::current_exception();
+        cancelled.store(true, std::memory_order_release);
+    }
+
+    detectDone.store(true, std::memory_order_release);
+    decodeThread.join();
+    encodeThread.join();
+    writer.release();
+    stats.wall_seconds = seconds_since(wall_start);
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return true;
+}
+
+void print_video_stats(const VideoProcessingStats& stats) {
+    auto per_frame_ms = [&](double seconds) { return stats.frames > 0 ? seconds * 1000.0 / stats.frames : 0.0; };
+    std::cout << std::fixed << std::setprecision(1)
+        << stats.frames << " frame(s) (" << stats.inferred_frames << " inferred) in " << stats.wall_seconds << "s, "
+        << stats.fps() << " fps end-to-end" << std::endl
+        << std::setprecision(2)
+        << "  decode  " << per_frame_ms(stats.decode_seconds) << "ms/frame (decoder thread)" << std::endl
+        << "  detect  " << per_frame_ms(stats.detect_seconds) << "ms/frame" << std::endl
+        << "  censor  " << per_frame_ms(stats.censor_seconds) << "ms/frame" << std::endl
+        << "  encode  " << per_frame_ms(stats.encode_seconds) << "ms/frame (encoder thread)" << std::endl
+        << "  detector waited " << stats.starved_seconds << "s for the decoder and " << stats.blocked_seconds << "s for the encoder" << std::endl;
+}
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""Writes a QDQ/INT8 version of the NudeNet model from calibration tensors.
+
+The tensors come from `NudeNetCPPDemo calibrate <image_dir> [model] [calibration.npy]`, which runs local images
+through the C++ preprocessing, so the activation ranges are collected on exactly what the model sees at runtime.
+
+    python tools/quantize_int8.py nudenet-best.onnx calibration.npy nudenet-best.int8.onnx
+
+Requires `pip install onnx onnxruntime numpy`. Compare the result with
+`NudeNetCPPDemo compare <image_dir> nudenet-best.onnx nudenet-best.int8.onnx` before shipping it.
+"""
+
+import argparse
+import os
+import tempfile
+
+import numpy as np
+import onnx
+from onnxruntime.quantization import CalibrationDataReader, CalibrationMethod, QuantFormat, QuantType, quantize_static
+from onnxruntime.quantization.shape_inference import quant_pre_process
+
+
+class TensorReader(CalibrationDataReader):
+    """Feeds the calibration tensors one image at a time."""
+
+    def __init__(self, tensors, input_name, batch):
+        self.tensors = tensors
+        self.input_name = input_name
+        self.batch = batch
+        self.index = 0
+
+    def get_next(self):
+        if self.index + self.batch > len(self.tensors):
+            return None
+        data = np.ascontiguousarray(self.tensors[self.index:self.index + self.batch])
+        self.index += self.batch
+        return {self.input_name: data}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("model", help="FP32 model, e.g. nudenet-best.onnx")
+    parser.add_argument("calibration", help="[N, ch, H, W] float32 .npy written by `NudeNetCPPDemo calibrate`")
+    parser.add_argument("output", help="path of the QDQ model, e.g. nudenet-best.int8.onnx")
+    parser.add_argument("--method", choices=["minmax", "entropy", "percentile"], default="percentile",
+                        help="how activation ranges are derived from the collected histograms")
+    parser.add_argument("--per-channel", action=argparse.BooleanOptionalAction, default=True,
+                        help="per output channel weight scales (better accuracy, same speed on x86)")
+    args = parser.parse_args()
+
+    tensors = np.load(args.calibration, mmap_mode="r")
+    if tensors.ndim != 4 or len(tensors) == 0:
+        raise SystemExit(f"{args.calibration}: expected a non-empty [N, ch, H, W] tensor, got shape {tensors.shape}")
+
+    model = onnx.load(args.model)
+    model_input = model.graph.input[0]
+    batch_dim = model_input.type.tensor_type.shape.dim[0]
+    batch = batch_dim.dim_value if batch_dim.HasField("dim_value") and batch_dim.dim_value > 0 else 1
+
+    with tempfile.TemporaryDirectory() as work_dir:
+        # shape inference + graph cleanup, quantize_static places better Q/DQ pairs on the prepared graph
+        prepared = os.path.join(work_dir, "prepared.onnx")
+        quant_pre_process(args.model, prepared, skip_symbolic_shape=True)
+
+        methods = {"minmax": CalibrationMethod.MinMax, "entropy": CalibrationMethod.Entropy,
+                   "percentile": CalibrationMethod.Percentile}
+        quantize_static(
+            prepared,
+            args.output,
+            TensorReader(tensors, model_input.name, batch),
+            quant_format=QuantFormat.QDQ,
+            activation_type=QuantType.QUInt8,
+            weight_type=QuantType.QInt8,
+            per_channel=args.per_channel,
+            calibrate_method=methods[args.method],
+            # the detection head mixes box coordinates (0..imgsz) and class scores (0..1) in one tensor,
+            # keeping it in float avoids losing the score resolution
+            nodes_to_exclude=[node.name for node in model.graph.node if node.output and node.output[0] in
+                              {output.name for output in model.graph.output}],
+        )
+
+    # AutoBackendOnnx reads imgsz, stride, names, ... from the metadata, make sure the quantized model keeps it
+    quantized = onnx.load(args.output)
+    existing = {prop.key for prop in quantized.metadata_props}
+    for prop in model.metadata_props:
+        if prop.key not in existing:
+            quantized.metadata_props.add(key=prop.key, value=prop.value)
+    onnx.save(quantized, args.output)
+
+    size_fp32 = os.path.getsize(args.model) / 1e6
+    size_int8 = os.path.getsize(args.output) / 1e6
+    print(f"Wrote {args.output} ({size_int8:.1f}MB, fp32 {size_fp32:.1f}MB) from {len(tensors) // batch * batch} calibration image(s)")
+
+
+if __name__ == "__main__":
+    main()
@@ -3,7 +3,7 @@
 struct obs_source_info nsfw_filter_info = {
 	.id = "nsfw_filter",
 	.type = OBS_SOURCE_TYPE_FILTER,
-	.output_flags = OBS_SOURCE_VIDEO,
+	.output_flags = OBS_SOURCE_VIDEO | OBS_SOURCE_ASYNC,
 	.get_name = nsfw_filter_getname,
 	.create = nsfw_filter_create,
 	.destroy = nsfw_filter_destroy,
@@ -12,5 +12,5 @@ struct obs_source_info nsfw_filter_info = {
 	.update = nsfw_filter_update,
 	.activate = nsfw_filter_activate,
 	.deactivate = nsfw_filter_deactivate,
-	.video_render = nsfw_filter_video_render,
+	.filter_video = nsfw_filter_video,
 };
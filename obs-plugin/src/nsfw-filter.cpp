@@ -1,8 +1,375 @@
 #include <plugin-support.h>
 #include "nsfw-filter.h"
 
-const char* nsfw_filter_getname(void* unused)
+#include <util/platform.h>
+
+#include <memory>
+
+#include "latency_histogram.h"
+#include "nn/scheduled_frame_filter.h"
+#include "nn/session_config.h"
+#include "nn_utils.h"
+#include "scheduler.h"
+
+#define SETTING_GRAPH_OPTIMIZATION_LEVEL "graph_optimization_level"
+#define SETTING_INTRA_OP_THREADS "intra_op_threads"
+#define SETTING_INTER_OP_THREADS "inter_op_threads"
+#define SETTING_PARALLEL_EXECUTION "parallel_execution"
+#define SETTING_MEM_PATTERN "mem_pattern"
+#define SETTING_ALLOW_SPINNING "allow_spinning"
+#define SETTING_CACHE_OPTIMIZED_MODEL "cache_optimized_model"
+#define SETTING_TARGET_LATENCY_MS "target_latency_ms"
+#define SETTING_MAX_CPU_SHARE "max_cpu_share"
+#define SETTING_MAX_INFERENCE_INTERVAL "max_inference_interval"
+#define SETTING_LOG_LATENCY "log_latency"
+#define SETTING_CENSOR_MODE "censor_mode"
+
+#define MODEL_FILENAME "nudenet-best.onnx"
+#define OPTIMIZED_MODEL_FILENAME "nudenet-optimized.onnx"
+#define LATENCY_REPORT_INTERVAL_SECONDS 60.0
+
+struct nsfw_filter {
+	obs_source_t *source;
+	SessionConfig session_config;
+	// runs the detector on its own thread on the frames its scheduler
+	// picks, null when the model is missing
+	std::unique_ptr<ScheduledFrameFilter> frame_filter;
+	// timestamp (ns) of the previous frame, 0 before the first one
+	uint64_t last_timestamp;
+	// time since the latency percentiles were last written to the log
+	double seconds_since_latency_report;
+};
+
+static FrameFormat frame_format_of(enum video_format format)
+{
+	switch (format) {
+	case VIDEO_FORMAT_BGRA:
+		return FrameFormat::BGRA;
+	case VIDEO_FORMAT_BGRX:
+		return FrameFormat::BGRX;
+	case VIDEO_FORMAT_RGBA:
+		return FrameFormat::RGBA;
+	case VIDEO_FORMAT_NV12:
+		return FrameFormat::NV12;
+	case VIDEO_FORMAT_I420:
+		return FrameFormat::I420;
+	case VIDEO_FORMAT_YUY2:
+		return FrameFormat::YUY2;
+	default:
+		return FrameFormat::Unsupported;
+	}
+}
+
+/*
+ * libobs only hands over the YUV -> RGB matrix of a frame, R = m[0] * Y + m[2] * V + m[3].
+ * m[2] / m[0] is 2 * (1 - Kr), times 219 / 224 for limited range, which tells BT.601 (Kr 0.299)
+ * from BT.709 (Kr 0.2126).
+ */
+static YuvMatrix yuv_matrix_of(const struct obs_source_frame *frame)
+{
+	if (frame->color_matrix[0] <= 0.0f) {
+		return YuvMatrix::BT709;
+	}
+	float range = frame->full_range ? 1.0f : 219.0f / 224.0f;
+	float kr = 1.0f - frame->color_matrix[2] /
+				  (2.0f * range * frame->color_matrix[0]);
+	return kr > 0.25f ? YuvMatrix::BT601 : YuvMatrix::BT709;
+}
+
+static FrameFilterOptions frame_filter_options_from_settings(obs_data_t *settings)
+{
+	FrameFilterOptions options;
+	parse_censor_mode(obs_data_get_string(settings, SETTING_CENSOR_MODE),
+			  options.censor.mode);
+	return options;
+}
+
+static SchedulerOptions scheduler_options_from_settings(obs_data_t *settings)
+{
+	SchedulerOptions options;
+	options.target_latency =
+		(double)obs_data_get_int(settings, SETTING_TARGET_LATENCY_MS) /
+		1000.0;
+	options.max_cpu_share =
+		(double)obs_data_get_int(settings, SETTING_MAX_CPU_SHARE) /
+		100.0;
+	options.max_interval =
+		(int)obs_data_get_int(settings, SETTING_MAX_INFERENCE_INTERVAL);
+	return options;
+}
+
+static bool scheduler_options_equal(const SchedulerOptions &a,
+				    const SchedulerOptions &b)
+{
+	return a.target_latency == b.target_latency &&
+	       a.max_cpu_share == b.max_cpu_share &&
+	       a.min_interval == b.min_interval &&
+	       a.max_interval == b.max_interval;
+}
+
+static SessionConfig session_config_from_settings(obs_data_t *settings)
+{
+	SessionConfig config;
+	set_session_config_value(
+		config, "graph_optimization_level",
+		obs_data_get_string(settings,
+				    SETTING_GRAPH_OPTIMIZATION_LEVEL));
+	config.intra_op_threads =
+		(int)obs_data_get_int(settings, SETTING_INTRA_OP_THREADS);
+	config.inter_op_threads =
+		(int)obs_data_get_int(settings, SETTING_INTER_OP_THREADS);
+	config.execution_mode =
+		obs_data_get_bool(settings, SETTING_PARALLEL_EXECUTION)
+			? SessionExecutionMode::Parallel
+			: SessionExecutionMode::Sequential;
+	config.mem_pattern = obs_data_get_bool(settings, SETTING_MEM_PATTERN);
+	config.allow_spinning =
+		obs_data_get_bool(settings, SETTING_ALLOW_SPINNING);
+
+	if (obs_data_get_bool(settings, SETTING_CACHE_OPTIMIZED_MODEL)) {
+		char *config_dir = obs_module_config_path("");
+		if (config_dir) {
+			os_mkdirs(config_dir);
+			bfree(config_dir);
+		}
+		char *path = obs_module_config_path(OPTIMIZED_MODEL_FILENAME);
+		if (path) {
+			config.optimized_model_path = path;
+			bfree(path);
+		}
+	}
+	return config;
+}
+
+static bool session_config_equal(const SessionConfig &a,
+				 const SessionConfig &b)
+{
+	return a.optimization_level == b.optimization_level &&
+	       a.intra_op_threads == b.intra_op_threads &&
+	       a.inter_op_threads == b.inter_op_threads &&
+	       a.execution_mode == b.execution_mode &&
+	       a.mem_pattern == b.mem_pattern &&
+	       a.cpu_mem_arena == b.cpu_mem_arena &&
+	       a.memory_map_model == b.memory_map_model &&
+	       a.allow_spinning == b.allow_spinning &&
+	       a.optimized_model_path == b.optimized_model_path;
+}
+
+const char *nsfw_filter_getname(void *unused)
 {
 	UNUSED_PARAMETER(unused);
 	return obs_module_text("NSFWFilter");
-}
\ No newline at end of file
+}
+
+void *nsfw_filter_create(obs_data_t *settings, obs_source_t *source)
+{
+	nsfw_filter *filter = new nsfw_filter();
+	filter->source = source;
+	filter->session_config = session_config_from_settings(settings);
+
+	// the model is loaded on the worker thread, frames pass through until then
+	char *model_path = obs_module_file(MODEL_FILENAME);
+	if (model_path) {
+		filter->frame_filter = std::make_unique<ScheduledFrameFilter>(
+			model_path, filter->session_config);
+		bfree(model_path);
+	} else {
+		obs_log(LOG_WARNING,
+			"%s not found in the plugin data, frames pass through uncensored",
+			MODEL_FILENAME);
+	}
+	nsfw_filter_update(filter, settings);
+	return filter;
+}
+
+void nsfw_filter_destroy(void *data)
+{
+	nsfw_filter *filter = static_cast<nsfw_filter *>(data);
+	delete filter;
+}
+
+void nsfw_filter_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_string(settings, SETTING_GRAPH_OPTIMIZATION_LEVEL,
+				    "all");
+	// a streaming PC runs the encoder and the game next to the filter,
+	// so do not claim every core and do not spin between frames
+	obs_data_set_default_int(settings, SETTING_INTRA_OP_THREADS, 2);
+	obs_data_set_default_int(settings, SETTING_INTER_OP_THREADS, 1);
+	obs_data_set_default_bool(settings, SETTING_PARALLEL_EXECUTION, false);
+	obs_data_set_default_bool(settings, SETTING_MEM_PATTERN, true);
+	obs_data_set_default_bool(settings, SETTING_ALLOW_SPINNING, false);
+	obs_data_set_default_bool(settings, SETTING_CACHE_OPTIMIZED_MODEL,
+				  true);
+	// leave at least half of the CPU to the encoder
+	obs_data_set_default_int(settings, SETTING_TARGET_LATENCY_MS, 33);
+	obs_data_set_default_int(settings, SETTING_MAX_CPU_SHARE, 50);
+	obs_data_set_default_int(settings, SETTING_MAX_INFERENCE_INTERVAL, 8);
+	obs_data_set_default_bool(settings, SETTING_LOG_LATENCY, false);
+	obs_data_set_default_string(settings, SETTING_CENSOR_MODE, "fill");
+}
+
+obs_properties_t *nsfw_filter_properties(void *data)
+{
+	UNUSED_PARAMETER(data);
+	obs_properties_t *props = obs_properties_create();
+
+	obs_property_t *level = obs_properties_add_list(
+		props, SETTING_GRAPH_OPTIMIZATION_LEVEL,
+		obs_module_text("GraphOptimizationLevel"), OBS_COMBO_TYPE_LIST,
+		OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(
+		level, obs_module_text("GraphOptimizationLevel.Disable"),
+		"disable");
+	obs_property_list_add_string(
+		level, obs_module_text("GraphOptimizationLevel.Basic"),
+		"basic");
+	obs_property_list_add_string(
+		level, obs_module_text("GraphOptimizationLevel.Extended"),
+		"extended");
+	obs_property_list_add_string(
+		level, obs_module_text("GraphOptimizationLevel.All"), "all");
+
+	obs_properties_add_int(props, SETTING_INTRA_OP_THREADS,
+			       obs_module_text("IntraOpThreads"), 0, 64, 1);
+	obs_properties_add_int(props, SETTING_INTER_OP_THREADS,
+			       obs_module_text("InterOpThreads"), 0, 64, 1);
+	obs_properties_add_bool(props, SETTING_PARALLEL_EXECUTION,
+				obs_module_text("ParallelExecution"));
+	obs_properties_add_bool(props, SETTING_MEM_PATTERN,
+				obs_module_text("MemPattern"));
+	obs_properties_add_bool(props, SETTING_ALLOW_SPINNING,
+				obs_module_text("AllowSpinning"));
+	obs_properties_add_bool(props, SETTING_CACHE_OPTIMIZED_MODEL,
+				obs_module_text("CacheOptimizedModel"));
+	obs_properties_add_int(props, SETTING_TARGET_LATENCY_MS,
+			       obs_module_text("TargetLatency"), 5, 1000, 1);
+	obs_properties_add_int_slider(props, SETTING_MAX_CPU_SHARE,
+				      obs_module_text("MaxCpuShare"), 5, 100,
+				      5);
+	obs_properties_add_int(props, SETTING_MAX_INFERENCE_INTERVAL,
+			       obs_module_text("MaxInferenceInterval"), 1, 60,
+			       1);
+	obs_properties_add_bool(props, SETTING_LOG_LATENCY,
+				obs_module_text("LogLatency"));
+
+	obs_property_t *censor = obs_properties_add_list(
+		props, SETTING_CENSOR_MODE, obs_module_text("CensorMode"),
+		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(
+		censor, obs_module_text("CensorMode.Fill"), "fill");
+	obs_property_list_add_string(
+		censor, obs_module_text("CensorMode.Pixelate"), "pixelate");
+	obs_property_list_add_string(
+		censor, obs_module_text("CensorMode.Blur"), "blur");
+	return props;
+}
+
+void nsfw_filter_update(void *data, obs_data_t *settings)
+{
+	nsfw_filter *filter = static_cast<nsfw_filter *>(data);
+	// the histograms are process wide, the last updated filter decides
+	set_latency_metrics_enabled(
+		obs_data_get_bool(settings, SETTING_LOG_LATENCY));
+
+	SchedulerOptions scheduler_options =
+		scheduler_options_from_settings(settings);
+	if (filter->frame_filter &&
+	    !scheduler_options_equal(
+		    scheduler_options,
+		    filter->frame_filter->getSchedulerOptions())) {
+		filter->frame_filter->setSchedulerOptions(scheduler_options);
+		obs_log(LOG_INFO,
+			"scheduler: target latency=%.0fms, max cpu share=%.0f%%, max inference interval=%d",
+			scheduler_options.target_latency * 1000.0,
+			scheduler_options.max_cpu_share * 100.0,
+			scheduler_options.max_interval);
+	}
+
+	if (filter->frame_filter) {
+		filter->frame_filter->getFilter().setOptions(
+			frame_filter_options_from_settings(settings));
+	}
+
+	SessionConfig config = session_config_from_settings(settings);
+	if (session_config_equal(config, filter->session_config)) {
+		return;
+	}
+
+	filter->session_config = config;
+	if (filter->frame_filter) {
+		filter->frame_filter->getFilter().setSessionConfig(config);
+	}
+	obs_log(LOG_INFO,
+		"session options: optimization=%s, intra_op_threads=%d, inter_op_threads=%d, execution_mode=%s, spinning=%d, optimized model cache=%s",
+		optimization_level_name(config.optimization_level).c_str(),
+		config.intra_op_threads, config.inter_op_threads,
+		execution_mode_name(config.execution_mode).c_str(),
+		config.allow_spinning,
+		config.optimized_model_path.empty()
+			? "off"
+			: config.optimized_model_path.c_str());
+}
+
+void nsfw_filter_activate(void *data)
+{
+	UNUSED_PARAMETER(data);
+}
+
+void nsfw_filter_deactivate(void *data)
+{
+	UNUSED_PARAMETER(data);
+}
+
+static void report_latency(nsfw_filter *filter, double frame_seconds)
+{
+	if (!latency_metrics_enabled()) {
+		return;
+	}
+	filter->seconds_since_latency_report += frame_seconds;
+	if (filter->seconds_since_latency_report <
+	    LATENCY_REPORT_INTERVAL_SECONDS) {
+		return;
+	}
+	filter->seconds_since_latency_report = 0.0;
+	std::string report = format_latency_report();
+	if (!report.empty()) {
+		obs_log(LOG_INFO, "latency over the last %.0fs:\n%s",
+			LATENCY_REPORT_INTERVAL_SECONDS, report.c_str());
+		reset_latency_metrics();
+	}
+}
+
+struct obs_source_frame *nsfw_filter_video(void *data,
+					   struct obs_source_frame *frame)
+{
+	nsfw_filter *filter = static_cast<nsfw_filter *>(data);
+	FrameFormat format = frame_format_of(frame->format);
+	if (!filter->frame_filter || format == FrameFormat::Unsupported) {
+		return frame;
+	}
+
+	double frame_seconds = 0.0;
+	if (filter->last_timestamp &&
+	    frame->timestamp > filter->last_timestamp) {
+		frame_seconds =
+			(double)(frame->timestamp - filter->last_timestamp) /
+			1e9;
+	}
+	filter->last_timestamp = frame->timestamp;
+
+	FrameView view;
+	view.format = format;
+	view.width = (int)frame->width;
+	view.height = (int)frame->height;
+	view.matrix = yuv_matrix_of(frame);
+	view.fullRange = frame->full_range;
+	for (int i = 0; i < 3; i++) {
+		view.data[i] = frame->data[i];
+		view.linesize[i] = (int)frame->linesize[i];
+	}
+	filter->frame_filter->filter(view, frame_seconds);
+
+	report_latency(filter, frame_seconds);
+	return frame;
+}
@@ -15,8 +15,8 @@ obs_properties_t *nsfw_filter_properties(void *data);
 void nsfw_filter_update(void *data, obs_data_t *settings);
 void nsfw_filter_activate(void *data);
 void nsfw_filter_deactivate(void *data);
-void nsfw_filter_video_tick(void *data, float seconds);
-void nsfw_filter_video_render(void *data, gs_effect_t *_effect);
+struct obs_source_frame *nsfw_filter_video(void *data,
+					   struct obs_source_frame *frame);
 
 #ifdef __cplusplus
 }